@@ -23,14 +23,22 @@
 #include "vmips.h"
 #include "options.h"
 #include "accesstypes.h"
+#include "hostprof.h"
+#include "stats.h"
 #include <cassert>
 
-AcceleratorBase::AcceleratorBase()
+AcceleratorBase::AcceleratorBase() : busy_cycles(0), eventtrace(NULL)
 {
 	//make localbus
 	localBus = new LocalMapper();
 }
 
+void AcceleratorBase::register_stats(StatsRegistry &stats,
+	const std::string &prefix)
+{
+	stats.add_counter(prefix + ".busy_cycles", &busy_cycles);
+}
+
 /*******************************  LocalMapper  *******************************/
 int LocalMapper::add_range(Range *r) {
 	assert (r && "Null range object passed to Mapper::add_range()");
@@ -155,7 +163,7 @@ void NetworkInterfaceConfig::store_word(uint32 offset, uint32 data, DeviceExc *c
 			dmaKicked = true;
 			break;
 		case DMA_DST_OFFSET:
-			dma_dst = data & DMA_DST_MASK;
+			dma_dst = data & ((RouterUtils::node_mask() << LOCAL_MEMA_MSB) | LOCAL_MEMA_MASK);
 			break;
 		case DMA_SRC_OFFSET:
 			dma_src = data & DMA_SRC_MASK;
@@ -174,19 +182,22 @@ void NetworkInterfaceConfig::store_word(uint32 offset, uint32 data, DeviceExc *c
 }
 
 /*******************************  CubeAccelerator  *******************************/
-CubeAccelerator::CubeAccelerator(uint32 node_ID_, Router* upperRouter, uint32 config_addr_base, bool dmac_en_)
+CubeAccelerator::CubeAccelerator(uint32 node_ID_, uint32 config_addr_base, bool dmac_en_)
 	: node_ID(node_ID_), dmac_en(dmac_en_)
 {
 	//make router ports
 	rtRx = new RouterPortSlave(iready); //receiver
 	rtTx = new RouterPortMaster(); //sender
 	//build router
-	localRouter = new Router(rtTx, rtRx, upperRouter, node_ID);
+	localRouter = new Router(rtTx, rtRx, node_ID);
 
 	//setup network interface
 	nif_state = nif_next_state = CNIF_IDLE;
 	packetMaxSize = (machine->opt->option("dcachebsize")->num / 4);
-	mem_bandwidth = machine->opt->option("mem_bandwidth")->num;
+	nif_bandwidth = machine->opt->option("nif_bandwidth")->num;
+	if (nif_bandwidth == 0) {
+		nif_bandwidth = machine->mem_bandwidth;
+	}
 	nif_config = new NetworkInterfaceConfig(config_addr_base, dmac_en);
 	localBus->map_at_local_address(nif_config, config_addr_base);
 
@@ -223,8 +234,8 @@ void CubeAccelerator::nif_step()
 							break;
 						default:
 							if (machine->opt->option("routermsg")->flag) {
-								fprintf(stderr, "%s: unknown message type(%d) is received (flit %X_%08X)\n",
-										accelerator_name(), reg_mtype, flit.ftype, flit.data);
+								fprintf(stderr, "%s: unknown message type(%d) is received (flit %X_%08llX)\n",
+										accelerator_name(), reg_mtype, flit.ftype, (unsigned long long)flit.data);
 							}
 					}
 				}
@@ -246,7 +257,7 @@ void CubeAccelerator::nif_step()
 			nif_next_state = CNIF_IDLE;
 			break;
 		case CNIF_BR_DATA:
-			for (int i = 0; i < mem_bandwidth; i++) {
+			for (int i = 0; i < nif_bandwidth; i++) {
 				read_addr = reg_mema + (packetMaxSize - dcount--) * 4;
 				RouterUtils::make_data_flit(&sflit, localBus->fetch_word(read_addr), dcount == 0);
 				rtTx->send(&sflit, nif_config->getVCnormal());
@@ -269,7 +280,7 @@ void CubeAccelerator::nif_step()
 			}
 			break;
 		case CNIF_BW_DATA:
-			for (int i = 0; i < mem_bandwidth; i++) {
+			for (int i = 0; i < nif_bandwidth; i++) {
 				if (rtRx->haveData()) {
 					rtRx->getData(&flit, &recv_vch);
 					write_addr = reg_mema + (packetMaxSize - dcount) * 4;
@@ -297,7 +308,7 @@ void CubeAccelerator::nif_step()
 			}
 			break;
 		case CNIF_DMA_DATA:
-			for (int i = 0; i < mem_bandwidth; i++) {
+			for (int i = 0; i < nif_bandwidth; i++) {
 				read_addr = nif_config->getDMAsrc() + packetMaxSize * 4 * (nif_config->getDMAlen() - remain_dma_len)
 							+ (packetMaxSize - dcount--) * 4;
 				RouterUtils::make_data_flit(&sflit, localBus->fetch_word(read_addr), dcount == 0);
@@ -354,8 +365,10 @@ void CubeAccelerator::nif_step()
 
 void CubeAccelerator::step()
 {
+	HostProfScope prof(HOSTPROF_ACCEL);
+
 	//handle data to/from router
-	for (int i = 0; i < mem_bandwidth; i++) {
+	for (int i = 0; i < nif_bandwidth; i++) {
 		localRouter->step();
 	}
 
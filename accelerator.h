@@ -39,7 +39,7 @@
 #define NIF_CONFIG_SIZE			0x900 //default 0x4100~0x5000
 #define DMA_KICK_OFFSET			0x00000
 #define DMA_DST_OFFSET			0x00100
-#define DMA_DST_MASK			0xFFFFFF //[23:0]
+#define DMA_DST_MASK			0xFFFFFF //[23:0] with the default node_bits
 #define DMA_SRC_OFFSET			0x00200
 #define DMA_SRC_MASK			0x3FFFFF //[21:0]
 #define DMA_LEN_OFFSET			0x00300
@@ -74,6 +74,8 @@
 
 class Range;
 class Mapper;
+class StatsRegistry;
+class EventTrace;
 
 class LocalMapper {
 private:
@@ -139,7 +141,7 @@ public:
 
 	void clearReg();
 	uint32 getDMADstAddr()	{ return dma_dst & LOCAL_MEMA_MASK; }
-	uint32 getDMADstID()	{ return dma_dst >> LOCAL_MEMA_MSB; }
+	uint32 getDMADstID()	{ return dma_dst >> LOCAL_MEMA_MSB; } //node_bits bits
 	uint32 getDMAsrc()		{ return dma_src; }
 	uint32 getDMAlen()		{ return dma_len; }
 	uint32 getVCnormal()	{ return vc_normal; }
@@ -160,6 +162,10 @@ protected:
 	AcceleratorBase();
 	//data/address bus
 	LocalMapper* localBus;
+	//cycles in which the core is working
+	uint64 busy_cycles;
+	//timeline of the activity
+	EventTrace *eventtrace;
 
 	virtual void core_step() = 0;
 	virtual void core_reset() = 0;
@@ -169,6 +175,13 @@ public:
 	virtual void setup() = 0;
 	//accelerator name
 	virtual const char *accelerator_name() = 0;
+	//register the statistics of the submodules
+	virtual void register_stats(StatsRegistry &stats,
+		const std::string &prefix);
+	uint64 get_busy_cycles() { return busy_cycles; }
+	//write the activity of the core to the timeline
+	virtual void attach_eventtrace(EventTrace *trace,
+		const std::string &process) { eventtrace = trace; };
 
 };
 
@@ -190,7 +203,7 @@ private:
 	int packetMaxSize;
 	int nif_state, nif_next_state;
 	bool dmac_en;
-	int mem_bandwidth;
+	int nif_bandwidth;
 	int remain_dma_len;
 	bool done_pending;
 	bool dma_after_done_en;
@@ -200,7 +213,7 @@ private:
 protected:
 	//constructor
 	CubeAccelerator() : dmac_en(false) {}; //for bus mode, nothing to do
-	CubeAccelerator(uint32 node_ID_, Router* upperRouter,
+	CubeAccelerator(uint32 node_ID_,
 		uint32 config_addr_base = NIF_CONFIG_BASE, bool dmac_en_ = true);
 
 public:
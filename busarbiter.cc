@@ -20,32 +20,432 @@
 
 
 #include "busarbiter.h"
+#include "options.h"
+#include "error.h"
+#include "stats.h"
+#include <cassert>
 #include <cstddef>
+#include <algorithm>
+#include <string>
+#include <cstdio>
 
 BusArbiter::BusArbiter()
 {
     last_released_cycle = 0;
     bus_holder = nullptr;
+    stats = nullptr;
+
+    bandwidth = machine->opt->option("bus_bandwidth")->num;
+    if (bandwidth == 0) {
+        // compatible with the word-based mem_bandwidth
+        bandwidth = machine->mem_bandwidth * 4;
+    }
+    credit = bandwidth;
+    credit_cycle = 0;
+
+    split = machine->opt->option("bus_split")->flag;
+    default_outstanding = machine->opt->option("bus_outstanding")->num;
+    if (default_outstanding < 1) {
+        fatal_error("bus_outstanding must be 1 or more\n");
+    }
+    std::string order = std::string(machine->opt->option("bus_order")->str);
+    if (order == std::string("inorder")) {
+        in_order = true;
+    } else if (order == std::string("ooo")) {
+        in_order = false;
+    } else {
+        fatal_error("unknown bus response order: %s\n", order.c_str());
+    }
+    next_request_slot = 0;
+    last_address_grant = (uint32)-1;
+
+    std::string arb = std::string(machine->opt->option("bus_arbitration")->str);
+    if (arb == std::string("fcfs")) {
+        policy = BUS_ARB_FCFS;
+    } else if (arb == std::string("fixed")) {
+        policy = BUS_ARB_FIXED;
+    } else if (arb == std::string("wrr")) {
+        policy = BUS_ARB_WRR;
+    } else if (arb == std::string("tdma")) {
+        policy = BUS_ARB_TDMA;
+    } else if (arb == std::string("age")) {
+        policy = BUS_ARB_AGE;
+    } else {
+        fatal_error("unknown bus arbitration policy: %s\n", arb.c_str());
+    }
+    tdma_slot = machine->opt->option("bus_tdma_slot")->num;
+    if (tdma_slot == 0) {
+        tdma_slot = 1;
+    }
+    rr_turn = 0;
+    rr_tokens = 0;
 }
 
 bool BusArbiter::acquire_bus(DeviceExc *client)
 {
-    if (last_released_cycle == machine->num_cycles) {
-        return false;
-    } else if (bus_holder == nullptr) {
-        bus_holder = client;
+    uint32 now = machine->num_cycles;
+
+    if (split && policy == BUS_ARB_FCFS) {
+        // address phases are given in the order of the requests
         return true;
     } else if (client == bus_holder) {
         return true;
-    } else {
+    }
+
+    Master *m = find_master(client, true);
+    if (split && m->address_granted) {
+        return true;
+    }
+    if (!m->waiting || m->last_request_cycle + 1 < now) {
+        // new request
+        m->waiting = true;
+        m->request_since = now;
+    }
+    m->last_request_cycle = now;
+
+    if (split) {
+        // the masters share the data phases, and the policy chooses
+        // the one which takes the next free address phase
+        if (last_address_grant == now || (int32)(next_request_slot - now) > 0 ||
+                select_master(m) != m) {
+            return false;
+        }
+        m->address_granted = true;
+        m->waiting = false;
+        m->grant_cycle = now;
+        last_address_grant = now;
+        record_grant(m, now - m->request_since);
+        return true;
+    }
+
+    if (last_released_cycle == (int32)now || bus_holder != nullptr) {
+        return false;
+    } else if (policy != BUS_ARB_FCFS && select_master(m) != m) {
         return false;
     }
+
+    bus_holder = client;
+    m->waiting = false;
+    m->grant_cycle = now;
+    record_grant(m, now - m->request_since);
+    return true;
 }
 
 void BusArbiter::release_bus(DeviceExc *client)
 {
-    if (bus_holder == client) {
+    if (split) {
+        Master *m = find_master(client);
+        if (m != nullptr) {
+            m->address_granted = false;
+        }
+    } else if (bus_holder == client) {
+        Master *m = find_master(client);
+        m->busy_cycles += machine->num_cycles - m->grant_cycle + 1;
         bus_holder = nullptr;
         last_released_cycle = machine->num_cycles;
     }
-}
\ No newline at end of file
+}
+
+/* Choose the master to be granted among REQUESTER and the masters which
+   have been waiting since the previous cycles. The masters stepped
+   later in this cycle are not known yet, so a lone requester on a free
+   bus is granted immediately. */
+BusArbiter::Master *BusArbiter::select_master(Master *requester)
+{
+    uint32 now = machine->num_cycles;
+    Master *winner = nullptr;
+    int n = masters.size();
+
+    auto requesting = [now](const Master &m) {
+        return m.waiting && m.last_request_cycle + 1 >= now;
+    };
+
+    switch (policy) {
+        case BUS_ARB_FIXED:
+            for (auto &m : masters) {
+                if (requesting(m) &&
+                        (winner == nullptr || m.weight > winner->weight)) {
+                    winner = &m;
+                }
+            }
+            break;
+        case BUS_ARB_AGE:
+            for (auto &m : masters) {
+                if (requesting(m) && (winner == nullptr ||
+                        (int32)(m.request_since - winner->request_since) < 0)) {
+                    winner = &m;
+                }
+            }
+            break;
+        case BUS_ARB_WRR:
+            for (int i = 0; i < n; i++) {
+                Master &m = masters[(rr_turn + i) % n];
+                if (requesting(m)) {
+                    winner = &m;
+                    break;
+                }
+            }
+            break;
+        case BUS_ARB_TDMA: {
+            // each master owns WEIGHT slots in a frame
+            uint32 frame = 0;
+            for (auto &m : masters) {
+                frame += m.weight;
+            }
+            uint32 slot = (now / tdma_slot) % frame;
+            for (auto &m : masters) {
+                if (slot < m.weight) {
+                    winner = &m;
+                    break;
+                }
+                slot -= m.weight;
+            }
+            break;
+        }
+        default:
+            winner = requester;
+            break;
+    }
+
+    return winner;
+}
+
+void BusArbiter::record_grant(Master *m, uint32 wait)
+{
+    int bucket = 0;
+    while (wait >> bucket && bucket < BUS_WAIT_HIST_SIZE - 1) {
+        bucket++;
+    }
+    m->grant_counts++;
+    m->wait_cycles += wait;
+    m->wait_hist[bucket]++;
+
+    if (policy == BUS_ARB_WRR) {
+        uint32 idx = m - &masters[0];
+        if (idx != rr_turn || rr_tokens == 0) {
+            rr_turn = idx;
+            rr_tokens = m->weight;
+        }
+        if (--rr_tokens == 0) {
+            rr_turn = (rr_turn + 1) % masters.size();
+        }
+    }
+}
+
+BusArbiter::Master *BusArbiter::find_master(DeviceExc *client, bool install)
+{
+    for (auto &m : masters) {
+        if (m.client == client) {
+            return &m;
+        }
+    }
+    if (install) {
+        Master m = Master();
+        m.client = client;
+        m.name = "master" + std::to_string(masters.size());
+        m.weight = 1;
+        m.outstanding_limit = default_outstanding;
+        masters.push_back(m);
+        return &masters.back();
+    }
+    return nullptr;
+}
+
+void BusArbiter::register_master(DeviceExc *client, const char *name,
+                                 uint32 weight)
+{
+    Master *m = find_master(client, true);
+    m->name = std::string(name);
+    m->weight = weight > 0 ? weight : 1;
+    if (stats != nullptr && !m->stats_registered) {
+        register_master_stats(m - &masters[0]);
+    }
+}
+
+uint32 BusArbiter::master_id(DeviceExc *client)
+{
+    return find_master(client, true) - &masters[0];
+}
+
+void BusArbiter::set_master_cap(DeviceExc *client, uint32 bytes)
+{
+    find_master(client, true)->cap = bytes;
+}
+
+void BusArbiter::set_master_outstanding(DeviceExc *client, uint32 limit)
+{
+    Master *m = find_master(client, true);
+    m->outstanding_limit = limit > 0 ? limit : default_outstanding;
+    assert(m->outstanding_limit >= 1);
+}
+
+void BusArbiter::refill_credit()
+{
+    if (credit_cycle != machine->num_cycles) {
+        // an overdraft is paid back from the following cycles
+        int64 elapsed = machine->num_cycles - credit_cycle;
+        credit = std::min<int64>(bandwidth, credit + elapsed * bandwidth);
+        for (auto &m : masters) {
+            int64 paid = elapsed * m.cap;
+            m.used = m.cap == 0 || m.used <= paid ? 0 : m.used - paid;
+        }
+        credit_cycle = machine->num_cycles;
+    }
+}
+
+bool BusArbiter::has_credit(DeviceExc *client)
+{
+    refill_credit();
+    if (credit <= 0) {
+        return false;
+    }
+    Master *m = find_master(client);
+    return m == nullptr || m->cap == 0 || m->used < m->cap;
+}
+
+void BusArbiter::consume_credit(DeviceExc *client, uint32 bytes)
+{
+    refill_credit();
+    // a transfer already judged ready may overdraw the current cycle
+    credit -= bytes;
+    Master *m = find_master(client);
+    if (m != nullptr) {
+        m->used += bytes;
+    }
+}
+
+uint32 BusArbiter::issue_request(DeviceExc *client, uint32 addr)
+{
+    uint32 now = machine->num_cycles;
+
+    if (!split) {
+        return now;
+    }
+
+    Master *m = find_master(client, true);
+
+    // following word of a burst
+    if (m->last_issue_cycle == now && addr == m->last_addr + 4) {
+        m->last_addr = addr;
+        return m->last_issue;
+    }
+
+    // retire finished transactions
+    auto &ends = m->transaction_ends;
+    ends.erase(std::remove_if(ends.begin(), ends.end(),
+        [now](uint32 end) { return (int32)(now - end) >= 0; }), ends.end());
+
+    // wait for the address phase and a free transaction slot
+    uint32 issue = next_request_slot > now ? next_request_slot : now;
+    std::sort(ends.begin(), ends.end());
+    while (ends.size() >= m->outstanding_limit) {
+        if ((int32)(ends.front() - issue) > 0) {
+            issue = ends.front();
+        }
+        ends.erase(ends.begin());
+    }
+    next_request_slot = issue + 1;
+    if (policy == BUS_ARB_FCFS) {
+        record_grant(m, issue - now);
+    } else {
+        // granted in acquire_bus; waits only for a transaction slot
+        m->wait_cycles += issue - now;
+    }
+    m->busy_cycles++;
+
+    ends.push_back(issue);
+    m->last_issue_cycle = now;
+    m->last_issue = issue;
+    m->last_addr = addr;
+    return issue;
+}
+
+uint32 BusArbiter::order_response(DeviceExc *client, uint32 ready)
+{
+    if (!split) {
+        return ready;
+    }
+
+    Master *m = find_master(client, true);
+    if (in_order && (int32)(m->last_ready - ready) > 0) {
+        ready = m->last_ready;
+    }
+    m->last_ready = ready;
+    // the transaction lasts until its last word is ready
+    if ((int32)(ready - m->transaction_ends.back()) > 0) {
+        m->transaction_ends.back() = ready;
+    }
+    return ready;
+}
+
+void BusArbiter::register_stats(StatsRegistry &stats_,
+    const std::string &prefix)
+{
+    stats = &stats_;
+    stats_prefix = prefix;
+    for (size_t i = 0; i < masters.size(); i++) {
+        register_master_stats(i);
+    }
+}
+
+void BusArbiter::register_master_stats(size_t i)
+{
+    // the vector of the masters may grow, so refer to them by index
+    std::string name = stats_prefix + "." + masters[i].name;
+    stats->add_counter(name + ".grants", [this, i]() {
+        return masters[i].grant_counts;
+    });
+    stats->add_counter(name + ".wait_cycles", [this, i]() {
+        return masters[i].wait_cycles;
+    });
+    stats->add_counter(name + ".busy_cycles", [this, i]() {
+        return masters[i].busy_cycles;
+    });
+    std::vector<StatsRegistry::Getter> hist;
+    for (int b = 0; b < BUS_WAIT_HIST_SIZE; b++) {
+        hist.push_back([this, i, b]() { return masters[i].wait_hist[b]; });
+    }
+    stats->add_histogram(name + ".wait_hist", hist);
+    stats->add_formula(name + ".average_wait", name + ".wait_cycles",
+        name + ".grants");
+    masters[i].stats_registered = true;
+}
+
+void BusArbiter::report_prof()
+{
+    static const char *policy_names[] = {"fcfs", "fixed", "wrr", "tdma", "age"};
+    uint64 busy = 0;
+    uint32 cycles = machine->num_cycles;
+
+    for (auto &m : masters) {
+        busy += m.busy_cycles;
+    }
+    fprintf(stderr, "\tArbitration %s%s\n", policy_names[policy],
+        split ? " (split transaction)" : "");
+    fprintf(stderr, "\tBus utilization %.5f%%\n",
+        (double)busy / (double)cycles * 100.0);
+
+    for (auto &m : masters) {
+        fprintf(stderr, "\t%s\n", m.name.c_str());
+        fprintf(stderr, "\t\tGrants %llu\n", (unsigned long long)m.grant_counts);
+        fprintf(stderr, "\t\tAverage wait %.3f cycles\n", m.grant_counts == 0 ? 0.0 :
+            (double)m.wait_cycles / (double)m.grant_counts);
+        fprintf(stderr, "\t\tBus occupancy %.5f%%\n",
+            (double)m.busy_cycles / (double)cycles * 100.0);
+        int last = BUS_WAIT_HIST_SIZE - 1;
+        while (last > 0 && m.wait_hist[last] == 0) {
+            last--;
+        }
+        fprintf(stderr, "\t\tWait cycles histogram\n");
+        for (int i = 0; i <= last; i++) {
+            if (i <= 1) {
+                fprintf(stderr, "\t\t\t%d", i);
+            } else if (i == BUS_WAIT_HIST_SIZE - 1) {
+                fprintf(stderr, "\t\t\t%u-", 1u << (i - 1));
+            } else {
+                fprintf(stderr, "\t\t\t%u-%u", 1u << (i - 1), (1u << i) - 1);
+            }
+            fprintf(stderr, "\t%llu\n", (unsigned long long)m.wait_hist[i]);
+        }
+    }
+}
@@ -24,14 +24,116 @@
 
 #include "vmips.h"
 #include "deviceexc.h"
+#include <vector>
+#include <string>
+
+class StatsRegistry;
+
+#define BUS_ARB_FCFS        0
+#define BUS_ARB_FIXED       1
+#define BUS_ARB_WRR         2
+#define BUS_ARB_TDMA        3
+#define BUS_ARB_AGE         4
+
+#define BUS_WAIT_HIST_SIZE  16
 
 class BusArbiter {
 public:
     BusArbiter();
     bool acquire_bus(DeviceExc *client);
     void release_bus(DeviceExc *client);
+
+    /* Register a bus master with its name and arbitration weight
+       (priority for fixed, grants per turn for wrr, slots per frame
+       for tdma) */
+    void register_master(DeviceExc *client, const char *name, uint32 weight);
+    void report_prof();
+    /* Register the statistics of the masters, including those which
+       are registered later */
+    void register_stats(StatsRegistry &stats, const std::string &prefix);
+    /* Index of CLIENT in the master registry */
+    uint32 master_id(DeviceExc *client);
+    const std::string &master_name(uint32 id) const { return masters[id].name; }
+
+    /* Bandwidth model: the bus moves up to BANDWIDTH bytes per cycle
+       shared by all the masters, and each master may be capped. A
+       transfer may overdraw the cycle, and the excess is taken from
+       the bandwidth of the next cycles. */
+    void set_master_cap(DeviceExc *client, uint32 bytes);
+    bool has_credit(DeviceExc *client);
+    void consume_credit(DeviceExc *client, uint32 bytes);
+
+    /* Split transaction bus: the bus is not locked by a master.
+       Requests are issued on the address phase (one transaction per
+       cycle, bursts of consecutive words count as one), each master
+       can have a limited number of transactions in flight, and data
+       return in order or out of order per master. With a policy other
+       than fcfs, acquire_bus chooses by the policy the master which
+       takes the next free address phase, and the master may issue
+       requests until it releases the bus. */
+    bool split_mode() const { return split; }
+    void set_master_outstanding(DeviceExc *client, uint32 limit);
+    /* return the cycle when the request of ADDR is issued */
+    uint32 issue_request(DeviceExc *client, uint32 addr);
+    /* return the cycle when the data of a request is ready */
+    uint32 order_response(DeviceExc *client, uint32 ready);
+
 private:
     int32 last_released_cycle;
     DeviceExc *bus_holder;
+
+    uint32 bandwidth;
+    int32 credit;
+    uint32 credit_cycle;
+
+    bool split;
+    bool in_order;
+    uint32 default_outstanding;
+    uint32 next_request_slot;
+    uint32 last_address_grant;  // cycle of the last arbitrated address phase
+
+    int policy;
+    uint32 tdma_slot;
+
+    StatsRegistry *stats;
+    std::string stats_prefix;
+    // weighted round robin
+    uint32 rr_turn;
+    uint32 rr_tokens;
+
+    struct Master {
+        DeviceExc *client;
+        std::string name;
+        uint32 weight;
+        // arbitration
+        bool waiting;
+        uint32 request_since;
+        uint32 last_request_cycle;
+        uint32 grant_cycle;
+        // profile
+        uint64 grant_counts;
+        uint64 wait_cycles;
+        uint64 busy_cycles;
+        uint64 wait_hist[BUS_WAIT_HIST_SIZE];
+        uint32 cap;     // 0: no cap
+        uint32 used;
+        // split transaction
+        bool address_granted;   // won the address phase until release_bus
+        uint32 outstanding_limit;
+        std::vector<uint32> transaction_ends;
+        uint32 last_issue_cycle;
+        uint32 last_issue;
+        uint32 last_addr;
+        uint32 last_ready;
+        bool stats_registered;
+    };
+    std::vector<Master> masters;
+
+    void refill_credit();
+    Master *find_master(DeviceExc *client, bool install = false);
+    Master *select_master(Master *requester);
+    void record_grant(Master *m, uint32 wait);
+    void register_master_stats(size_t i);
 };
-#endif /* _BUSARBITER_H_ */
\ No newline at end of file
+
+#endif /* _BUSARBITER_H_ */
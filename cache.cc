@@ -20,6 +20,8 @@
 
 
 #include "cache.h"
+#include "stats.h"
+#include "hostprof.h"
 #include "excnames.h"
 #include "mapper.h"
 
@@ -29,7 +31,13 @@ Cache::Cache(Mapper* mem, unsigned int block_count_, unsigned int block_size_, u
 	physmem(mem),
 	block_count(block_count_),
 	block_size(block_size_),
-	way_size(way_size_)
+	way_size(way_size_),
+	sdprof(NULL),
+	missprof(NULL),
+	funcprof(NULL),
+	funcprof_kind(FUNCPROF_ICACHE),
+	eventtrace(NULL),
+	trace_track(0)
 {
 	//block_size: byte size
 	blocks = new Entry*[way_size];
@@ -62,15 +70,26 @@ Cache::Cache(Mapper* mem, unsigned int block_count_, unsigned int block_size_, u
 Cache::~Cache()
 {
 	delete [] blocks;
+	if (sdprof) delete sdprof;
+	if (missprof) delete missprof;
 }
 
 void Cache::step()
 {
+	HostProfScope prof(HOSTPROF_CACHE);
+
 	if (machine->num_cycles > last_state_update_time) {
 		status = next_status;
 		last_state_update_time = machine->num_cycles;
 	}
 
+	if (eventtrace != NULL) {
+		static const char *status_names[] = {NULL, "writeback", "fill",
+			"cache op writeback"};
+		eventtrace->set_state(trace_track, status_names[status],
+			machine->get_cycles());
+	}
+
 	if (status == CACHE_WB || status == CACHE_OP_WB) {
 		cache_wb();
 	} else if (status == CACHE_FETCH) {
@@ -78,6 +97,13 @@ void Cache::step()
 	}
 }
 
+void Cache::attach_eventtrace(EventTrace *trace, const std::string &process,
+	const std::string &name)
+{
+	eventtrace = trace;
+	trace_track = trace->add_track(process, name);
+}
+
 void Cache::reset_stat()
 {
 	// If exception occurs while cache working, cache must be reset
@@ -126,7 +152,7 @@ bool Cache::cache_hit(uint32 addr, uint32 &index, uint32 &way, uint32 &offset)
 	return false;
 }
 
-void Cache::request_block(uint32 addr, int mode, DeviceExc* client)
+bool Cache::request_block(uint32 addr, int mode, DeviceExc* client, uint32 pc)
 {
 	int least_recent_used_way = 0;
 	bool find = false;
@@ -150,6 +176,7 @@ void Cache::request_block(uint32 addr, int mode, DeviceExc* client)
 		}
 		if (!find) { // in case of no free block
 			way = least_recent_used_way;
+			physmem->evict_notify(calc_addr(way, index));
 			//check if WB is needed
 			if (!isisolated && mode != INSTFETCH && blocks[way][index].dirty) {
 				next_status = CACHE_WB;
@@ -171,7 +198,15 @@ void Cache::request_block(uint32 addr, int mode, DeviceExc* client)
 		// regist replaced cache block & status
 		cache_op_state = new CacheOpState{word_size, addr, way, index, mode, false, client};
 		cache_miss_counts++;
+		if (missprof) {
+			missprof->miss(addr, pc);
+		}
+		if (funcprof) {
+			funcprof->add_miss(pc, funcprof_kind);
+		}
+		return true;
 	}
+	return status != CACHE_IDLE;
 }
 
 
@@ -181,19 +216,20 @@ void Cache::cache_wb()
 	wb_addr += (word_size - cache_op_state->counter) * 4;
 	unsigned int way = cache_op_state->way;
 	unsigned int index = cache_op_state->index;
+	DeviceExc *client = cache_op_state->client;
 
 	// request for access at first
 	if (cache_op_state->counter == word_size) {
 		for (int i = 0; i < word_size; i++) {
-			physmem->request_word(wb_addr + (4 * i), DATASTORE, cache_op_state->client);
+			physmem->request_word(wb_addr + (4 * i), DATASTORE, client, true);
 		}
 	}
 
-	// if access is ready, write back the data
-	if (physmem->ready(wb_addr, DATASTORE, cache_op_state->client)) {
+	// write back the data while accesses are ready and the bus has bandwidth
+	while (physmem->ready(wb_addr, DATASTORE, client)) {
 		physmem->store_word(wb_addr,
 			physmem->host_to_mips_word(blocks[way][index].data[word_size - cache_op_state->counter]),
-			cache_op_state->client);
+			client);
 
 		if (--cache_op_state->counter == 0) {
 			//finish write back
@@ -205,13 +241,15 @@ void Cache::cache_wb()
 				}
 				next_status = CACHE_IDLE;
 				delete cache_op_state;
-				physmem->release_bus(cache_op_state->client);
+				physmem->release_bus(client);
 			} else {
 				next_status = CACHE_FETCH;
 				cache_op_state->counter = word_size;
 			}
 			cache_wb_counts++;
+			break;
 		}
+		wb_addr += 4;
 	}
 
 }
@@ -224,20 +262,21 @@ void Cache::cache_fetch()
 
 	way = cache_op_state->way;
 	index = cache_op_state->index;
+	DeviceExc *client = cache_op_state->client;
 
 	int mode = cache_op_state->mode == INSTFETCH ? INSTFETCH : DATALOAD;
 
 	// request for access at first
 	if (cache_op_state->counter == word_size) {
 		for (int i = 0; i < word_size; i++) {
-			physmem->request_word(fetch_addr + (4 * i), mode, cache_op_state->client);
+			physmem->request_word(fetch_addr + (4 * i), mode, client, true);
 		}
 	}
 
-	// if access is ready, fetch the data
-	if (physmem->ready(fetch_addr, mode, cache_op_state->client)) {
+	// fetch the data while accesses are ready and the bus has bandwidth
+	while (physmem->ready(fetch_addr, mode, client)) {
 		blocks[way][index].data[word_size - cache_op_state->counter] =
-			physmem->host_to_mips_word(physmem->fetch_word(fetch_addr, mode, cache_op_state->client));
+			physmem->host_to_mips_word(physmem->fetch_word(fetch_addr, mode, client));
 
 		if (--cache_op_state->counter == 0) {
 			// finish cache fetch
@@ -247,8 +286,10 @@ void Cache::cache_fetch()
 			blocks[way][index].valid = true;
 			blocks[way][index].dirty = false;
 			delete cache_op_state;
-			physmem->release_bus(cache_op_state->client);
+			physmem->release_bus(client);
+			break;
 		}
+		fetch_addr += 4;
 	}
 }
 
@@ -387,6 +428,7 @@ uint32 Cache::fetch_word(uint32 addr, int32 mode, DeviceExc *client)
 		return 0xffffffff;
 	} else {
 		cache_hit_counts++;
+		profile_access(addr);
 	}
 
 	//get data
@@ -417,6 +459,7 @@ uint16 Cache::fetch_halfword(uint32 addr, DeviceExc *client)
 		return 0xffff;
 	} else {
 		cache_hit_counts++;
+		profile_access(addr);
 	}
 
 	entry = &blocks[way][index];
@@ -446,6 +489,7 @@ uint8 Cache::fetch_byte(uint32 addr, DeviceExc *client)
 		return 0xff;
 	} else {
 		cache_hit_counts++;
+		profile_access(addr);
 	}
 
 	entry = &blocks[way][index];
@@ -479,6 +523,7 @@ void Cache::store_word(uint32 addr, uint32 data, DeviceExc *client)
 		return;
 	} else {
 		cache_hit_counts++;
+		profile_access(addr);
 	}
 
 	entry = &blocks[way][index];
@@ -509,6 +554,7 @@ void Cache::store_halfword(uint32 addr, uint16 data,  DeviceExc *client)
 		return ;
 	} else {
 		cache_hit_counts++;
+		profile_access(addr);
 	}
 
 	entry = &blocks[way][index];
@@ -537,6 +583,7 @@ void Cache::store_byte(uint32 addr, uint8 data, DeviceExc *client)
 		return ;
 	} else {
 		cache_hit_counts++;
+		profile_access(addr);
 	}
 
 	entry = &blocks[way][index];
@@ -556,6 +603,46 @@ void Cache::store_byte(uint32 addr, uint8 data, DeviceExc *client)
 	return;
 }
 
+void Cache::profile_access(uint32 addr)
+{
+	if (sdprof) {
+		sdprof->access(addr);
+	}
+	if (missprof) {
+		missprof->access(addr);
+	}
+}
+
+int Cache::back_invalidate(uint32 addr, uint32 size)
+{
+	uint32 index, way, offset;
+	int count = 0;
+
+	for (uint32 a = addr; a < addr + size; a += block_size) {
+		if (!cache_hit(a, index, way, offset)) {
+			continue;
+		}
+		// the block under replacement is left to the running operation
+		if (next_status != CACHE_IDLE && cache_op_state->way == way
+				&& cache_op_state->index == index) {
+			continue;
+		}
+		Entry &entry = blocks[way][index];
+		if (entry.dirty) {
+			// flush the data without bus timing
+			uint32 base = calc_addr(way, index);
+			Range *l = physmem->find_mapping_range(base);
+			for (int i = 0; l && i < word_size; i++) {
+				l->store_word(base + 4 * i - l->getBase(), entry.data[i], NULL);
+			}
+		}
+		entry.valid = false;
+		entry.dirty = false;
+		count++;
+	}
+	return count;
+}
+
 void Cache::report_prof()
 {
 	uint32 cache_access = cache_miss_counts + cache_hit_counts;
@@ -566,3 +653,29 @@ void Cache::report_prof()
 		(double)cache_wb_counts / (double)cache_miss_counts * 100.0);
 
 }
+
+void Cache::register_stats(StatsRegistry &stats, const std::string &prefix)
+{
+	stats.add_counter(prefix + ".hits", &cache_hit_counts);
+	stats.add_counter(prefix + ".misses", &cache_miss_counts);
+	stats.add_counter(prefix + ".writebacks", &cache_wb_counts);
+	stats.add_counter(prefix + ".accesses", StatsRegistry::widen<uint32>([this]() {
+		return (uint32)cache_hit_counts + (uint32)cache_miss_counts;
+	}));
+	stats.add_formula(prefix + ".miss_ratio", prefix + ".misses",
+		prefix + ".accesses");
+}
+
+void Cache::report_sdprof()
+{
+	if (sdprof) {
+		sdprof->report_prof();
+	}
+}
+
+void Cache::report_missprof()
+{
+	if (missprof) {
+		missprof->report_prof();
+	}
+}
@@ -29,6 +29,13 @@
 #include "vmips.h"
 #include "mapper.h"
 #include "cacheinstr.h"
+#include "stackdist.h"
+#include "missprof.h"
+#include "funcprof.h"
+#include "eventtrace.h"
+#include <string>
+
+class StatsRegistry;
 
 #define CACHE_IDLE  0
 #define CACHE_WB    1
@@ -52,7 +59,9 @@ public:
     void step();
 
     bool ready(uint32 addr);
-    void request_block(uint32 addr, int mode, DeviceExc* client);
+    // PC is the instruction causing the access (for miss profiling)
+    // return false if the request is ignored because the bus is not granted
+    bool request_block(uint32 addr, int mode, DeviceExc* client, uint32 pc = 0);
     void reset_stat();
 
     uint32 fetch_word(uint32 addr, int32 mode, DeviceExc *client);
@@ -64,9 +73,30 @@ public:
 
     void cache_isolate(bool flag) {isisolated = flag;}
     void report_prof();
+    void register_stats(StatsRegistry &stats, const std::string &prefix);
+
+    // stack distance profiling (the cache takes ownership)
+    void attach_sdprof(StackDistProfiler *prof) { sdprof = prof; }
+    void report_sdprof();
+    // per-PC miss profiling (the cache takes ownership)
+    void attach_missprof(MissProfiler *prof) { missprof = prof; }
+    void report_missprof();
+    // per-function miss counts (not owned by the cache)
+    void attach_funcprof(FuncProfiler *prof, int kind) {
+        funcprof = prof;
+        funcprof_kind = kind;
+    }
+
+    // block fills and writebacks on the timeline (not owned by the cache)
+    void attach_eventtrace(EventTrace *trace, const std::string &process,
+        const std::string &name);
 
     bool exec_cache_op(uint16 opcode, uint32 addr, DeviceExc* client);
 
+    // invalidate blocks in [addr, addr + size) for an inclusive L2 cache
+    // return the number of invalidated blocks
+    int back_invalidate(uint32 addr, uint32 size);
+
 private:
     // connected memory
     Mapper* physmem;
@@ -114,6 +144,13 @@ private:
 
     CacheOpState *cache_op_state;
 
+    StackDistProfiler *sdprof;
+    MissProfiler *missprof;
+    FuncProfiler *funcprof;
+    int funcprof_kind;
+    EventTrace *eventtrace;
+    int trace_track;
+
 	// method
 	void addr_separete(uint32 addr, uint32 &tag, uint32 &index, uint32 &offset);
     bool cache_hit(uint32 addr, uint32 &index, uint32 &way, uint32 &offset);
@@ -122,6 +159,8 @@ private:
     void cache_fetch();
     void cache_wb();
     uint32 calc_addr(uint32 way, uint32 index);
+    // record a completed reference for profilers
+    void profile_access(uint32 addr);
 
 };
 
@@ -21,6 +21,9 @@
 
 #include "cma.h"
 #include "debugutils.h"
+#include "stats.h"
+#include "hostprof.h"
+#include "eventtrace.h"
 
 using namespace CMAComponents;
 
@@ -29,8 +32,8 @@ CMA::CMA()
 
 }
 
-CMA::CMA(uint32 node_ID, Router* upperRouter)
-	: CubeAccelerator(node_ID, upperRouter)
+CMA::CMA(uint32 node_ID)
+	: CubeAccelerator(node_ID)
 {
 
 }
@@ -51,6 +54,24 @@ CMA::~CMA()
 	delete preg_config;
 }
 
+void CMA::register_stats(StatsRegistry &stats, const std::string &prefix)
+{
+	AcceleratorBase::register_stats(stats, prefix);
+	CMAComponents::PEArray *pe = pearray;
+	stats.add_counter(prefix + ".pearray.active_cycles", [pe]() {
+		return pe->get_active_cycles();
+	});
+	stats.add_formula(prefix + ".pearray.utilization",
+		prefix + ".pearray.active_cycles", "cycles");
+}
+
+void CMA::attach_eventtrace(EventTrace *trace, const std::string &process)
+{
+	eventtrace = trace;
+	mc_track = trace->add_track(process, "microcontroller");
+	pearray_track = trace->add_track(process, "pearray");
+}
+
 void CMA::setup()
 {
 	pearray = new CCSOTB2::CCSOTB2_PEArray(CMA_PE_ARRAY_HEIGHT,
@@ -113,6 +134,9 @@ void CMA::core_reset()
 
 void CMA::core_step()
 {
+	HostProfScope prof(HOSTPROF_CMA);
+	bool running = false;
+
 	if (ctrl_reg->getRun()) {
 		if (!mc_working) {
 			// kick microcontroller
@@ -132,6 +156,8 @@ void CMA::core_step()
 		}
 		if (!mc_done) {
 			// execute microcontroller
+			busy_cycles++;
+			running = true;
 			mc->step();
 			pearray->exec();
 			st_unit->step();
@@ -152,6 +178,12 @@ void CMA::core_step()
 		mc_working = false;
 		mc->reset();
 	}
+
+	if (eventtrace != NULL) {
+		uint64 now = machine->get_cycles();
+		eventtrace->set_state(mc_track, running ? "run" : NULL, now);
+		eventtrace->set_state(pearray_track, running ? "exec" : NULL, now);
+	}
 }
 
 void CMA::send_commnad(uint32 cmd, uint32 arg) {
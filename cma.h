@@ -56,6 +56,9 @@ private:
 	bool mc_working;
 	bool done_notif;
 
+	//timeline
+	int mc_track, pearray_track;
+
 	//for debug
 	uint8 trgr_cnd, trgr_mod, trgr_offset;
 	uint8 debug_op;
@@ -66,7 +69,7 @@ private:
 
 public:
 	// for cube mode
-	CMA(uint32 node_ID, Router* upperRouter);
+	CMA(uint32 node_ID);
 	// for bus conn mode
 	CMA();
 	~CMA();
@@ -76,6 +79,8 @@ public:
 	void core_reset();
 
 	const char *accelerator_name() { return "CMA"; }
+	void register_stats(StatsRegistry &stats, const std::string &prefix);
+	void attach_eventtrace(EventTrace *trace, const std::string &process);
 
 	CMAComponents::ControlReg *ctrl_reg;
 
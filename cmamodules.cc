@@ -160,6 +160,7 @@ PEArray::PEArray(int height_, int width_, int preg_channels_,
 	}
 	make_memports();
 	config_changed = false;
+	active_cycles = 0;
 }
 
 PEArray::~PEArray()
@@ -466,6 +467,7 @@ void PEArray::analyze_dataflow()
 
 void PEArray::exec()
 {
+	active_cycles++;
 	if (config_changed) {
 		analyze_dataflow();
 	}
@@ -425,6 +425,7 @@ namespace CMAComponents {
 		private:
 			//status
 			bool config_changed;
+			uint64 active_cycles;
 
 			// for build PE array
 			void make_ALUs();
@@ -466,6 +467,9 @@ namespace CMAComponents {
 			void exec();
 			void update();
 
+			//cycles executed by the array
+			uint64 get_active_cycles() { return active_cycles; }
+
 			//for debugger
 			uint32 debug_fetch_launch(uint32 col);
 			void debug_store_launch(uint32 col, uint32 data);
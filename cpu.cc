@@ -38,6 +38,10 @@
 #include "state.h"
 #include "cache.h"
 #include "ISA.h"
+#include "insttrace.h"
+#include "stallprof.h"
+#include "funcprof.h"
+#include "hostprof.h"
 
 /* states of the delay-slot state machine -- see CPU::step() */
 static const int NORMAL = 0, DELAYING = 1, DELAYSLOT = 2;
@@ -58,8 +62,8 @@ static const char *strdelaystate(const int state) {
 	return statestr[state];
 }
 
-PipelineRegs::PipelineRegs(uint32 pc_, uint32 instr_):
-	pc(pc_), instr(instr_)
+PipelineRegs::PipelineRegs(uint32 pc_, uint32 instr_, bool bubble_):
+	pc(pc_), instr(instr_), bubble(bubble_)
 {
 	alu_src_a = &(this->shamt);
 	alu_src_b = &(this->shamt);
@@ -75,7 +79,11 @@ PipelineRegs::~PipelineRegs()
 }
 
 CPU::CPU (Mapper &m, IntCtrl &i, int cpuid)
-  : tracing (false), last_epc (0), last_prio (0), mem (&m),
+  : tracing (false), insttrace (NULL), stallprof (NULL),
+    fetch_stall_cause (STALL_ICACHE_MISS), data_stall_cause (STALL_DCACHE_MISS),
+    funcprof (NULL), eventtrace (NULL), trace_track (0),
+    trace_stall_cause (-1), inst_retired (0),
+    last_epc (0), last_prio (0), mem (&m),
     cpzero (new CPZero (this, &i, cpuid)), fpu (0), delay_state (NORMAL),
     mul_div_remain(0), suspend(false), icache(NULL), dcache(NULL)
 {
@@ -104,7 +112,6 @@ CPU::CPU (Mapper &m, IntCtrl &i, int cpuid)
 	opt_dcachebnum = machine->opt->option("dcachebnum")->num;
 	opt_icachebsize = machine->opt->option("icachebsize")->num;
 	opt_dcachebsize = machine->opt->option("dcachebsize")->num;
-	mem_bandwidth = machine->opt->option("mem_bandwidth")->num;
 
 	exception_pending = false;
 	volatilize_pipeline();
@@ -136,6 +143,27 @@ CPU::reset(void)
 	//generate cache
 	icache = new Cache(mem, opt_icachebnum, opt_icachebsize, opt_icacheway);	/* 64Byte * 64Block * 2way = 8KB*/
 	dcache = new Cache(mem, opt_dcachebnum, opt_dcachebsize, opt_dcacheway);
+	if (machine->opt->option("sdprof")->flag) {
+		std::vector<int> bsizes = machine->opt->get_list(
+			machine->opt->option("sdprof_bsizes")->str);
+		std::vector<int> sets = machine->opt->get_list(
+			machine->opt->option("sdprof_sets")->str);
+		int max_way = machine->opt->option("sdprof_maxway")->num;
+		icache->attach_sdprof(new StackDistProfiler(bsizes, sets, max_way));
+		dcache->attach_sdprof(new StackDistProfiler(bsizes, sets, max_way));
+	}
+	if (machine->opt->option("missprof")->flag) {
+		int region = machine->opt->option("missprof_region")->num;
+		int top_n = machine->opt->option("missprof_top")->num;
+		icache->attach_missprof(new MissProfiler(opt_icachebsize,
+			opt_icachebnum * opt_icacheway, region, top_n));
+		dcache->attach_missprof(new MissProfiler(opt_dcachebsize,
+			opt_dcachebnum * opt_dcacheway, region, top_n));
+	}
+	if (funcprof != NULL) {
+		icache->attach_funcprof(funcprof, FUNCPROF_ICACHE);
+		dcache->attach_funcprof(funcprof, FUNCPROF_DCACHE);
+	}
 	//fill NOP for each Pipeline stage
 	volatilize_pipeline();
 }
@@ -143,10 +171,10 @@ CPU::reset(void)
 void CPU::volatilize_pipeline()
 {
 	for (int i = 0; i < PIPELINE_STAGES; i++) {
-		PL_REGS[i] = new PipelineRegs(pc + 4, NOP_INSTR);
+		PL_REGS[i] = new PipelineRegs(pc + 4, NOP_INSTR, true);
 	}
-	late_preg = new PipelineRegs(pc + 4, NOP_INSTR);
-	late_late_preg = new PipelineRegs(pc + 4, NOP_INSTR);
+	late_preg = new PipelineRegs(pc + 4, NOP_INSTR, true);
+	late_late_preg = new PipelineRegs(pc + 4, NOP_INSTR, true);
 }
 
 void
@@ -768,7 +796,7 @@ void CPU::fetch(bool& fetch_miss, bool data_miss)
 	}
 
 	if (exception_pending) {
-		PL_REGS[IF_STAGE] = new PipelineRegs(pc, NOP_INSTR);
+		PL_REGS[IF_STAGE] = new PipelineRegs(pc, NOP_INSTR, true);
 		PL_REGS[IF_STAGE]->excBuf.emplace_back(exc_signal);
 		//reset signal
 		exception_pending = false;
@@ -776,11 +804,16 @@ void CPU::fetch(bool& fetch_miss, bool data_miss)
 		// Fetch next instruction.
 		if (cacheable) {
 			fetch_miss = !cache->ready(real_pc);
+			fetch_stall_cause = STALL_ICACHE_MISS;
 			if (fetch_miss & !data_miss) {
-				cache->request_block(real_pc, INSTFETCH, this);
+				if (!cache->request_block(real_pc, INSTFETCH, this, pc)) {
+					fetch_stall_cause = STALL_BUS_LOSS;
+				}
 			}
 		} else {
+			fetch_stall_cause = STALL_BUS_LOSS;
 			if (mem->acquire_bus(this)) {
+				fetch_stall_cause = STALL_IFETCH_UNCACHED;
 				fetch_miss = !mem->ready(real_pc,INSTFETCH,this);
 				if (fetch_miss & !data_miss) {
 					mem->request_word(real_pc,INSTFETCH,this);
@@ -805,7 +838,7 @@ void CPU::fetch(bool& fetch_miss, bool data_miss)
 			}
 			//check exception
 			if (exception_pending) {
-				PL_REGS[IF_STAGE] = new PipelineRegs(pc, NOP_INSTR);
+				PL_REGS[IF_STAGE] = new PipelineRegs(pc, NOP_INSTR, true);
 				PL_REGS[IF_STAGE]->excBuf.emplace_back(exc_signal);
 				//reset signal
 				exception_pending = false;
@@ -1129,6 +1162,7 @@ void CPU::pre_mem_access(bool& data_miss)
 			cache_opcode = rt(mem_instr);
 			cache = cache_op_mux(cache_opcode);
 			data_miss = !cache->exec_cache_op(cache_opcode, phys, this);
+			data_stall_cause = STALL_DCACHE_MISS;
 		}
 	} else if (mem_write_flag[mem_opcode] || mem_read_flag[mem_opcode]) {
 		phys = cpzero->address_trans(vaddr, mode, &cacheable, this);
@@ -1136,17 +1170,22 @@ void CPU::pre_mem_access(bool& data_miss)
 		if (cacheable) {
 			Cache *cache = cpzero->caches_swapped() ? icache : dcache;
 			data_miss = !cache->ready(phys);
+			data_stall_cause = STALL_DCACHE_MISS;
 			if (data_miss) {
-				cache->request_block(phys, mode, this);
+				if (!cache->request_block(phys, mode, this, preg->pc)) {
+					data_stall_cause = STALL_BUS_LOSS;
+				}
 			}
 		} else {
 			if (mem->acquire_bus(this)) {
 				data_miss = !mem->ready(phys, mode, this);
+				data_stall_cause = STALL_DATA_UNCACHED;
 				if (data_miss) {
 					mem->request_word(phys, mode, this);
 				}
 			} else {
 				data_miss = true;
+				data_stall_cause = STALL_BUS_LOSS;
 			}
 		}
 	}
@@ -1326,10 +1365,72 @@ void CPU::reg_commit()
 	if (preg->w_reg_data != NULL) {
 		reg[preg->dst] = *(preg->w_reg_data);
 	}
+
+	if (!preg->bubble) {
+		inst_retired++;
+		if (insttrace != NULL) {
+			write_insttrace(preg);
+		}
+	}
+
+	if (funcprof != NULL) {
+		funcprof->add_cycle(preg->pc);
+		if (!preg->bubble) {
+			funcprof->retire(preg->pc, preg->instr, preg->delay_slot);
+		}
+	}
+}
+
+void CPU::attach_eventtrace(EventTrace *t)
+{
+	eventtrace = t;
+	trace_track = t->add_track("cpu", "pipeline");
+	icache->attach_eventtrace(t, "cpu", "icache");
+	dcache->attach_eventtrace(t, "cpu", "dcache");
+}
+
+void CPU::account_stall(uint32 stall_pc, int cause)
+{
+	trace_stall_cause = cause;
+	if (stallprof != NULL) {
+		stallprof->add(stall_pc, cause);
+	}
+	if (funcprof != NULL) {
+		funcprof->add_stall(stall_pc);
+	}
+}
+
+void CPU::write_insttrace(PipelineRegs *preg)
+{
+	InstTraceRecord r;
+	uint16 op = opcode(preg->instr);
+
+	r.cycle = machine->num_cycles;
+	r.pc = preg->pc;
+	r.instr = preg->instr;
+	r.flags = preg->delay_slot ? INSTTRACE_DELAY_SLOT : 0;
+	r.reg = preg->dst;
+	r.reg_value = r.mem_addr = r.mem_data = 0;
+	r.reserved = 0;
+	if (preg->w_reg_data != NULL) {
+		r.flags |= INSTTRACE_REG_WRITE;
+		r.reg_value = *(preg->w_reg_data);
+	}
+	if (preg->mem_read_op) {
+		r.flags |= INSTTRACE_MEM_READ;
+		r.mem_addr = preg->result;
+	} else if (mem_write_flag[op]) {
+		r.flags |= INSTTRACE_MEM_WRITE;
+		r.mem_addr = preg->result;
+		r.mem_data = *(preg->w_mem_data);
+	}
+	insttrace->record(r);
 }
 
 void CPU::step()
 {
+	HostProfScope prof(HOSTPROF_CPU);
+
 	// control signals
 	bool data_hazard, interlock, fetch_miss, data_miss;
 
@@ -1372,9 +1473,7 @@ void CPU::step()
 		cop_remain--;
 	}
 
-	for (int i = 0; i < mem_bandwidth; i++) {
-		dcache->step();
-	}
+	dcache->step();
 
 	// dcache brings exceptions
 	if (exception_pending) {
@@ -1383,9 +1482,7 @@ void CPU::step()
 		exc_handle(PL_REGS[WB_STAGE]);
 	}
 
-	for (int i = 0; i < mem_bandwidth; i++) {
-		icache->step();
-	}
+	icache->step();
 
 	// icache brings exceptions
 	if (exception_pending) {
@@ -1404,6 +1501,10 @@ void CPU::step()
 			decode(); //decode must be processed after execute/mem_access due to forwarding
 		}
 		if (suspend == true || data_hazard == true) {
+			if (stallprof != NULL || funcprof != NULL || eventtrace != NULL) {
+				account_stall(PL_REGS[ID_STAGE]->pc,
+					data_hazard ? STALL_LOAD_USE : STALL_COP_SUSPEND);
+			}
 			//IF stage stay until suspension
 			delete late_late_preg;
 			late_late_preg = late_preg;
@@ -1411,7 +1512,7 @@ void CPU::step()
 			for (int i = PIPELINE_STAGES - 1; i > EX_STAGE; i--) {
 				PL_REGS[i] = PL_REGS[i - 1];
 			}
-			PL_REGS[EX_STAGE] = new PipelineRegs(pc, NOP_INSTR);
+			PL_REGS[EX_STAGE] = new PipelineRegs(pc, NOP_INSTR, true);
 		} else {
 			//go ahead pipeline
 			delete late_late_preg;
@@ -1428,6 +1529,29 @@ void CPU::step()
 
 	} else {
 		machine->stall_count++;
+		if (stallprof != NULL || funcprof != NULL || eventtrace != NULL) {
+			// the oldest waiting stage is responsible for the stall
+			uint32 stall_pc = pc;
+			int cause = fetch_stall_cause;
+			if (data_miss) {
+				stall_pc = PL_REGS[MEM_STAGE]->pc;
+				cause = data_stall_cause;
+			} else if (interlock) {
+				stall_pc = PL_REGS[EX_STAGE]->pc;
+				cause = STALL_MUL_DIV;
+			}
+			account_stall(stall_pc, cause);
+			if (funcprof != NULL) {
+				funcprof->add_cycle(stall_pc);
+			}
+		}
+	}
+
+	if (eventtrace != NULL) {
+		eventtrace->set_state(trace_track, trace_stall_cause < 0 ? NULL :
+			StallProfiler::cause_name(trace_stall_cause),
+			machine->get_cycles());
+		trace_stall_cause = -1;
 	}
 
 };
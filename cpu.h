@@ -37,6 +37,10 @@ class FPU;
 class Mapper;
 class IntCtrl;
 class Cache;
+class InstTrace;
+class StallProfiler;
+class FuncProfiler;
+class EventTrace;
 
 #define PIPELINE_STAGES 5
 #define IF_STAGE 0
@@ -78,7 +82,7 @@ struct ExcInfo {
 
 class PipelineRegs {
 public:
-	PipelineRegs(uint32 pc, uint32 instr);
+	PipelineRegs(uint32 pc, uint32 instr, bool bubble_ = false);
 	~PipelineRegs();
 	uint32 instr, pc;
 	uint32 *alu_src_a, *alu_src_b;
@@ -92,6 +96,7 @@ public:
 	uint32 shamt;
 	bool mem_read_op;
 	bool delay_slot;
+	bool bubble;	/* inserted by a stall or a flush, not an instruction */
 	std::vector<ExcInfo*> excBuf;
 };
 
@@ -158,6 +163,18 @@ class CPU : public DeviceExc {
 	Trace current_trace;
 	Trace::Record current_trace_record;
 	FILE *traceout;
+	InstTrace *insttrace;
+
+	// Stall attribution
+	StallProfiler *stallprof;
+	int fetch_stall_cause;
+	int data_stall_cause;
+	FuncProfiler *funcprof;
+
+	// Timeline of the stall episodes
+	EventTrace *eventtrace;
+	int trace_track;
+	int trace_stall_cause;
 
 	// Tracing support methods.
 	void open_trace_file ();
@@ -226,7 +243,6 @@ class CPU : public DeviceExc {
 	int opt_dcachebnum;
 	int opt_icachebsize;
 	int opt_dcachebsize;
-	int mem_bandwidth;
 
 	//each stage
 	void fetch(bool& fetch_miss, bool data_miss);
@@ -238,6 +254,8 @@ class CPU : public DeviceExc {
 	void mem_access();
 	void exc_handle(PipelineRegs* preg);
 	void reg_commit();
+	void write_insttrace(PipelineRegs *preg);
+	void account_stall(uint32 stall_pc, int cause);
 	void volatilize_pipeline();
 
 	// Miscellaneous shared code. 
@@ -410,6 +428,21 @@ public:
 	void dis_mem (FILE *f, uint32 addr);
 	void cpzero_dump_regs_and_tlb (FILE *f);
 
+	// Record the committed instructions to the binary trace.
+	void attach_insttrace (InstTrace *t) { insttrace = t; }
+
+	// Attribute the lost cycles to their causes and PCs.
+	void attach_stallprof (StallProfiler *p) { stallprof = p; }
+
+	// Committed instructions (bubbles are not counted)
+	uint64 inst_retired;
+
+	// Attribute the cycles, instructions and calls to the functions.
+	void attach_funcprof (FuncProfiler *p) { funcprof = p; }
+
+	// Write the stall episodes and the cache activity to the timeline.
+	void attach_eventtrace (EventTrace *t);
+
 	// Register file accessors.
 	uint32 get_reg (const unsigned regno) { return reg[regno]; }
 	void put_reg (const unsigned regno, const uint32 new_data) {
@@ -23,14 +23,15 @@
 #include "vmips.h"
 #include "options.h"
 #include "excnames.h"
+#include "hostprof.h"
+#include "eventtrace.h"
 
-DMAC::DMAC(Mapper &m) : bus(&m)
+DMAC::DMAC(Mapper &m) : bus(&m), eventtrace(NULL), trace_track(0)
 {
 	config = new DMACConfig();
 	bus->map_at_physical_address(config, DMAC_ADDR_BASE);
 	block_words = machine->opt->option("dcachebsize")->num >> 2;
 	buffer = new uint32[block_words];
-	mem_bandwidth = machine->opt->option("mem_bandwidth")->num;
 }
 
 void DMAC::exception(uint16 excCode, int mode, int coprocno)
@@ -50,6 +51,8 @@ bool DMAC::address_valid(uint32 addr)
 
 void DMAC::step()
 {
+	HostProfScope prof(HOSTPROF_DMAC);
+
 	uint32 addr;
 	if (config->isEnabled()) {
 		next_status = status;
@@ -85,32 +88,34 @@ void DMAC::step()
 									block_words * counter * 4;
 						for (int i = 0; i < block_words; i++) {
 							bus->request_word(addr + 4 * i,
-											DATALOAD, this);
+											DATALOAD, this, false, true);
 						}
 					} else {
 						bus->request_word(query.src + 4 * counter,
-											DATALOAD, this);
+											DATALOAD, this, false, true);
 					}
 					word_counter = 0;
 					next_status = DMAC_STAT_READING;
 				}
 				break;
 			case DMAC_STAT_READING:
-				for (int i = 0; i < mem_bandwidth; i++) {
+				// read while the bus has bandwidth in this cycle
+				while (true) {
 					if (query.burst) {
 						addr = query.src + block_words * counter * 4 +
 									4 * word_counter;
 					} else {
 						addr = query.src + 4 * counter;
 					}
-					if (bus->ready(addr, DATALOAD, this)) {
-						buffer[word_counter] =
-								bus->fetch_word(addr, DATALOAD, this);
-						if (++word_counter == block_words ||
-								!query.burst) {
-							next_status = DMAC_STAT_READ_DONE;
-							break;
-						}
+					if (!bus->ready(addr, DATALOAD, this)) {
+						break;
+					}
+					buffer[word_counter] =
+							bus->fetch_word(addr, DATALOAD, this);
+					if (++word_counter == block_words ||
+							!query.burst) {
+						next_status = DMAC_STAT_READ_DONE;
+						break;
 					}
 				}
 				break;
@@ -134,11 +139,11 @@ void DMAC::step()
 									block_words * counter * 4;
 						for (int i = 0; i < block_words; i++) {
 							bus->request_word(addr + 4 * i,
-											DATASTORE, this);
+											DATASTORE, this, false, true);
 						}
 					} else {
 						bus->request_word(query.dst + 4 * counter,
-											DATASTORE, this);
+											DATASTORE, this, false, true);
 					}
 					word_counter = 0;
 					next_status = DMAC_STAT_WRITING;
@@ -146,7 +151,8 @@ void DMAC::step()
 				break;
 			case DMAC_STAT_WRITING:
 				uint32 data;
-				for (int i = 0; i < mem_bandwidth; i++) {
+				// write while the bus has bandwidth in this cycle
+				while (true) {
 					if (query.zero_write) {
 						data = 0;
 					} else {
@@ -158,13 +164,14 @@ void DMAC::step()
 					} else {
 						addr = query.dst + 4 * counter;
 					}
-					if (bus->ready(addr, DATASTORE, this)) {
-						bus->store_word(addr, data, this);
-						if (++word_counter == block_words || 
-								!query.burst) {
-							next_status = DMAC_STAT_WRITE_DONE;
-							break;
-						}
+					if (!bus->ready(addr, DATASTORE, this)) {
+						break;
+					}
+					bus->store_word(addr, data, this);
+					if (++word_counter == block_words || 
+							!query.burst) {
+						next_status = DMAC_STAT_WRITE_DONE;
+						break;
 					}
 				}
 				break;
@@ -196,6 +203,12 @@ void DMAC::step()
 			exception_pending = false;
 		}
 		status = next_status;
+		if (eventtrace != NULL) {
+			static const char *phase_names[] = {NULL, "read", "read",
+				"write", "write", "read", "write", "done"};
+			eventtrace->set_state(trace_track, phase_names[status],
+				machine->get_cycles());
+		}
 	}
 	if (config->isDone() && config->isIRQEn()) {
 		assertInt(IRQ5);
@@ -211,6 +224,12 @@ void DMAC::reset()
 	exception_pending = false;
 }
 
+void DMAC::attach_eventtrace(EventTrace *trace)
+{
+	eventtrace = trace;
+	trace_track = trace->add_track("dmac", "transfer");
+}
+
 //to override DeviceInt
 const char *DMAC::descriptor_str() const
 {
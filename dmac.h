@@ -63,6 +63,7 @@
 #define DMAC_STAT_EXIT			0x7
 
 class Mapper;
+class EventTrace;
 
 struct DMA_query_t {
 	uint32 src;
@@ -138,7 +139,9 @@ class DMAC : public DeviceExc, public DeviceInt  {
 		DMA_query_t query;
 		int counter;
 		int word_counter;
-		int mem_bandwidth;
+
+		EventTrace *eventtrace;
+		int trace_track;
 
 		bool address_valid(uint32 addr);
 	public:
@@ -151,6 +154,9 @@ class DMAC : public DeviceExc, public DeviceInt  {
 		void step ();
 		void reset ();
 
+		// transfers on the timeline
+		void attach_eventtrace(EventTrace *trace);
+
 		//for device int
 		const char *descriptor_str() const;
 };
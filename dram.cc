@@ -0,0 +1,167 @@
+/*  DRAM timing model for the external memories
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "dram.h"
+#include "vmips.h"
+#include "accesstypes.h"
+#include "stats.h"
+#include <cstdio>
+
+static inline uint32 later(uint32 a, uint32 b)
+{
+	return (int32)(a - b) > 0 ? a : b;
+}
+
+DRAMModel::DRAMModel(unsigned int bank_count_, unsigned int row_size_,
+	int tcas_, int trcd_, int trp_, int trefi_, int trfc_, int page_policy_) :
+	bank_count(bank_count_ > 0 ? bank_count_ : 1),
+	row_size(row_size_ > 0 ? row_size_ : 4),
+	tcas(tcas_),
+	trcd(trcd_),
+	trp(trp_),
+	trefi(trefi_),
+	trfc(trfc_),
+	page_policy(page_policy_)
+{
+	banks = new Bank[bank_count]();
+	next_refresh = trefi;
+
+	read_counts = 0;
+	write_counts = 0;
+	refresh_counts = 0;
+}
+
+DRAMModel::~DRAMModel()
+{
+	delete [] banks;
+}
+
+void DRAMModel::refresh(uint32 now)
+{
+	if (trefi <= 0) {
+		return;
+	}
+
+	// all the banks are precharged and refreshed at once
+	while ((int32)(now - next_refresh) >= 0) {
+		for (unsigned int i = 0; i < bank_count; i++) {
+			Bank &b = banks[i];
+			uint32 start = later(next_refresh, b.cmd_ready);
+			b.row_open = false;
+			b.cmd_ready = b.act_ready = start + trfc;
+		}
+		next_refresh += trefi;
+		refresh_counts++;
+	}
+}
+
+int DRAMModel::access(uint32 addr, int32 mode, uint32 now)
+{
+	uint32 row = addr / row_size;
+	Bank &b = banks[row % bank_count];
+	row /= bank_count;
+	int latency;
+
+	refresh(now);
+
+	uint32 start = later(now, b.cmd_ready);
+	// the closed page policy keeps the row only for a burst
+	bool hit = b.row_open && b.open_row == row &&
+		(page_policy == DRAM_PAGE_OPEN || b.last_cycle == now);
+
+	if (hit) {
+		latency = tcas;
+		b.hit_counts++;
+	} else if (b.row_open && page_policy == DRAM_PAGE_OPEN) {
+		// precharge the other row before the activation
+		latency = trp + trcd + tcas;
+		b.conflict_counts++;
+	} else {
+		start = later(start, b.act_ready);
+		latency = trcd + tcas;
+		b.miss_counts++;
+	}
+	b.row_open = true;
+	b.open_row = row;
+	b.last_cycle = now;
+
+	// column commands are pipelined, one per cycle
+	uint32 column = start + latency - tcas;
+	b.cmd_ready = column + 1;
+	if (page_policy == DRAM_PAGE_CLOSED) {
+		// auto precharge after the column access
+		b.act_ready = column + 1 + trp;
+	}
+
+	uint32 end = start + latency;
+	if ((int32)(end - b.busy_end) > 0) {
+		b.busy_cycles += end - later(start, b.busy_end);
+		b.busy_end = end;
+	}
+
+	if (mode == DATASTORE) {
+		write_counts++;
+	} else {
+		read_counts++;
+	}
+
+	return end - now;
+}
+
+void DRAMModel::register_stats(StatsRegistry &stats,
+	const std::string &prefix)
+{
+	stats.add_counter(prefix + ".reads", &read_counts);
+	stats.add_counter(prefix + ".writes", &write_counts);
+	stats.add_counter(prefix + ".refreshes", &refresh_counts);
+	for (unsigned int i = 0; i < bank_count; i++) {
+		std::string bank = prefix + ".bank" + std::to_string(i);
+		stats.add_counter(bank + ".row_hits", &banks[i].hit_counts);
+		stats.add_counter(bank + ".row_misses", &banks[i].miss_counts);
+		stats.add_counter(bank + ".row_conflicts", &banks[i].conflict_counts);
+		stats.add_counter(bank + ".busy_cycles", &banks[i].busy_cycles);
+	}
+}
+
+void DRAMModel::report_prof()
+{
+	uint32 hits = 0, misses = 0, conflicts = 0;
+
+	for (unsigned int i = 0; i < bank_count; i++) {
+		hits += banks[i].hit_counts;
+		misses += banks[i].miss_counts;
+		conflicts += banks[i].conflict_counts;
+	}
+	uint32 accesses = hits + misses + conflicts;
+
+	fprintf(stderr, "\tRead Count:\t%d\n", read_counts);
+	fprintf(stderr, "\tWrite Count:\t%d\n", write_counts);
+	fprintf(stderr, "\tRow Hit Ratio:\t%.5f%%\n",
+		(double)hits / (double)accesses * 100.0);
+	fprintf(stderr, "\tRow Misses:\t%d\n", misses);
+	fprintf(stderr, "\tRow Conflicts:\t%d\n", conflicts);
+	fprintf(stderr, "\tRefreshes:\t%d\n", refresh_counts);
+	for (unsigned int i = 0; i < bank_count; i++) {
+		Bank &b = banks[i];
+		fprintf(stderr, "\tBank %u:\thit %d, miss %d, conflict %d, "
+			"utilization %.5f%%\n", i, b.hit_counts, b.miss_counts,
+			b.conflict_counts,
+			(double)b.busy_cycles / (double)machine->num_cycles * 100.0);
+	}
+}
@@ -0,0 +1,88 @@
+/*  Headers for the DRAM timing model
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _DRAM_H_
+#define _DRAM_H_
+
+#include "types.h"
+#include <string>
+
+class StatsRegistry;
+
+#define DRAM_PAGE_OPEN		0
+#define DRAM_PAGE_CLOSED	1
+
+/* Timing model of the external DRAM shared by the memory modules.
+ * Only the timing is modeled: the data stays in the MemoryModule.
+ * Addresses are mapped as row:bank:column so that sequential accesses
+ * hit in the open row and the rows are interleaved among the banks.
+ * All the timing parameters are given in bus cycles.
+ */
+class DRAMModel {
+public:
+	DRAMModel(unsigned int bank_count_, unsigned int row_size_,
+			int tcas_, int trcd_, int trp_, int trefi_, int trfc_,
+			int page_policy_);
+	~DRAMModel();
+
+	/* Return the latency of a word access to physical address ADDR
+	   issued in the cycle NOW (later than this cycle on a split
+	   transaction bus) */
+	int access(uint32 addr, int32 mode, uint32 now);
+
+	void report_prof();
+	void register_stats(StatsRegistry &stats, const std::string &prefix);
+
+private:
+	// config
+	unsigned int bank_count;
+	unsigned int row_size;
+	int tcas;
+	int trcd;
+	int trp;
+	int trefi;
+	int trfc;
+	int page_policy;
+
+	struct Bank {
+		bool row_open;
+		uint32 open_row;
+		uint32 last_cycle;	// cycle of the last column command
+		uint32 cmd_ready;	// cycle when the next command is accepted
+		uint32 act_ready;	// cycle when a row can be activated
+		uint32 busy_end;	// end of the last data transfer
+		// profile
+		uint32 hit_counts;
+		uint32 miss_counts;
+		uint32 conflict_counts;
+		uint64 busy_cycles;
+	};
+	Bank *banks;
+
+	uint32 next_refresh;
+
+	// profile
+	uint32 read_counts;
+	uint32 write_counts;
+	uint32 refresh_counts;
+
+	void refresh(uint32 now);
+};
+
+#endif /* _DRAM_H_ */
@@ -0,0 +1,126 @@
+/*  Timeline event trace
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "eventtrace.h"
+
+EventTrace::EventTrace(const char *filename_) : filename(filename_),
+	first_event(true), event_count(0)
+{
+	fp = fopen(filename_, "w");
+	if (fp == NULL) {
+		return;
+	}
+	fprintf(fp, "{\"displayTimeUnit\":\"ns\","
+		"\"otherData\":{\"timeUnit\":\"1us = 1 cycle\"},\n"
+		"\"traceEvents\":[");
+}
+
+EventTrace::~EventTrace()
+{
+	if (fp != NULL) {
+		fclose(fp);
+	}
+}
+
+void EventTrace::begin_event()
+{
+	fprintf(fp, first_event ? "\n" : ",\n");
+	first_event = false;
+}
+
+int EventTrace::add_track(const std::string &process, const std::string &name)
+{
+	int pid;
+	auto it = processes.find(process);
+	if (it == processes.end()) {
+		pid = processes.size() + 1;
+		processes[process] = pid;
+		if (fp != NULL) {
+			// keep the modules in the order of registration
+			begin_event();
+			fprintf(fp, "{\"ph\":\"M\",\"pid\":%d,\"name\":\"process_name\","
+				"\"args\":{\"name\":\"%s\"}},\n", pid, process.c_str());
+			fprintf(fp, "{\"ph\":\"M\",\"pid\":%d,"
+				"\"name\":\"process_sort_index\",\"args\":{\"sort_index\":%d}}",
+				pid, pid);
+		}
+	} else {
+		pid = it->second;
+	}
+
+	Track t = {pid, NULL, 0};
+	tracks.push_back(t);
+	int tid = tracks.size();
+	if (fp != NULL) {
+		begin_event();
+		fprintf(fp, "{\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"name\":\"thread_name\","
+			"\"args\":{\"name\":\"%s\"}},\n", pid, tid, name.c_str());
+		fprintf(fp, "{\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+			"\"name\":\"thread_sort_index\",\"args\":{\"sort_index\":%d}}",
+			pid, tid, tid);
+	}
+	return tid - 1;
+}
+
+void EventTrace::span(int track, const char *name, uint64 begin, uint64 end,
+	const char *args)
+{
+	if (fp == NULL) {
+		return;
+	}
+	begin_event();
+	fprintf(fp, "{\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"name\":\"%s\","
+		"\"ts\":%llu,\"dur\":%llu", tracks[track].pid, track + 1, name,
+		(unsigned long long)begin, (unsigned long long)(end - begin));
+	if (args != NULL) {
+		fprintf(fp, ",\"args\":{%s}", args);
+	}
+	fputc('}', fp);
+	event_count++;
+}
+
+void EventTrace::change_state(int track, const char *state, uint64 cycle)
+{
+	Track &t = tracks[track];
+	if (t.state != NULL) {
+		span(track, t.state, t.since, cycle);
+	}
+	t.state = state;
+	t.since = cycle;
+}
+
+void EventTrace::close(uint64 cycle)
+{
+	if (fp == NULL) {
+		return;
+	}
+	for (size_t i = 0; i < tracks.size(); i++) {
+		set_state(i, NULL, cycle);
+	}
+	fprintf(fp, "\n]}\n");
+	fclose(fp);
+	fp = NULL;
+}
+
+void EventTrace::report()
+{
+	fprintf(stderr, "Event trace: %llu spans on %u tracks written to %s\n",
+		(unsigned long long)event_count, (unsigned int)tracks.size(),
+		filename.c_str());
+}
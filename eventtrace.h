@@ -0,0 +1,84 @@
+/*  Headers for the timeline event trace
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _EVENTTRACE_H_
+#define _EVENTTRACE_H_
+
+#include "types.h"
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+/* Writer of the activity of the modules as a Chrome trace event file
+ * (JSON), which chrome://tracing and the Perfetto UI can open. One
+ * cycle is written as one microsecond.
+ *
+ * The modules are the processes of the trace and each of them has
+ * tracks (threads), e.g. process "cpu" with tracks "pipeline" and
+ * "icache". A track is either given complete spans, or it is driven
+ * as a state machine with set_state(): a span is written whenever the
+ * state changes. The state names must be static strings because they
+ * are compared by pointer; NULL is the idle state.
+ */
+class EventTrace {
+public:
+	EventTrace(const char *filename);
+	~EventTrace();
+
+	bool is_open() const { return fp != NULL; }
+
+	/* Return the ID of a new track NAME of the module PROCESS */
+	int add_track(const std::string &process, const std::string &name);
+
+	/* Write a span of [BEGIN, END) cycles. ARGS is the content of a
+	   JSON object shown with the span, or NULL. */
+	void span(int track, const char *name, uint64 begin, uint64 end,
+		const char *args = NULL);
+
+	void set_state(int track, const char *state, uint64 cycle) {
+		if (tracks[track].state != state) {
+			change_state(track, state, cycle);
+		}
+	}
+
+	/* End the spans in progress at CYCLE and finish the file */
+	void close(uint64 cycle);
+
+	void report();
+
+private:
+	struct Track {
+		int pid;
+		const char *state;
+		uint64 since;
+	};
+
+	FILE *fp;
+	std::string filename;
+	bool first_event;
+	uint64 event_count;
+	std::map<std::string, int> processes;
+	std::vector<Track> tracks;
+
+	void change_state(int track, const char *state, uint64 cycle);
+	void begin_event();
+};
+
+#endif /* _EVENTTRACE_H_ */
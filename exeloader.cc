@@ -198,10 +198,66 @@ bool vmips::load_ecoff (FILE *fp) {
   return rv;
 }
 
+static uint32 elf_word (const unsigned char *p, int size, bool bigendian) {
+  uint32 v = 0;
+  for (int i = 0; i < size; i++)
+    v |= (uint32) p[bigendian ? i : size - 1 - i] << (8 * (size - 1 - i));
+  return v;
+}
+
+#define PT_LOAD 1
+
 bool vmips::load_elf (FILE *fp) {
-  error ("Can't load elf files yet");
+  bool rv = true;
+  try {
+
+  unsigned char ehdr[52];
+  if (fseek (fp, 0, SEEK_SET) < 0 || fread (ehdr, sizeof (ehdr), 1, fp) != 1)
+    throw std::string ("Can't read ELF header");
+  if (ehdr[4] != 1)
+    throw std::string ("Only 32-bit ELF files are supported");
+  bool be = (ehdr[5] == 2);
+  uint32 phoff = elf_word (&ehdr[28], 4, be);
+  uint32 phentsize = elf_word (&ehdr[42], 2, be);
+  uint32 phnum = elf_word (&ehdr[44], 2, be);
+
+  for (uint32 i = 0; i < phnum; i++) {
+    unsigned char phdr[32];
+    if (fseek (fp, phoff + i * phentsize, SEEK_SET) < 0
+        || fread (phdr, sizeof (phdr), 1, fp) != 1)
+      throw std::string ("Can't read program headers");
+    if (elf_word (&phdr[0], 4, be) != PT_LOAD
+        || elf_word (&phdr[20], 4, be) == 0)
+      continue;
+    uint32 offset = elf_word (&phdr[4], 4, be);
+    uint32 vaddr = elf_word (&phdr[8], 4, be);
+    uint32 filesz = elf_word (&phdr[16], 4, be);
+    uint32 memsz = elf_word (&phdr[20], 4, be);
+    printf ("segment: 0x%x, %u bytes (%u bytes in file) at file offset %u\n",
+            vaddr, memsz, filesz, offset);
+
+    if (filesz > memsz)
+      throw std::string ("Segment has more bytes in file than in memory");
+    char *dst = translate_to_host_ram_pointer (vaddr);
+    // the whole segment has to be in one RAM module
+    if (!dst || vaddr + memsz - 1 < vaddr
+        || translate_to_host_ram_pointer (vaddr + memsz - 1) != dst + memsz - 1)
+      throw std::string ("Segment is out of RAM");
+    if (fseek (fp, offset, SEEK_SET) < 0)
+      throw std::string ("Can't seek to segment");
+    if (fread (dst, 1, filesz, fp) != filesz)
+      throw std::string ("Can't read segment");
+    memset (dst + filesz, 0, memsz - filesz);
+  }
+  putchar ('\n');
+
+  } catch (std::string &errorstr) {
+    error ("%s", errorstr.c_str ());
+    rv = false;
+  }
+
   fclose (fp);
-  return false;
+  return rv;
 }
 
 bool
@@ -0,0 +1,89 @@
+/*  Headers for the binary trace of the flits in the Cube network
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _FLITTRACE_H_
+#define _FLITTRACE_H_
+
+#include "types.h"
+#include "tracefile.h"
+#include "spscring.h"
+#include <atomic>
+#include <thread>
+
+#define FLITTRACE_MAGIC		"CSFT"
+#define FLITTRACE_VERSION	1
+
+#define FLITTRACE_FLIT		0 //a flit goes through the crossbar
+#define FLITTRACE_ACK		1 //an ACK flit is forwarded to the sender
+
+#define FLITTRACE_NO_PORT	0xFF
+
+#define FLITTRACE_RING_SIZE	(1 << 16)
+
+/* One record per flit through the crossbar of a router, stored in the
+   host byte order */
+struct FlitTraceRecord {
+	uint64 cycle;
+	uint64 data;
+	uint16 router;
+	uint8 in_port;		// FLITTRACE_NO_PORT for the ACKs
+	uint8 out_port;
+	uint8 vch;
+	uint8 out_vch;
+	uint8 ftype;
+	uint8 kind;
+	uint8 src;			// decoded from the head flits
+	uint8 dst;
+	uint8 mtype;
+	uint8 reserved[5];
+};
+
+/* The routers push the records to a lock-free ring and a writer thread
+ * packs them into the chunks of a TraceFile, in the same way as the
+ * instruction trace. Use tracetool to filter the flits or to list the
+ * packets with their latency.
+ */
+class FlitTrace {
+public:
+	FlitTrace(const char *filename, int codec);
+	~FlitTrace();
+
+	bool is_open() const { return file->is_open(); }
+	void record(const FlitTraceRecord &r) {
+		while (!ring.push(r)) {
+			// the writer falls behind
+			std::this_thread::yield();
+		}
+		record_counts++;
+	}
+	void close();
+	void report();
+
+private:
+	TraceFile *file;
+	SPSCRing<FlitTraceRecord> ring;
+	std::thread worker;
+	std::atomic<bool> stopping;
+	bool closed;
+	uint64 record_counts;
+
+	void run();
+};
+
+#endif /* _FLITTRACE_H_ */
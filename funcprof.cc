@@ -0,0 +1,285 @@
+/*  Per-function profiler of the guest program
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "funcprof.h"
+#include "cpu.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// gmon.out format of gprof
+#define GMON_VERSION		1
+#define GMON_TAG_TIME_HIST	0
+#define GMON_TAG_CG_ARC		1
+#define GMON_MAX_BINS		(1 << 20)
+
+FuncProfiler::FuncProfiler(const SymbolTable *symtab_, unsigned int top_n_) :
+	symtab(symtab_), top_n(top_n_), funcs(symtab_->size() + 1),
+	total_cycles(0), pending_call(false), pending_return(false),
+	call_site(0), cur_lo(0), cur_hi(0), cur_func(0)
+{
+}
+
+int FuncProfiler::lookup_func(uint32 pc)
+{
+	int i = symtab->lookup(pc);
+	if (i < 0) {
+		return symtab->size();
+	}
+	const SymbolTable::Symbol &s = symtab->symbol(i);
+	cur_lo = s.addr;
+	cur_hi = s.addr + s.size;
+	cur_func = i;
+	return i;
+}
+
+const char *FuncProfiler::func_name(int func) const
+{
+	if (func == (int)symtab->size()) {
+		return "<unknown>";
+	}
+	return symtab->symbol(func).name.c_str();
+}
+
+void FuncProfiler::retire(uint32 pc, uint32 instr, bool delay_slot)
+{
+	stats(pc).instrs++;
+
+	// the target is known when the first instruction after the delay
+	// slot is committed
+	if (!delay_slot) {
+		if (pending_call) {
+			pending_call = false;
+			// branch and link not taken
+			if (pc != call_site + 8) {
+				enter(pc);
+			}
+		} else if (pending_return) {
+			pending_return = false;
+			leave(pc);
+		}
+	}
+
+	uint16 op = CPU::opcode(instr);
+	if (op == 3 || (op == 0 && CPU::funct(instr) == 9)
+		|| (op == 1 && (CPU::rt(instr) & 0x1e) == 0x10)) {
+		// jal, jalr, bltzal, bgezal
+		pending_call = true;
+		call_site = pc;
+	} else if (op == 0 && CPU::funct(instr) == 8 && CPU::rs(instr) == 31) {
+		// jr $ra
+		pending_return = true;
+	}
+}
+
+void FuncProfiler::enter(uint32 pc)
+{
+	int func = func_index(pc);
+	Frame f = {func, call_site + 8, total_cycles};
+
+	arcs[std::make_pair(call_site, pc)]++;
+	funcs[func].calls++;
+	funcs[func].active++;
+	stack.push_back(f);
+}
+
+void FuncProfiler::leave(uint32 pc)
+{
+	// unwind to the caller if some frames did not return normally
+	size_t depth = stack.size();
+	while (depth > 0 && stack[depth - 1].ret_addr != pc) {
+		depth--;
+	}
+	if (depth == 0) {
+		depth = stack.size();
+	}
+	while (!stack.empty() && stack.size() >= depth) {
+		Frame &f = stack.back();
+		FuncStats &s = funcs[f.func];
+		// recursive calls are counted once
+		if (--s.active == 0) {
+			s.inclusive += total_cycles - f.entry_cycle;
+		}
+		stack.pop_back();
+	}
+}
+
+void FuncProfiler::report_prof()
+{
+	// functions which have not returned yet
+	std::vector<uint64> inclusive(funcs.size());
+	std::vector<bool> counted(funcs.size(), false);
+	for (size_t i = 0; i < funcs.size(); i++) {
+		inclusive[i] = funcs[i].inclusive;
+	}
+	for (auto &f : stack) {
+		if (!counted[f.func]) {
+			inclusive[f.func] += total_cycles - f.entry_cycle;
+			counted[f.func] = true;
+		}
+	}
+
+	std::vector<int> order;
+	for (size_t i = 0; i < funcs.size(); i++) {
+		if (funcs[i].cycles > 0 || funcs[i].calls > 0) {
+			order.push_back(i);
+		}
+	}
+	std::sort(order.begin(), order.end(), [this](int a, int b) {
+		return funcs[a].cycles > funcs[b].cycles;
+	});
+
+	fprintf(stderr, "\tTotal %llu cycles in %u functions\n",
+		(unsigned long long)total_cycles, (unsigned int)order.size());
+	fprintf(stderr, "\t%7s %11s %11s %6s %10s %8s %8s %8s %11s  %s\n",
+		"%cycles", "self", "instrs", "CPI", "stalls", "icmiss", "dcmiss",
+		"calls", "inclusive", "function");
+	for (size_t n = 0; n < order.size() && n < top_n; n++) {
+		const FuncStats &s = funcs[order[n]];
+		fprintf(stderr, "\t%6.2f%% %11llu %11llu %6.2f %10llu %8llu %8llu "
+			"%8llu %11llu  %s\n",
+			(double)s.cycles / (double)total_cycles * 100.0,
+			(unsigned long long)s.cycles, (unsigned long long)s.instrs,
+			s.instrs == 0 ? 0.0 : (double)s.cycles / (double)s.instrs,
+			(unsigned long long)s.stalls,
+			(unsigned long long)s.icache_misses,
+			(unsigned long long)s.dcache_misses,
+			(unsigned long long)s.calls,
+			(unsigned long long)inclusive[order[n]], func_name(order[n]));
+	}
+
+	// call graph arcs between the functions
+	std::map<std::pair<int, int>, uint64> func_arcs;
+	for (auto &a : arcs) {
+		func_arcs[std::make_pair(func_index(a.first.first),
+			func_index(a.first.second))] += a.second;
+	}
+	std::vector<std::pair<std::pair<int, int>, uint64> > sorted(
+		func_arcs.begin(), func_arcs.end());
+	std::sort(sorted.begin(), sorted.end(),
+		[](const std::pair<std::pair<int, int>, uint64> &a,
+		   const std::pair<std::pair<int, int>, uint64> &b) {
+			return a.second > b.second;
+		});
+	fprintf(stderr, "\tTop %u call arcs\n", top_n);
+	for (size_t n = 0; n < sorted.size() && n < top_n; n++) {
+		fprintf(stderr, "\t%11llu  %s -> %s\n",
+			(unsigned long long)sorted[n].second,
+			func_name(sorted[n].first.first),
+			func_name(sorted[n].first.second));
+	}
+}
+
+/* Writer of the integers in the byte order of the guest */
+class GmonWriter {
+public:
+	GmonWriter(FILE *fp_, bool bigendian_) : fp(fp_), bigendian(bigendian_) {}
+	void u8(uint8 v) { fputc(v, fp); }
+	void u16(uint16 v) {
+		uint8 b[2] = {(uint8)(v >> 8), (uint8)v};
+		if (!bigendian) {
+			std::swap(b[0], b[1]);
+		}
+		fwrite(b, 1, 2, fp);
+	}
+	void u32(uint32 v) {
+		uint8 b[4] = {(uint8)(v >> 24), (uint8)(v >> 16), (uint8)(v >> 8),
+			(uint8)v};
+		if (!bigendian) {
+			std::reverse(b, b + 4);
+		}
+		fwrite(b, 1, 4, fp);
+	}
+	void bytes(const void *p, size_t len) { fwrite(p, 1, len, fp); }
+private:
+	FILE *fp;
+	bool bigendian;
+};
+
+bool FuncProfiler::write_gmon(const char *filename)
+{
+	FILE *fp = fopen(filename, "wb");
+	if (fp == NULL) {
+		return false;
+	}
+	GmonWriter w(fp, symtab->is_bigendian());
+
+	w.bytes("gmon", 4);
+	w.u32(GMON_VERSION);
+	uint8 spare[12] = {0};
+	w.bytes(spare, sizeof(spare));
+
+	// one bin per instruction over the executed functions unless the
+	// range is too large
+	uint32 low = 0xffffffff, high = 0;
+	for (auto &p : pc_cycles) {
+		if (symtab->lookup(p.first) < 0) {
+			continue;
+		}
+		low = std::min(low, p.first & ~3);
+		high = std::max(high, (p.first & ~3) + 4);
+	}
+	if (low >= high) {
+		low = high = 0;
+	}
+	uint32 bin_size = 4;
+	while ((high - low) / bin_size > GMON_MAX_BINS) {
+		bin_size *= 2;
+	}
+	uint32 nbins = (high - low + bin_size - 1) / bin_size;
+	std::vector<uint64> bins(nbins, 0);
+	for (auto &p : pc_cycles) {
+		if (p.first - low < high - low) {
+			bins[(p.first - low) / bin_size] += p.second;
+		}
+	}
+
+	// the samples are 16-bit, so gprof sums up the records of the
+	// same range
+	char dimen[15];
+	memset(dimen, 0, sizeof(dimen));
+	strncpy(dimen, "cycles", sizeof(dimen));
+	bool remaining = true;
+	while (remaining) {
+		remaining = false;
+		w.u8(GMON_TAG_TIME_HIST);
+		w.u32(low);
+		w.u32(low + nbins * bin_size);
+		w.u32(nbins);
+		w.u32(1);
+		w.bytes(dimen, sizeof(dimen));
+		w.u8('c');
+		for (auto &b : bins) {
+			uint16 n = b > 0xffff ? 0xffff : b;
+			w.u16(n);
+			b -= n;
+			remaining |= (b > 0);
+		}
+	}
+
+	for (auto &a : arcs) {
+		w.u8(GMON_TAG_CG_ARC);
+		w.u32(a.first.first);
+		w.u32(a.first.second);
+		w.u32(a.second > 0xffffffffULL ? 0xffffffff : a.second);
+	}
+
+	fclose(fp);
+	return true;
+}
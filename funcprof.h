@@ -0,0 +1,116 @@
+/*  Headers for the per-function profiler of the guest program
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _FUNCPROF_H_
+#define _FUNCPROF_H_
+
+#include "types.h"
+#include "symtab.h"
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#define FUNCPROF_ICACHE	0
+#define FUNCPROF_DCACHE	1
+
+/* Attributes the CPU cycles, committed instructions, stalls and L1 cache
+ * misses to the functions of the symbol table. Calls (jal, jalr, bgezal,
+ * bltzal) and returns (jr $ra) are followed at commit with a shadow call
+ * stack to count the calls, the call graph arcs and the inclusive cycles.
+ * The result can be written as a gmon.out file for gprof, where every
+ * histogram sample is a cycle.
+ */
+class FuncProfiler {
+public:
+	FuncProfiler(const SymbolTable *symtab_, unsigned int top_n_);
+
+	/* A cycle of the CPU spent for the instruction at PC */
+	void add_cycle(uint32 pc) {
+		stats(pc).cycles++;
+		pc_cycles[pc]++;
+		total_cycles++;
+	}
+	/* A cycle lost by the instruction at PC */
+	void add_stall(uint32 pc) { stats(pc).stalls++; }
+	/* A cache miss caused by the instruction at PC */
+	void add_miss(uint32 pc, int kind) {
+		if (kind == FUNCPROF_ICACHE) {
+			stats(pc).icache_misses++;
+		} else {
+			stats(pc).dcache_misses++;
+		}
+	}
+	/* An instruction committed */
+	void retire(uint32 pc, uint32 instr, bool delay_slot);
+
+	void report_prof();
+	bool write_gmon(const char *filename);
+
+private:
+	struct FuncStats {
+		uint64 cycles;
+		uint64 instrs;
+		uint64 stalls;
+		uint64 icache_misses;
+		uint64 dcache_misses;
+		uint64 calls;
+		uint64 inclusive;	// cycles including the callees
+		int active;			// instances on the call stack
+	};
+
+	struct Frame {
+		int func;
+		uint32 ret_addr;
+		uint64 entry_cycle;
+	};
+
+	const SymbolTable *symtab;
+	unsigned int top_n;
+
+	// the last entry is for the PCs out of the symbols
+	std::vector<FuncStats> funcs;
+	std::unordered_map<uint32, uint64> pc_cycles;
+	uint64 total_cycles;
+
+	// call graph
+	std::map<std::pair<uint32, uint32>, uint64> arcs;
+	std::vector<Frame> stack;
+	bool pending_call;
+	bool pending_return;
+	uint32 call_site;
+
+	// range of the last looked up function
+	uint32 cur_lo, cur_hi;
+	int cur_func;
+
+	int func_index(uint32 pc) {
+		if (pc - cur_lo < cur_hi - cur_lo) {
+			return cur_func;
+		}
+		return lookup_func(pc);
+	}
+	int lookup_func(uint32 pc);
+	FuncStats &stats(uint32 pc) { return funcs[func_index(pc)]; }
+	void enter(uint32 pc);
+	void leave(uint32 pc);
+	const char *func_name(int func) const;
+};
+
+#endif /* _FUNCPROF_H_ */
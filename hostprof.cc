@@ -0,0 +1,104 @@
+/*  Host-side profiler of the simulator
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "hostprof.h"
+#include <cstdio>
+#include <cstring>
+#include <sys/time.h>
+
+HostProfiler *HostProfiler::sampling = NULL;
+volatile sig_atomic_t HostProfiler::toggle_request = 0;
+
+static double wall_sec()
+{
+	timeval tv;
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+}
+
+HostProfiler::HostProfiler(unsigned int period_) :
+	period(period_ == 0 ? 1 : period_), count(0), enabled(true),
+	depth(0), last(0), sampled_cycles(0), stop_ticks(0), stop_sec(0.0)
+{
+	memset(self, 0, sizeof(self));
+	memset(calls, 0, sizeof(calls));
+
+	// average time between two consecutive reads
+	const int n = 1000;
+	uint64 t0 = ticks(), t = t0;
+	for (int i = 0; i < n; i++) {
+		t = ticks();
+	}
+	overhead = (t - t0) / n;
+
+	start_ticks = ticks();
+	start_sec = wall_sec();
+}
+
+const char *HostProfiler::scope_name(int scope)
+{
+	static const char *names[HOSTPROF_SCOPES] = {
+		"Other", "CPU", "Cache", "DMAC", "RouterInterface", "Router",
+		"Accelerator NIF", "CMA", "SNACC"
+	};
+	return names[scope];
+}
+
+void HostProfiler::stop()
+{
+	stop_ticks = ticks();
+	stop_sec = wall_sec();
+}
+
+void HostProfiler::report_prof(uint32 num_cycles)
+{
+	if (stop_ticks == 0) {
+		stop();
+	}
+	double elapsed = stop_sec - start_sec;
+	double ns_per_tick = stop_ticks > start_ticks ?
+		elapsed * 1e9 / (double)(stop_ticks - start_ticks) : 0.0;
+
+	fprintf(stderr, "\tSampled %llu of %u cycles (1 in %u)\n",
+		(unsigned long long)sampled_cycles, num_cycles, period);
+	fprintf(stderr, "\t%u cycles in %.3f host seconds (%.0f cycles per "
+		"second)\n", num_cycles, elapsed,
+		elapsed > 0.0 ? (double)num_cycles / elapsed : 0.0);
+	if (sampled_cycles == 0) {
+		return;
+	}
+
+	uint64 total = 0;
+	for (int i = 0; i < HOSTPROF_SCOPES; i++) {
+		total += self[i];
+	}
+	fprintf(stderr, "\t%-16s %10s %7s %12s\n", "component", "ns/cycle",
+		"share", "calls/cycle");
+	for (int i = 0; i < HOSTPROF_SCOPES; i++) {
+		if (self[i] == 0) {
+			continue;
+		}
+		fprintf(stderr, "\t%-16s %10.1f %6.2f%% %12.2f\n", scope_name(i),
+			(double)self[i] * ns_per_tick / (double)sampled_cycles,
+			(double)self[i] / (double)total * 100.0,
+			(double)calls[i] / (double)sampled_cycles);
+	}
+	fprintf(stderr, "\t%-16s %10.1f\n", "total",
+		(double)total * ns_per_tick / (double)sampled_cycles);
+}
@@ -0,0 +1,159 @@
+/*  Headers for the host-side profiler of the simulator
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _HOSTPROF_H_
+#define _HOSTPROF_H_
+
+#include "types.h"
+#include <cassert>
+#include <csignal>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <ctime>
+#endif
+
+/* Components whose step functions are timed */
+enum HostProfScopeId {
+	HOSTPROF_OTHER,			// main loop and everything not below
+	HOSTPROF_CPU,			// CPU::step except the caches
+	HOSTPROF_CACHE,			// Cache::step
+	HOSTPROF_DMAC,			// DMAC::step
+	HOSTPROF_RTIF,			// RouterInterface::step except the router
+	HOSTPROF_ROUTER,		// Router::step
+	HOSTPROF_ACCEL,			// network/bus interface of the accelerators
+	HOSTPROF_CMA,			// CMA::core_step
+	HOSTPROF_SNACC,			// SNACC::core_step
+	HOSTPROF_SCOPES
+};
+
+#define HOSTPROF_MAX_DEPTH	8
+
+/* Measures the host time spent in each component per simulated cycle.
+ * Only one of every PERIOD cycles is timed, with the time stamp counter,
+ * so the cost of the other cycles is a pointer test per scope. Time is
+ * charged to the innermost scope, i.e. the caches are not counted in
+ * the CPU. The measurement can be paused and resumed by a signal.
+ */
+class HostProfiler {
+public:
+	HostProfiler(unsigned int period_);
+
+	/* The profiler timing the current cycle, or NULL */
+	static HostProfiler *sampling;
+
+	static uint64 ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+	}
+
+	void cycle_begin() {
+		if (toggle_request) {
+			toggle_request = 0;
+			enabled = !enabled;
+		}
+		if (!enabled || ++count < period) {
+			return;
+		}
+		count = 0;
+		sampling = this;
+		depth = 1;
+		stack[0] = HOSTPROF_OTHER;
+		last = ticks();
+	}
+	void cycle_end() {
+		if (sampling != this) {
+			return;
+		}
+		charge(HOSTPROF_OTHER, ticks());
+		sampled_cycles++;
+		sampling = NULL;
+	}
+
+	void enter(int scope) {
+		assert(depth < HOSTPROF_MAX_DEPTH);
+		charge(stack[depth - 1], ticks());
+		stack[depth++] = scope;
+		calls[scope]++;
+	}
+	void leave() {
+		charge(stack[--depth], ticks());
+	}
+
+	/* Pause or resume at the next cycle (safe in a signal handler) */
+	static void request_toggle() { toggle_request = 1; }
+
+	/* End of the simulation */
+	void stop();
+	void report_prof(uint32 num_cycles);
+
+	static const char *scope_name(int scope);
+
+private:
+	static volatile sig_atomic_t toggle_request;
+
+	void charge(int scope, uint64 now) {
+		uint64 d = now - last;
+		self[scope] += d > overhead ? d - overhead : 0;
+		last = now;
+	}
+
+	unsigned int period;
+	unsigned int count;
+	bool enabled;
+
+	int stack[HOSTPROF_MAX_DEPTH];
+	int depth;
+	uint64 last;
+
+	// cost of reading the counter, which is not negligible in a VM
+	uint64 overhead;
+
+	uint64 self[HOSTPROF_SCOPES];
+	uint64 calls[HOSTPROF_SCOPES];
+	uint64 sampled_cycles;
+
+	// calibration of the ticks and the wall clock time of the run
+	uint64 start_ticks, stop_ticks;
+	double start_sec, stop_sec;
+};
+
+/* Charges the host time until the end of the block to SCOPE */
+class HostProfScope {
+public:
+	HostProfScope(int scope) : prof(HostProfiler::sampling) {
+		if (prof != NULL) {
+			prof->enter(scope);
+		}
+	}
+	~HostProfScope() {
+		if (prof != NULL) {
+			prof->leave();
+		}
+	}
+private:
+	HostProfiler *prof;
+};
+
+#endif /* _HOSTPROF_H_ */
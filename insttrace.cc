@@ -0,0 +1,87 @@
+/*  Binary instruction trace written by a background thread
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "insttrace.h"
+#include <chrono>
+#include <cstdio>
+
+#define RECORDS_PER_CHUNK (TRACE_CHUNK_SIZE / sizeof(InstTraceRecord))
+
+InstTrace::InstTrace(const char *filename, int codec) :
+	ring(INSTTRACE_RING_SIZE), stopping(false), closed(false),
+	record_counts(0)
+{
+	file = new TraceFile(filename, INSTTRACE_MAGIC, INSTTRACE_VERSION, codec);
+	if (file->is_open()) {
+		worker = std::thread(&InstTrace::run, this);
+	} else {
+		closed = true;
+	}
+}
+
+InstTrace::~InstTrace()
+{
+	close();
+	delete file;
+}
+
+void InstTrace::run()
+{
+	InstTraceRecord *chunk = new InstTraceRecord[RECORDS_PER_CHUNK];
+	size_t fill = 0;
+
+	while (true) {
+		bool last = stopping.load(std::memory_order_acquire);
+		size_t n = ring.pop(chunk + fill, RECORDS_PER_CHUNK - fill);
+		fill += n;
+		if (fill == RECORDS_PER_CHUNK) {
+			file->write_chunk((uint8 *)chunk, fill * sizeof(InstTraceRecord));
+			fill = 0;
+		} else if (n == 0) {
+			if (last) {
+				// the ring has been drained after the producer stopped
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+	}
+	file->write_chunk((uint8 *)chunk, fill * sizeof(InstTraceRecord));
+	delete [] chunk;
+}
+
+void InstTrace::close()
+{
+	if (closed) {
+		return;
+	}
+	stopping.store(true, std::memory_order_release);
+	worker.join();
+	file->close();
+	closed = true;
+}
+
+void InstTrace::report()
+{
+	fprintf(stderr, "Instruction trace: %llu records, %llu bytes of data (%llu "
+		"bytes before compression), %llu bytes of headers\n",
+		(unsigned long long)record_counts,
+		(unsigned long long)file->stored_bytes(),
+		(unsigned long long)file->raw_bytes(),
+		(unsigned long long)file->header_bytes());
+}
@@ -0,0 +1,84 @@
+/*  Headers for the binary instruction trace
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _INSTTRACE_H_
+#define _INSTTRACE_H_
+
+#include "types.h"
+#include "tracefile.h"
+#include "spscring.h"
+#include <atomic>
+#include <thread>
+
+#define INSTTRACE_MAGIC		"CSIT"
+#define INSTTRACE_VERSION	1
+
+#define INSTTRACE_REG_WRITE		0x01
+#define INSTTRACE_MEM_READ		0x02
+#define INSTTRACE_MEM_WRITE		0x04
+#define INSTTRACE_DELAY_SLOT	0x08
+
+#define INSTTRACE_RING_SIZE		(1 << 16)
+
+/* One record per instruction committed in the WB stage, stored in the
+   host byte order */
+struct InstTraceRecord {
+	uint64 cycle;
+	uint32 pc;
+	uint32 instr;
+	uint32 reg_value;	// value written to reg (INSTTRACE_REG_WRITE)
+	uint32 mem_addr;	// virtual address of the load/store
+	uint32 mem_data;	// data of the store
+	uint8 reg;
+	uint8 flags;
+	uint16 reserved;
+};
+
+/* The CPU pushes the records to a lock-free ring and a writer thread
+ * packs them into the chunks of a TraceFile. Use tracetool to
+ * disassemble the trace.
+ */
+class InstTrace {
+public:
+	InstTrace(const char *filename, int codec);
+	~InstTrace();
+
+	bool is_open() const { return file->is_open(); }
+	void record(const InstTraceRecord &r) {
+		while (!ring.push(r)) {
+			// the writer falls behind
+			std::this_thread::yield();
+		}
+		record_counts++;
+	}
+	void close();
+	void report();
+
+private:
+	TraceFile *file;
+	SPSCRing<InstTraceRecord> ring;
+	std::thread worker;
+	std::atomic<bool> stopping;
+	bool closed;
+	uint64 record_counts;
+
+	void run();
+};
+
+#endif /* _INSTTRACE_H_ */
@@ -0,0 +1,295 @@
+/*  Shared L2 cache between the system bus and the external memories
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "l2cache.h"
+#include "cache.h"
+#include "vmips.h"
+#include "accesstypes.h"
+#include "stats.h"
+#include <cmath>
+#include <cstdio>
+
+//#define L2CACHE_DEBUG
+
+L2Cache::L2Cache(unsigned int block_count_, unsigned int block_size_,
+	unsigned int way_size_, unsigned int bank_count_, int hit_latency_,
+	int policy_) :
+	block_count(block_count_),
+	block_size(block_size_),
+	way_size(way_size_),
+	bank_count(bank_count_ > 0 ? bank_count_ : 1),
+	hit_latency(hit_latency_),
+	policy(policy_)
+{
+	blocks = new Entry*[way_size];
+	for (unsigned int i = 0; i < way_size; i++) {
+		blocks[i] = new Entry[block_count];
+		for (unsigned int j = 0; j < block_count; j++) {
+			blocks[i][j].valid = false;
+			blocks[i][j].dirty = false;
+			blocks[i][j].moving_up = false;
+			blocks[i][j].last_access = 0;
+			blocks[i][j].tag = 0;
+		}
+	}
+
+	bank_busy_until = new uint32[bank_count]();
+
+	// analyze bit format
+	offset_len = int(std::log2(block_size));
+	index_len = int(std::log2(block_count));
+
+	// init cache profile
+	hit_counts = 0;
+	miss_counts = 0;
+	wb_counts = 0;
+	merge_counts = 0;
+	back_inv_counts = 0;
+	saved_cycles = 0;
+}
+
+L2Cache::~L2Cache()
+{
+	for (unsigned int i = 0; i < way_size; i++) {
+		delete [] blocks[i];
+	}
+	delete [] blocks;
+	delete [] bank_busy_until;
+}
+
+bool L2Cache::covers(Range *r)
+{
+	for (auto range : ranges) {
+		if (range == r) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void L2Cache::addr_separete(uint32 addr, uint32 &tag, uint32 &index)
+{
+	tag = addr >> (offset_len + index_len);
+	index = (addr & ((1 << (index_len + offset_len)) - 1)) >> offset_len;
+}
+
+uint32 L2Cache::calc_addr(uint32 way, uint32 index)
+{
+	return (blocks[way][index].tag << (offset_len + index_len)) + (index << offset_len);
+}
+
+bool L2Cache::lookup(uint32 tag, uint32 index, uint32 &way, uint32 now)
+{
+	for (way = 0; way < way_size; way++) {
+		Entry &e = blocks[way][index];
+		if (e.valid && e.moving_up && e.last_access != now) {
+			// exclusive policy: the block has been moved to L1
+			e.valid = e.dirty = e.moving_up = false;
+		}
+		if (e.valid && e.tag == tag) {
+			return true;
+		}
+	}
+	return false;
+}
+
+uint32 L2Cache::allocate(uint32 tag, uint32 index, Range *backing, uint32 now)
+{
+	uint32 way, least_recent_used_way = 0;
+	bool find = false;
+
+	//find free block or LRU block
+	for (way = 0; way < way_size; way++) {
+		if (!blocks[way][index].valid) {
+			find = true;
+			break;
+		}
+		if (blocks[least_recent_used_way][index].last_access >
+				blocks[way][index].last_access) {
+			least_recent_used_way = way;
+		}
+	}
+
+	if (!find) {
+		way = least_recent_used_way;
+		Entry &victim = blocks[way][index];
+		uint32 victim_addr = calc_addr(way, index);
+		if (victim.dirty) {
+			// write back occupies the bank while memory is written
+			uint32 bank = index % bank_count;
+			uint32 start = bank_busy_until[bank] > now ? bank_busy_until[bank] : now;
+			bank_busy_until[bank] = start + backing->access_latency(
+				victim_addr - backing->getBase(), DATASTORE, start);
+			wb_counts++;
+		}
+		if (policy == L2_POLICY_INCLUSIVE) {
+			for (auto c : uppers) {
+				back_inv_counts += c->back_invalidate(victim_addr, block_size);
+			}
+		}
+#if defined(L2CACHE_DEBUG)
+		fprintf(stderr, "L2 evicts addr(0x%x) for index(%d)\n", victim_addr, index);
+#endif
+	}
+
+	Entry &e = blocks[way][index];
+	e.valid = true;
+	e.dirty = false;
+	e.moving_up = false;
+	e.tag = tag;
+	e.last_access = now;
+	return way;
+}
+
+int L2Cache::access(uint32 addr, int32 mode, DeviceExc *client, Range *backing,
+	bool from_l1, uint32 now)
+{
+	uint32 tag, index, way;
+	uint32 block_addr = addr & ~(block_size - 1);
+	int mem_latency = backing->extra_latency();
+	int latency;
+
+	addr_separete(addr, tag, index);
+
+	// retire finished requests & look for the same block
+	InFlight *same = NULL;
+	for (auto it = inflights.begin(); it != inflights.end(); ) {
+		if ((int32)(now - it->ready) >= 0) {
+			it = inflights.erase(it);
+		} else {
+			if (it->block_addr == block_addr) {
+				same = &(*it);
+			}
+			++it;
+		}
+	}
+
+	if (same != NULL) {
+		if (same->issued == now && same->client == client && same->mode == mode) {
+			// rest of the words in the same block transfer
+			return same->ready - now;
+		} else if (same->miss) {
+			// the block is still on its way from memory
+			merge_counts++;
+			if (lookup(tag, index, way, now)) {
+				blocks[way][index].last_access = now;
+				if (mode == DATASTORE) {
+					blocks[way][index].dirty = true;
+				}
+			}
+			latency = same->ready - now;
+			saved_cycles += mem_latency - latency;
+			return latency;
+		}
+	}
+
+	// each bank accepts one tag lookup per cycle
+	uint32 bank = index % bank_count;
+	uint32 start = bank_busy_until[bank] > now ? bank_busy_until[bank] : now;
+	bank_busy_until[bank] = start + 1;
+	latency = (start - now) + hit_latency;
+
+	bool hit = lookup(tag, index, way, now);
+	if (hit) {
+		Entry &e = blocks[way][index];
+		hit_counts++;
+		e.last_access = now;
+		if (mode == DATASTORE) {
+			e.dirty = true;
+		} else if (policy == L2_POLICY_EXCLUSIVE && from_l1) {
+			e.moving_up = true;
+		}
+#if defined(L2CACHE_DEBUG)
+		fprintf(stderr, "L2 Hit addr(0x%x) latency %d\n", addr, latency);
+#endif
+	} else {
+		miss_counts++;
+		if (mode == DATASTORE && from_l1) {
+			// write back from L1 covers the whole block, no need to fetch
+			way = allocate(tag, index, backing, now);
+			blocks[way][index].dirty = true;
+		} else if (mode == DATASTORE) {
+			// DMA writes the words through to memory without allocating
+			latency += backing->access_latency(addr - backing->getBase(), mode,
+				now + latency);
+		} else {
+			// the memory is accessed once the tags have been looked up
+			latency += backing->access_latency(addr - backing->getBase(), mode,
+				now + latency);
+			if (policy != L2_POLICY_EXCLUSIVE) {
+				allocate(tag, index, backing, now);
+			}
+		}
+#if defined(L2CACHE_DEBUG)
+		fprintf(stderr, "L2 Miss addr(0x%x) latency %d\n", addr, latency);
+#endif
+	}
+
+	inflights.push_back(InFlight{block_addr, now, now + latency,
+		!hit && mode != DATASTORE, mode, client});
+	saved_cycles += mem_latency - latency;
+	return latency;
+}
+
+void L2Cache::evict_notify(uint32 addr, Range *backing)
+{
+	uint32 tag, index, way;
+
+	// only the victim cache (exclusive) is filled by L1 evictions
+	if (policy != L2_POLICY_EXCLUSIVE) {
+		return;
+	}
+
+	addr_separete(addr, tag, index);
+	if (lookup(tag, index, way, machine->num_cycles)) {
+		blocks[way][index].last_access = machine->num_cycles;
+		blocks[way][index].moving_up = false;
+	} else {
+		allocate(tag, index, backing, machine->num_cycles);
+	}
+}
+
+void L2Cache::register_stats(StatsRegistry &stats, const std::string &prefix)
+{
+	stats.add_counter(prefix + ".hits", &hit_counts);
+	stats.add_counter(prefix + ".misses", &miss_counts);
+	stats.add_counter(prefix + ".merged_misses", &merge_counts);
+	stats.add_counter(prefix + ".writebacks", &wb_counts);
+	stats.add_counter(prefix + ".back_invalidations", &back_inv_counts);
+	stats.add_counter(prefix + ".accesses", StatsRegistry::widen<uint32>([this]() {
+		return hit_counts + miss_counts + merge_counts;
+	}));
+	stats.add_formula(prefix + ".miss_ratio", prefix + ".misses",
+		prefix + ".accesses");
+}
+
+void L2Cache::report_prof()
+{
+	uint32 cache_access = hit_counts + miss_counts + merge_counts;
+	fprintf(stderr, "\tAccess Count %d\n", cache_access);
+	fprintf(stderr, "\tCache Miss Ratio %.5f%%\n",
+		(double)miss_counts / (double)cache_access * 100.0);
+	fprintf(stderr, "\twrite back ratio %.5f%%\n",
+		(double)wb_counts / (double)miss_counts * 100.0);
+	fprintf(stderr, "\tMerged misses %d\n", merge_counts);
+	if (policy == L2_POLICY_INCLUSIVE) {
+		fprintf(stderr, "\tBack invalidations %d\n", back_inv_counts);
+	}
+	fprintf(stderr, "\tSaved memory cycles %lld\n", (long long)saved_cycles);
+}
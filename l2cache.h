@@ -0,0 +1,127 @@
+/*  Headers for the shared L2 cache
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _L2CACHE_H_
+#define _L2CACHE_H_
+
+#include "types.h"
+#include "range.h"
+#include <vector>
+#include <string>
+
+class StatsRegistry;
+
+#define L2_POLICY_NINE		0
+#define L2_POLICY_INCLUSIVE	1
+#define L2_POLICY_EXCLUSIVE	2
+
+class Cache;
+class DeviceExc;
+
+/* Shared second level cache located between the system bus (Mapper) and
+ * the external memories. Only tags are kept here: the data always lives in
+ * the backing MemoryModule, so the L2 is coherent with uncached accesses
+ * and DMA transfers by construction. The L2 just decides how many cycles
+ * each word request takes.
+ */
+class L2Cache {
+public:
+	L2Cache(unsigned int block_count_,
+			unsigned int block_size_,
+			unsigned int way_size_,
+			unsigned int bank_count_,
+			int hit_latency_,
+			int policy_);
+	~L2Cache();
+
+	/* Register a memory range cached by the L2 */
+	void add_range(Range *r) { ranges.push_back(r); }
+	bool covers(Range *r);
+
+	/* Register L1 caches for back invalidation (inclusive policy) */
+	void attach_upper(Cache *c) { uppers.push_back(c); }
+
+	/* Look up ADDR for a word request issued in the cycle NOW and
+	   return its latency (excluding the bus latency). FROM_L1 is
+	   false for the DMA transfers, which have no L1 to move the
+	   block to and do not write whole blocks. */
+	int access(uint32 addr, int32 mode, DeviceExc *client, Range *backing,
+		bool from_l1, uint32 now);
+
+	/* Notify that an L1 cache dropped the block including ADDR */
+	void evict_notify(uint32 addr, Range *backing);
+
+	void report_prof();
+	void register_stats(StatsRegistry &stats, const std::string &prefix);
+
+private:
+	// cache config
+	unsigned int block_count;
+	unsigned int block_size;
+	unsigned int way_size;
+	unsigned int bank_count;
+	int hit_latency;
+	int policy;
+
+	// bit format
+	unsigned int offset_len;
+	unsigned int index_len;
+
+	struct Entry {
+		bool valid;
+		bool dirty;
+		bool moving_up;		// exclusive: moved to L1 in this cycle
+		uint32 last_access;
+		uint32 tag;
+	};
+
+	Entry **blocks;
+	uint32 *bank_busy_until;
+
+	/* Block requests in flight (MSHR). The words of one L1 block
+	   transfer share a lookup, and other requests to a block under
+	   a miss are merged into it. */
+	struct InFlight {
+		uint32 block_addr;
+		uint32 issued;
+		uint32 ready;
+		bool miss;
+		int32 mode;
+		DeviceExc *client;
+	};
+	std::vector<InFlight> inflights;
+
+	std::vector<Range *> ranges;
+	std::vector<Cache *> uppers;
+
+	// cache profile
+	uint32 hit_counts;
+	uint32 miss_counts;
+	uint32 wb_counts;
+	uint32 merge_counts;
+	uint32 back_inv_counts;
+	int64 saved_cycles;
+
+	void addr_separete(uint32 addr, uint32 &tag, uint32 &index);
+	uint32 calc_addr(uint32 way, uint32 index);
+	bool lookup(uint32 tag, uint32 index, uint32 &way, uint32 now);
+	uint32 allocate(uint32 tag, uint32 index, Range *backing, uint32 now);
+};
+
+#endif /* _L2CACHE_H_ */
@@ -31,12 +31,14 @@
 #include "range.h"
 #include "vmips.h"
 #include "busarbiter.h"
+#include "l2cache.h"
+#include "memtrace.h"
 #include <cassert>
 #include <unordered_map>
 #include <functional>
 
 Mapper::Mapper () :
-	last_used_mapping (NULL)
+	l2cache (NULL), memtrace (NULL), last_used_mapping (NULL)
 {
 
 	opt_bigendian = machine->opt->option("bigendian")->flag;
@@ -63,8 +65,29 @@ void Mapper::release_bus(DeviceExc *client)
 	bus_arbiter->release_bus(client);
 }
 
+void Mapper::register_master(DeviceExc *client, const char *name,
+	uint32 weight)
+{
+	bus_arbiter->register_master(client, name, weight);
+}
 
-bool Mapper::ready(uint32 addr, int32 mode, DeviceExc *client)
+void Mapper::report_bus_prof()
+{
+	bus_arbiter->report_prof();
+}
+
+void Mapper::set_master_cap(DeviceExc *client, uint32 bytes)
+{
+	bus_arbiter->set_master_cap(client, bytes);
+}
+
+void Mapper::set_master_outstanding(DeviceExc *client, uint32 limit)
+{
+	bus_arbiter->set_master_outstanding(client, limit);
+}
+
+
+bool Mapper::request_done(uint32 addr, int32 mode, DeviceExc *client)
 {
 	struct RequestsKey key = {
 		addr,
@@ -76,9 +99,9 @@ bool Mapper::ready(uint32 addr, int32 mode, DeviceExc *client)
 		return true;
 	}
 
-	bool constainsKey = (access_requests_time.find(key) != access_requests_time.end());
+	auto it = access_ready_time.find(key);
 
-	if (!constainsKey) {
+	if (it == access_ready_time.end()) {
 		return false;
 	}
 
@@ -88,10 +111,7 @@ bool Mapper::ready(uint32 addr, int32 mode, DeviceExc *client)
 		bus_error (client, mode, addr);
 	}
 
-	int32 issue_time = access_requests_time[key];
-
-	bool isReady = ((machine->num_cycles - issue_time) >= 
-						(bus_latency + l->extra_latency()));
+	bool isReady = ((int32)(machine->num_cycles - it->second.ready) >= 0);
 
 	if (isReady) {
 		return l->ready(addr, mode, client);
@@ -101,7 +121,17 @@ bool Mapper::ready(uint32 addr, int32 mode, DeviceExc *client)
 
 }
 
-void Mapper::request_word(uint32 addr, int32 mode, DeviceExc *client)
+bool Mapper::ready(uint32 addr, int32 mode, DeviceExc *client)
+{
+	if (!request_done(addr, mode, client)) {
+		return false;
+	}
+	// the data can be moved only if the bus has bandwidth left in this cycle
+	return debug_mode || bus_arbiter->has_credit(client);
+}
+
+void Mapper::request_word(uint32 addr, int32 mode, DeviceExc *client, bool cached,
+	bool dma)
 {
 	struct RequestsKey key = {
 		addr,
@@ -109,13 +139,61 @@ void Mapper::request_word(uint32 addr, int32 mode, DeviceExc *client)
 		client
 	};
 
-	bool constainsKey = (access_requests_time.find(key) != access_requests_time.end());
+	bool constainsKey = (access_ready_time.find(key) != access_ready_time.end());
 
 	if (constainsKey) {
 		return;
 	}
 
-	access_requests_time.insert(std::make_pair(key, machine->num_cycles));
+	// latency is fixed when the request is issued
+	uint32 issue = bus_arbiter->issue_request(client, addr);
+	uint32 latency = bus_latency;
+	Range *l = find_mapping_range(addr);
+	if (l) {
+		if ((cached || dma) && l2cache && l2cache->covers(l)) {
+			latency += l2cache->access(addr, mode, client, l, cached, issue);
+		} else {
+			latency += l->access_latency(addr - l->getBase(), mode, issue);
+		}
+	}
+
+	uint32 ready = bus_arbiter->order_response(client, issue + latency);
+	access_ready_time.insert(std::make_pair(key, RequestInfo{ready, cached}));
+}
+
+void Mapper::complete_request(uint32 addr, int32 mode, DeviceExc *client,
+	uint32 bytes)
+{
+	RequestsKey key = {
+		addr,
+		mode,
+		client
+	};
+
+	auto it = access_ready_time.find(key);
+	if (it == access_ready_time.end()) {
+		return;
+	}
+	if (!debug_mode) {
+		if (memtrace != NULL) {
+			uint32 master = bus_arbiter->master_id(client);
+			memtrace->record(machine->num_cycles, master,
+				bus_arbiter->master_name(master), addr, bytes, mode,
+				it->second.cached);
+		}
+		bus_arbiter->consume_credit(client, bytes);
+	}
+	access_ready_time.erase(it);
+}
+
+void Mapper::evict_notify(uint32 addr)
+{
+	if (l2cache) {
+		Range *l = find_mapping_range(addr);
+		if (l && l2cache->covers(l)) {
+			l2cache->evict_notify(addr, l);
+		}
+	}
 }
 
 /* Add range R to the mapping. R must not overlap with any existing
@@ -275,18 +353,12 @@ Mapper::fetch_word(uint32 addr, int32 mode, DeviceExc *client)
 		return 0xffffffff;
 	}
 
-	if (!ready(addr, mode, client)) {
+	if (!request_done(addr, mode, client)) {
 		bus_error (client, mode, addr);
 		return 0xffffffff;
 	}
 
-	RequestsKey key = {
-		addr,
-		mode,
-		client
-	};
-
-	access_requests_time.erase(key);
+	complete_request(addr, mode, client, 4);
 	return host_to_mips_word(l->fetch_word(offset, mode, client));
 }
 
@@ -327,18 +399,12 @@ Mapper::fetch_halfword(uint32 addr, DeviceExc *client)
 		return 0xffff;
 	}
 
-	if (!ready(addr, DATALOAD, client)) {
+	if (!request_done(addr, DATALOAD, client)) {
 		bus_error (client, DATALOAD, addr);
 		return 0xffff;
 	}
 
-	RequestsKey key = {
-		addr,
-		DATALOAD,
-		client
-	};
-
-	access_requests_time.erase(key);
+	complete_request(addr, DATALOAD, client, 2);
 	return host_to_mips_halfword(l->fetch_halfword(offset, client));
 }
 
@@ -371,18 +437,12 @@ Mapper::fetch_byte(uint32 addr, DeviceExc *client)
 		return 0xff;
 	}
 
-	if (!ready(addr, DATALOAD, client)) {
+	if (!request_done(addr, DATALOAD, client)) {
 		bus_error (client, DATALOAD, addr);
 		return 0xff;
 	}
 
-	RequestsKey key = {
-		addr,
-		DATALOAD,
-		client
-	};
-
-	access_requests_time.erase(key);
+	complete_request(addr, DATALOAD, client, 1);
 	return l->fetch_byte(offset, client);
 }
 
@@ -416,18 +476,12 @@ Mapper::store_word(uint32 addr, uint32 data, DeviceExc *client)
 		return;
 	}
 
-	if (!ready(addr, DATASTORE, client)) {
+	if (!request_done(addr, DATASTORE, client)) {
 		bus_error (client, DATASTORE, addr);
 		return;
 	}
 
-	RequestsKey key = {
-		addr,
-		DATASTORE,
-		client
-	};
-
-	access_requests_time.erase(key);
+	complete_request(addr, DATASTORE, client, 4);
 	l->store_word(addr - l->getBase(), mips_to_host_word(data), client);
 }
 
@@ -460,18 +514,12 @@ Mapper::store_halfword(uint32 addr, uint16 data, DeviceExc *client)
 		return;
 	}
 
-	if (!ready(addr, DATASTORE, client)) {
+	if (!request_done(addr, DATASTORE, client)) {
 		bus_error (client, DATASTORE, addr);
 		return;
 	}
 
-	RequestsKey key = {
-		addr,
-		DATASTORE,
-		client
-	};
-
-	access_requests_time.erase(key);
+	complete_request(addr, DATASTORE, client, 2);
 	l->store_halfword(addr - l->getBase(), mips_to_host_halfword(data), client);
 }
 
@@ -501,18 +549,12 @@ Mapper::store_byte(uint32 addr, uint8 data, DeviceExc *client)
 		return;
 	}
 
-	if (!ready(addr, DATASTORE, client)) {
+	if (!request_done(addr, DATASTORE, client)) {
 		bus_error (client, DATASTORE, addr);
 		return;
 	}
 
-	RequestsKey key = {
-		addr,
-		DATASTORE,
-		client
-	};
-
-	access_requests_time.erase(key);
+	complete_request(addr, DATASTORE, client, 1);
 	l->store_byte(addr - l->getBase(), data, client);
 
 }
@@ -30,6 +30,8 @@
 #include <unordered_map>
 
 class DeviceExc;
+class L2Cache;
+class MemTrace;
 
 class Mapper {
 public:
@@ -63,8 +65,20 @@ public:
 private:
 	uint32 bus_latency;
 
-	std::unordered_map<RequestsKey, uint32, RequestsHash, RequestsKeyEqual> access_requests_time;
+	struct RequestInfo {
+		uint32 ready;	// cycle when the access becomes ready
+		bool cached;
+	};
+
+	/* Requested accesses in flight */
+	std::unordered_map<RequestsKey, RequestInfo, RequestsHash, RequestsKeyEqual> access_ready_time;
 	BusArbiter *bus_arbiter;
+	L2Cache *l2cache;
+	MemTrace *memtrace;
+
+	/* Retire the request and move BYTES on the bus */
+	void complete_request(uint32 addr, int32 mode, DeviceExc *client,
+		uint32 bytes);
 	/* We keep lists of ranges in a vector of pointers to range
 	   objects. */
 	typedef std::vector<Range *> Ranges;
@@ -90,6 +104,9 @@ private:
 
 	bool debug_mode = false;
 
+	/* check if the latency of the request has passed */
+	bool request_done(uint32 addr, int32 mode, DeviceExc *client);
+
 public:
 	Mapper();
 	~Mapper();
@@ -130,12 +147,38 @@ public:
 	bool acquire_bus(DeviceExc *client);
 	void release_bus(DeviceExc *client);
 
+	/* Register CLIENT as a bus master with NAME and arbitration WEIGHT */
+	void register_master(DeviceExc *client, const char *name, uint32 weight);
+	void report_bus_prof();
+	void register_bus_stats(StatsRegistry &stats, const std::string &prefix) {
+		bus_arbiter->register_stats(stats, prefix);
+	}
+
+	/* Limit the bytes per cycle CLIENT can move on the bus (0: no cap) */
+	void set_master_cap(DeviceExc *client, uint32 bytes);
+	/* Limit the transactions CLIENT can have in flight on the split
+	   transaction bus (0: bus_outstanding) */
+	void set_master_outstanding(DeviceExc *client, uint32 limit);
+
 	/* check if mem access is available */
+	/* (the latency has passed and the bus has bandwidth left in this cycle) */
 	bool ready(uint32 addr, int32 mode, DeviceExc *client);
 	/* request for memory access */
 	/* If the request is first time, regist it to entry*/
 	/* Otherwise, it is ignored */
-	void request_word(uint32 addr, int32 mode, DeviceExc *client);
+	/* CACHED is true for block transfers of the L1 caches and */
+	/* DMA for transfers of the DMA engines, both of which are */
+	/* looked up in the L2 cache (if any) */
+	void request_word(uint32 addr, int32 mode, DeviceExc *client, bool cached = false,
+		bool dma = false);
+
+	/* Shared L2 cache placed below the bus */
+	void attach_l2cache(L2Cache *l2) { l2cache = l2; }
+	/* An L1 cache replaces the block including ADDR */
+	void evict_notify(uint32 addr);
+
+	/* Record the completed transactions to the memory trace */
+	void attach_memtrace(MemTrace *t) { memtrace = t; }
 
 
 	/* Returns the Range object which would be used for a fetch or store to
@@ -27,15 +27,17 @@
 #include "memorymodule.h"
 #include "fileutils.h"
 #include "mmapglue.h"
+#include "dram.h"
 #include <cstring>
 
 class MemoryModule : public Range {
 private:
     int latency;
+    DRAMModel *dram;
 public:
     uint32 *myaddr;
     MemoryModule(size_t size, int latency_, FILE *init_data = NULL) 
-    : Range (0, size, 0, MEM_READ_WRITE), latency(latency_) {
+    : Range (0, size, 0, MEM_READ_WRITE), latency(latency_), dram(NULL) {
         myaddr = new uint32[size / 4]();
         if (init_data != NULL) {
             if (get_file_size(init_data) > size) {
@@ -53,6 +55,14 @@ public:
         delete [] myaddr;
     }
     virtual int extra_latency() { return latency; };
+    virtual int access_latency(uint32 offset, int32 mode, uint32 now) {
+        if (dram != NULL) {
+            return dram->access(base + offset, mode, now);
+        }
+        return latency;
+    };
+    /* Use the DRAM timing model instead of the fixed latency */
+    void attach_dram(DRAMModel *d) { dram = d; }
 };
 
 #endif /* _MEMORYMODULE_H_ */
@@ -0,0 +1,101 @@
+/*  Memory reference trace of the system bus
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "memtrace.h"
+#include <cstdio>
+#include <cstring>
+
+MemTrace::MemTrace(const char *filename, int codec) :
+	last_cycle(0), last_addr(0), record_counts(0)
+{
+	file = new TraceFile(filename, MEMTRACE_MAGIC, MEMTRACE_VERSION, codec);
+	writer = file->is_open() ? new TraceWriter(file) : NULL;
+}
+
+MemTrace::~MemTrace()
+{
+	close();
+	delete writer;
+	delete file;
+}
+
+uint8 *MemTrace::put_master(uint8 *p, uint8 flags, uint32 master)
+{
+	if (master < 7) {
+		*p++ = flags | (master << 5);
+	} else {
+		*p++ = flags | (7 << 5);
+		p = put_varint(p, master);
+	}
+	return p;
+}
+
+void MemTrace::record(uint32 cycle, uint32 master, const std::string &name,
+	uint32 addr, uint32 size, int32 mode, bool cached)
+{
+	bool new_chunk;
+	uint8 *p = writer->reserve(32 + name.size(), new_chunk);
+	uint8 *start = p;
+
+	if (new_chunk) {
+		last_cycle = 0;
+		last_addr = 0;
+		named.assign(named.size(), false);
+	}
+
+	// name the master once in every chunk
+	if (master >= named.size()) {
+		named.resize(master + 1, false);
+	}
+	if (!named[master]) {
+		p = put_master(p, 0x3, master);
+		p = put_varint(p, name.size());
+		memcpy(p, name.data(), name.size());
+		p += name.size();
+		named[master] = true;
+	}
+
+	uint8 size_code = size == 4 ? 2 : size == 2 ? 1 : 0;
+	uint8 flags = (mode & 0x3) | (cached ? 0x4 : 0) | (size_code << 3);
+	p = put_master(p, flags, master);
+	p = put_varint(p, cycle - last_cycle);
+	p = put_varint(p, zigzag((int32)(addr - last_addr)));
+	writer->commit(p - start);
+
+	last_cycle = cycle;
+	last_addr = addr;
+	record_counts++;
+}
+
+void MemTrace::close()
+{
+	if (writer != NULL) {
+		writer->close();
+	}
+}
+
+void MemTrace::report()
+{
+	fprintf(stderr, "Memory trace: %llu records, %llu bytes of data (%llu "
+		"bytes before compression), %llu bytes of headers\n",
+		(unsigned long long)record_counts,
+		(unsigned long long)file->stored_bytes(),
+		(unsigned long long)file->raw_bytes(),
+		(unsigned long long)file->header_bytes());
+}
@@ -0,0 +1,67 @@
+/*  Headers for the memory reference trace
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _MEMTRACE_H_
+#define _MEMTRACE_H_
+
+#include "types.h"
+#include "tracefile.h"
+#include <string>
+#include <vector>
+
+#define MEMTRACE_MAGIC		"CSMT"
+#define MEMTRACE_VERSION	2
+
+/* Binary trace of the transactions completed on the system bus.
+ * Each record is encoded as
+ *   flags:  bit 1-0 mode (INSTFETCH, DATALOAD, DATASTORE)
+ *           bit 2   cached (block transfer of a cache)
+ *           bit 4-3 log2 of the size in bytes
+ *           bit 7-5 master id (7: the id follows as a varint)
+ *   [varint master id]
+ *   varint  cycle delta from the previous record
+ *   varint  zigzag encoded address delta from the previous record
+ * The deltas are reset to zero at the beginning of every chunk.
+ * Mode 3 marks a record which names a master instead (version 2):
+ *   flags, [varint master id], varint length, name[length]
+ * It precedes the first record of the master in every chunk.
+ */
+class MemTrace {
+public:
+	MemTrace(const char *filename, int codec);
+	~MemTrace();
+
+	bool is_open() const { return file->is_open(); }
+	void record(uint32 cycle, uint32 master, const std::string &name,
+		uint32 addr, uint32 size, int32 mode, bool cached);
+	void close();
+	void report();
+
+private:
+	TraceFile *file;
+	TraceWriter *writer;
+	uint32 last_cycle;
+	uint32 last_addr;
+	uint64 record_counts;
+	std::vector<bool> named;	// masters named in this chunk
+
+	uint8 *put_master(uint8 *p, uint8 flags, uint32 master);
+};
+
+#endif /* _MEMTRACE_H_ */
@@ -0,0 +1,191 @@
+/*  Per-PC and per-region cache miss profiler with 3C classification
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "missprof.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+MissProfiler::MissProfiler(unsigned int block_size_, unsigned int capacity_,
+	unsigned int region_size_, unsigned int top_n_) :
+	capacity(capacity_),
+	region_size(region_size_),
+	top_n(top_n_),
+	ref_time(0),
+	total{{0, 0, 0}}
+{
+	offset_len = int(std::log2(block_size_));
+	ref_tree.assign(MISSPROF_TIME_WINDOW + 1, 0);
+	// cold + log2 buckets up to MISSPROF_MAX_DISTANCE + beyond
+	reuse_hist.assign(int(std::log2(MISSPROF_MAX_DISTANCE)) + 3, 0);
+}
+
+void MissProfiler::mark_time(uint32 time, int delta)
+{
+	for (uint32 i = time + 1; i < ref_tree.size(); i += i & -i) {
+		ref_tree[i] += delta;
+	}
+}
+
+uint32 MissProfiler::count_marks(uint32 time)
+{
+	uint32 count = 0;
+	for (uint32 i = time + 1; i > 0; i -= i & -i) {
+		count += ref_tree[i];
+	}
+	return count;
+}
+
+// the times run out: number the blocks in the stack from 0 again,
+// dropping those deeper than MISSPROF_MAX_DISTANCE
+void MissProfiler::renumber()
+{
+	std::vector<std::pair<uint32, uint32> > stack;
+	stack.reserve(last_ref.size());
+	for (auto &ref : last_ref) {
+		stack.push_back(std::make_pair(ref.second, ref.first));
+	}
+	std::sort(stack.begin(), stack.end());
+	size_t first = stack.size() > MISSPROF_MAX_DISTANCE ?
+		stack.size() - MISSPROF_MAX_DISTANCE : 0;
+
+	last_ref.clear();
+	std::fill(ref_tree.begin(), ref_tree.end(), 0);
+	ref_time = 0;
+	for (size_t i = first; i < stack.size(); i++) {
+		last_ref[stack[i].second] = ref_time;
+		mark_time(ref_time, 1);
+		ref_time++;
+	}
+}
+
+int MissProfiler::stack_distance(uint32 block)
+{
+	auto ref = last_ref.find(block);
+	if (ref == last_ref.end()) {
+		return -1;
+	}
+	// the blocks referenced after the last reference to BLOCK
+	uint32 distance = last_ref.size() - count_marks(ref->second);
+	if (distance >= MISSPROF_MAX_DISTANCE) {
+		// dropped from the shadow stack
+		return -1;
+	}
+	return distance;
+}
+
+void MissProfiler::access(uint32 addr)
+{
+	uint32 block = addr >> offset_len;
+	int distance = stack_distance(block);
+
+	if (distance < 0) {
+		if (seen_blocks.insert(block).second) {
+			reuse_hist[0]++;
+		} else {
+			// dropped from the shadow stack
+			reuse_hist.back()++;
+		}
+	} else {
+		int bucket = 1;
+		while ((1 << (bucket - 1)) <= distance) {
+			bucket++;
+		}
+		reuse_hist[bucket]++;
+	}
+
+	auto ref = last_ref.find(block);
+	if (ref != last_ref.end()) {
+		mark_time(ref->second, -1);
+		last_ref.erase(ref);
+	}
+	if (ref_time == MISSPROF_TIME_WINDOW) {
+		renumber();
+	}
+	last_ref[block] = ref_time;
+	mark_time(ref_time, 1);
+	ref_time++;
+}
+
+void MissProfiler::miss(uint32 addr, uint32 pc)
+{
+	uint32 block = addr >> offset_len;
+	int kind;
+
+	if (seen_blocks.find(block) == seen_blocks.end()) {
+		kind = COMPULSORY;
+	} else {
+		int distance = stack_distance(block);
+		if (distance < 0 || (unsigned int)distance >= capacity) {
+			kind = CAPACITY;
+		} else {
+			kind = CONFLICT;
+		}
+	}
+
+	total.count[kind]++;
+	pc_misses[pc].count[kind]++;
+	region_misses[addr & ~(region_size - 1)].count[kind]++;
+}
+
+void MissProfiler::report_top(const std::unordered_map<uint32, MissCount> &misses,
+	const char *label)
+{
+	std::vector<std::pair<uint32, MissCount> > sorted(misses.begin(), misses.end());
+	std::sort(sorted.begin(), sorted.end(),
+		[](const std::pair<uint32, MissCount> &a, const std::pair<uint32, MissCount> &b) {
+			return a.second.total() > b.second.total();
+		});
+
+	fprintf(stderr, "\t%10s %10s %10s %10s %10s\n",
+		label, "misses", "compulsory", "capacity", "conflict");
+	for (unsigned int i = 0; i < sorted.size() && i < top_n; i++) {
+		const MissCount &c = sorted[i].second;
+		fprintf(stderr, "\t0x%08x %10llu %10llu %10llu %10llu\n",
+			sorted[i].first, (unsigned long long)c.total(),
+			(unsigned long long)c.count[COMPULSORY],
+			(unsigned long long)c.count[CAPACITY],
+			(unsigned long long)c.count[CONFLICT]);
+	}
+}
+
+void MissProfiler::report_prof()
+{
+	fprintf(stderr, "\tMiss Count %llu (compulsory %llu, capacity %llu, conflict %llu)\n",
+		(unsigned long long)total.total(),
+		(unsigned long long)total.count[COMPULSORY],
+		(unsigned long long)total.count[CAPACITY],
+		(unsigned long long)total.count[CONFLICT]);
+
+	fprintf(stderr, "\tTop %u miss PCs\n", top_n);
+	report_top(pc_misses, "pc");
+	fprintf(stderr, "\tTop %u miss regions (%u bytes)\n", top_n, region_size);
+	report_top(region_misses, "region");
+
+	fprintf(stderr, "\tReuse distance histogram (blocks)\n");
+	fprintf(stderr, "\t%16s %12llu\n", "cold", (unsigned long long)reuse_hist[0]);
+	for (unsigned int i = 1; i < reuse_hist.size() - 1; i++) {
+		unsigned int low = i == 1 ? 0 : (1 << (i - 2)) ;
+		unsigned int high = (1 << (i - 1)) - 1;
+		fprintf(stderr, "\t%7u - %6u %12llu\n", low, high,
+			(unsigned long long)reuse_hist[i]);
+	}
+	fprintf(stderr, "\t%8s%6u %12llu\n", ">= ", MISSPROF_MAX_DISTANCE,
+		(unsigned long long)reuse_hist.back());
+}
@@ -0,0 +1,94 @@
+/*  Headers for the per-PC cache miss profiler
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _MISSPROF_H_
+#define _MISSPROF_H_
+
+#include "types.h"
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+/* Longest reuse distance (in blocks) tracked by the shadow LRU stack */
+#define MISSPROF_MAX_DISTANCE	16384
+/* References numbered before the shadow stack is renumbered */
+#define MISSPROF_TIME_WINDOW	(4 * MISSPROF_MAX_DISTANCE)
+
+/* Attributes the misses of a cache to the PCs and address regions which
+ * caused them. Each miss is classified with the 3C model using a shadow
+ * fully associative LRU cache of the same capacity:
+ *   compulsory: the block has never been referenced
+ *   capacity:   the block misses in the fully associative cache too
+ *   conflict:   otherwise
+ * Reuse distances (number of distinct blocks referenced between two
+ * references to the same block) are collected as a log2 histogram.
+ *
+ * The shadow stack is kept as in Bennett and Kruskal: each block
+ * remembers the time of its last reference, and a Fenwick tree over the
+ * times marks those which are the last reference of a block. The
+ * distance of a block is the number of marks after its time, which
+ * takes O(log n) instead of a walk down the stack.
+ */
+class MissProfiler {
+public:
+	MissProfiler(unsigned int block_size_, unsigned int capacity_,
+				 unsigned int region_size_, unsigned int top_n_);
+
+	/* record a completed reference to ADDR */
+	void access(uint32 addr);
+	/* record a miss of ADDR caused by the instruction at PC */
+	void miss(uint32 addr, uint32 pc);
+
+	void report_prof();
+
+private:
+	enum { COMPULSORY, CAPACITY, CONFLICT, MISS_KINDS };
+
+	struct MissCount {
+		uint64 count[MISS_KINDS];
+		uint64 total() const {
+			return count[COMPULSORY] + count[CAPACITY] + count[CONFLICT];
+		}
+	};
+
+	unsigned int offset_len;
+	unsigned int capacity;		// number of blocks
+	unsigned int region_size;
+	unsigned int top_n;
+
+	// shadow fully associative LRU stack
+	std::unordered_map<uint32, uint32> last_ref;	// block -> time
+	std::vector<uint32> ref_tree;	// Fenwick tree of the times (1-origin)
+	uint32 ref_time;		// time of the next reference
+	std::unordered_set<uint32> seen_blocks;
+
+	MissCount total;
+	std::unordered_map<uint32, MissCount> pc_misses;
+	std::unordered_map<uint32, MissCount> region_misses;
+	std::vector<uint64> reuse_hist;	// [0] = cold, [i] = distance in [2^(i-1), 2^i)
+
+	int stack_distance(uint32 block);
+	void mark_time(uint32 time, int delta);
+	uint32 count_marks(uint32 time);	// marks at TIME or before
+	void renumber();
+	void report_top(const std::unordered_map<uint32, MissCount> &misses,
+					const char *label);
+};
+
+#endif /* _MISSPROF_H_ */
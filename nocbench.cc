@@ -0,0 +1,400 @@
+/*  Traffic generator benchmark of the Cube network
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "nocbench.h"
+#include "noctlm.h"
+#include "topology.h"
+#include "options.h"
+#include "error.h"
+#include "vmips.h"
+#include <cstring>
+#include <sys/time.h>
+
+static const char *traffic_names[] = {
+	"uniform", "hotspot", "bitcomp", "bursty", "dma"
+};
+
+NocBench::NocBench(const NocTopology *topo_) : topo(topo_), tlm(NULL),
+	csv(NULL), now(0)
+{
+}
+
+NocBench::~NocBench()
+{
+	for (size_t i = 0; i < nodes.size(); i++) {
+		delete nodes[i]->router;
+		delete nodes[i];
+	}
+	delete tlm;
+	if (csv != NULL) {
+		fclose(csv);
+	}
+}
+
+bool NocBench::setup()
+{
+	Options *opt = machine->opt;
+	int node_count = topo->node_count();
+	//the local module may send a packet when its VC has room for one
+	int max_flits = (opt->option("dcachebsize")->num / 4) + 1;
+
+	pattern_name = opt->option("noc_traffic")->str;
+	pattern = -1;
+	for (int i = 0; i <= TRAFFIC_DMA; i++) {
+		if (pattern_name == traffic_names[i]) {
+			pattern = i;
+		}
+	}
+	if (pattern < 0) {
+		error("unknown noc_traffic: %s", pattern_name.c_str());
+		return false;
+	}
+
+	rates = opt->get_list(opt->option("noc_rates")->str);
+	for (size_t i = 0; i < rates.size(); i++) {
+		if (rates[i] < 1 || rates[i] > 100) {
+			error("noc_rates must be 1 to 100 (percent of a flit/cycle)");
+			return false;
+		}
+	}
+
+	packet_flits = pattern == TRAFFIC_DMA ? max_flits :
+					opt->option("noc_packet_flits")->num;
+	if (packet_flits < 2 || packet_flits > max_flits) {
+		error("noc_packet_flits must be 2 to %d", max_flits);
+		return false;
+	}
+
+	hotspot = opt->option("noc_hotspot")->num;
+	if (node_count < 2 || hotspot >= node_count) {
+		error("noc_bench needs 2 nodes or more and noc_hotspot below %d",
+			node_count);
+		return false;
+	}
+
+	warmup_cycles = opt->option("noc_bench_warmup")->num;
+	measure_cycles = opt->option("noc_bench_cycles")->num;
+	if (measure_cycles == 0) {
+		error("noc_bench_cycles must not be 0");
+		return false;
+	}
+	seed = opt->option("noc_seed")->num;
+
+	const char *csv_name = opt->option("noc_bench_csv")->str;
+	if (strcmp(csv_name, "none") != 0) {
+		csv = fopen(csv_name, "w");
+		if (csv == NULL) {
+			error("cannot open %s", csv_name);
+			return false;
+		}
+		fprintf(csv, "traffic,offered,accepted,avg_latency,max_latency,"
+			"packets,drained\n");
+	}
+
+	//the upper half of the VCs is for the wrap-around links of a torus
+	vch_count = topo->get_shape() == TOPO_TORUS ? VCH_SIZE / 2 : VCH_SIZE;
+
+	std::vector<Router *> routers;
+	for (int i = 0; i < node_count; i++) {
+		Node *node = new Node;
+		node->router = new Router(&node->tx, &node->rx, i);
+		nodes.push_back(node);
+		routers.push_back(node->router);
+	}
+	topo->connect(routers);
+	if (strcmp(opt->option("noc_model")->str, "tlm") == 0) {
+		//the generators step the routers once a cycle
+		tlm = new NocTlm(topo, opt->option("noc_tlm_hop_latency")->num, 1);
+		tlm->attach(routers);
+	}
+
+	return true;
+}
+
+uint64 NocBench::next_random()
+{
+	seed ^= seed >> 12;
+	seed ^= seed << 25;
+	seed ^= seed >> 27;
+	return seed * 0x2545F4914F6CDD1DULL;
+}
+
+uint32 NocBench::pick_dst(uint32 src)
+{
+	uint32 count = nodes.size();
+
+	if (pattern == TRAFFIC_BITCOMP) {
+		return count - 1 - src;
+	}
+	if (pattern == TRAFFIC_HOTSPOT && src != (uint32)hotspot &&
+		random_real() < 0.25) {
+		return hotspot;
+	}
+	//any node but the source
+	uint32 dst = next_random() % (count - 1);
+	return dst >= src ? dst + 1 : dst;
+}
+
+void NocBench::generate(uint32 src, double rate)
+{
+	Node *node = nodes[src];
+	double p = rate / packet_flits;
+
+	if (pattern == TRAFFIC_BURSTY) {
+		//on: back-to-back packets, off: silent, RATE of the time on
+		double p_off = 1.0 / (BURST_PACKETS * packet_flits);
+		double p_on = rate >= 1.0 ? 1.0 : p_off * rate / (1.0 - rate);
+		if (random_real() < (node->burst_on ? p_off : p_on)) {
+			node->burst_on = !node->burst_on;
+		}
+		p = node->burst_on ? 1.0 / packet_flits : 0.0;
+	}
+	if (random_real() >= p) {
+		return;
+	}
+
+	uint32 dst = pick_dst(src);
+	if (dst == src) {
+		//the middle node of bit complement traffic
+		return;
+	}
+	Packet packet = {dst, packet_flits, now};
+	node->queue.push_back(packet);
+	if (now >= window_begin && now < window_end) {
+		outstanding++;
+	}
+}
+
+void NocBench::inject(uint32 src)
+{
+	Node *node = nodes[src];
+	FLIT_t flit;
+
+	if (node->queue.empty()) {
+		return;
+	}
+	Packet &packet = node->queue.front();
+
+	if (node->sent_flits == 0) {
+		//head: take the first VC with room for a packet
+		int i;
+		for (i = 0; i < vch_count; i++) {
+			uint32 vch = (node->next_vch + i) % vch_count;
+			if (node->tx.slaveReady(vch)) {
+				node->vch = vch;
+				break;
+			}
+		}
+		if (i == vch_count) {
+			return;
+		}
+		node->next_vch = (node->vch + 1) % vch_count;
+		RouterUtils::make_head_flit(&flit, 0, MTYPE_BW, node->vch, src,
+									packet.dst);
+	} else {
+		RouterUtils::make_data_flit(&flit, packet.created,
+									node->sent_flits == packet.flits - 1);
+	}
+	node->tx.send(&flit, node->vch);
+
+	if (++node->sent_flits == packet.flits) {
+		node->queue.pop_front();
+		node->sent_flits = 0;
+	}
+}
+
+void NocBench::receive(uint32 dst)
+{
+	Node *node = nodes[dst];
+	FLIT_t flit;
+
+	while (node->rx.haveData()) {
+		node->rx.getData(&flit);
+		if (now >= window_begin && now < window_end) {
+			window_flits++;
+		}
+		if (flit.ftype == FTYPE_HEAD && RouterUtils::extractDst(&flit) != dst) {
+			misrouted++;
+		}
+		if (flit.ftype != FTYPE_TAIL) {
+			continue;
+		}
+		uint64 created = flit.data;
+		if (created >= window_begin && created < window_end) {
+			uint64 latency = now - created;
+			latency_sum += latency;
+			if (latency > latency_max) {
+				latency_max = latency;
+			}
+			delivered++;
+			outstanding--;
+		}
+	}
+}
+
+void NocBench::reset()
+{
+	for (size_t i = 0; i < nodes.size(); i++) {
+		Node *node = nodes[i];
+		node->router->reset();
+		node->rx.clearBuf();
+		node->queue.clear();
+		node->sent_flits = 0;
+		node->vch = node->next_vch = 0;
+		node->burst_on = false;
+	}
+	if (tlm != NULL) {
+		tlm->reset();
+	}
+	outstanding = window_flits = delivered = 0;
+	latency_sum = latency_max = misrouted = 0;
+}
+
+void NocBench::step(double rate)
+{
+	for (size_t i = 0; i < nodes.size(); i++) {
+		generate(i, rate);
+		inject(i);
+	}
+	for (size_t i = 0; i < nodes.size(); i++) {
+		nodes[i]->router->step();
+	}
+	if (tlm != NULL) {
+		tlm->step();
+	}
+	for (size_t i = 0; i < nodes.size(); i++) {
+		receive(i);
+	}
+
+	//the routers see the cycles of the machine
+	if (++machine->num_cycles == 0) {
+		machine->num_cycles_high++;
+	}
+	now++;
+}
+
+NocBenchPoint NocBench::measure(int percent)
+{
+	double rate = percent / 100.0;
+	NocBenchPoint point;
+
+	reset();
+	window_begin = now + warmup_cycles;
+	window_end = window_begin + measure_cycles;
+	while (now < window_end) {
+		step(rate);
+	}
+	//keep the load while the measured packets drain, up to one more window
+	uint64 drain_end = window_end + measure_cycles;
+	while (outstanding > 0 && now < drain_end) {
+		step(rate);
+	}
+
+	point.offered = rate;
+	point.accepted = (double)window_flits / nodes.size() / measure_cycles;
+	point.avg_latency = delivered > 0 ? (double)latency_sum / delivered : 0.0;
+	point.max_latency = latency_max;
+	point.packets = delivered;
+	point.drained = outstanding == 0;
+	point.misrouted = misrouted;
+	return point;
+}
+
+static double wall_sec()
+{
+	timeval tv;
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+}
+
+void NocBench::attach_flittrace(FlitTrace *trace)
+{
+	for (size_t i = 0; i < nodes.size(); i++) {
+		nodes[i]->router->attach_flittrace(trace);
+	}
+}
+
+void NocBench::run()
+{
+	std::vector<NocBenchPoint> points;
+	double start = wall_sec();
+
+	for (size_t i = 0; i < rates.size(); i++) {
+		points.push_back(measure(rates[i]));
+		const NocBenchPoint &p = points.back();
+		if (csv != NULL) {
+			fprintf(csv, "%s,%.3f,%.4f,%.3f,%llu,%llu,%d\n",
+				pattern_name.c_str(), p.offered, p.accepted, p.avg_latency,
+				(unsigned long long)p.max_latency,
+				(unsigned long long)p.packets, p.drained ? 1 : 0);
+		}
+	}
+	report(points, wall_sec() - start);
+}
+
+void NocBench::report(const std::vector<NocBenchPoint> &points, double elapsed)
+{
+	fprintf(stderr, "NoC benchmark: %s traffic, %d nodes in a %s, %s routing\n",
+		pattern_name.c_str(), topo->node_count(), topo->shape_name(),
+		topo->routing_name());
+	fprintf(stderr, "\t%d flits/packet, vcbufsize %u, %u warmup and %u "
+		"measured cycles per rate\n", packet_flits, machine->vcbufsize,
+		warmup_cycles, measure_cycles);
+	if (tlm != NULL) {
+		fprintf(stderr, "\ttransaction-level model, %d cycles/hop\n",
+			(int)machine->opt->option("noc_tlm_hop_latency")->num);
+	}
+	fprintf(stderr, "\t offered  accepted   avg latency  max latency   packets\n");
+
+	//saturated: the measured packets are not drained in time, or the
+	//latency is three times that of the lowest rate
+	int saturated = -1;
+	uint64 misrouted_total = 0;
+	for (size_t i = 0; i < points.size(); i++) {
+		const NocBenchPoint &p = points[i];
+		fprintf(stderr, "\t%8.3f  %8.3f  %12.2f  %11llu  %8llu%s\n",
+			p.offered, p.accepted, p.avg_latency,
+			(unsigned long long)p.max_latency, (unsigned long long)p.packets,
+			p.drained ? "" : " (not drained)");
+		if (saturated < 0 && (!p.drained ||
+			p.avg_latency > 3.0 * points[0].avg_latency)) {
+			saturated = i;
+		}
+		misrouted_total += p.misrouted;
+	}
+
+	if (saturated > 0) {
+		fprintf(stderr, "\tSaturation between %.3f and %.3f flits/node/cycle\n",
+			points[saturated - 1].offered, points[saturated].offered);
+	} else if (saturated == 0) {
+		fprintf(stderr, "\tSaturated at the lowest rate\n");
+	} else if (!points.empty()) {
+		fprintf(stderr, "\tNot saturated up to %.3f flits/node/cycle\n",
+			points.back().offered);
+	}
+	if (misrouted_total > 0) {
+		fprintf(stderr, "\t%llu head flits were delivered to a wrong node\n",
+			(unsigned long long)misrouted_total);
+	}
+
+	if (machine->opt->option("instcounts")->flag) {
+		fprintf(stderr, "%llu cycles in %.5f seconds (%.3f cycles per second)\n",
+			(unsigned long long)now, elapsed, now / elapsed);
+	}
+}
@@ -0,0 +1,130 @@
+/*  Headers for the traffic generator benchmark of the Cube network
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _NOCBENCH_H_
+#define _NOCBENCH_H_
+
+#include "types.h"
+#include "router.h"
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+
+class NocTopology;
+class NocTlm;
+class FlitTrace;
+
+//Traffic patterns
+#define TRAFFIC_UNIFORM		0 //random destination
+#define TRAFFIC_HOTSPOT		1 //a quarter of the packets go to one node
+#define TRAFFIC_BITCOMP		2 //node N sends to node (count - 1 - N)
+#define TRAFFIC_BURSTY		3 //uniform, on/off sources
+#define TRAFFIC_DMA			4 //uniform, packets of the maximum size
+
+#define BURST_PACKETS		8 //average packets in a burst
+
+/* Result of one injection rate */
+struct NocBenchPoint {
+	double offered;		//flits/node/cycle
+	double accepted;
+	double avg_latency;	//cycles from the creation to the tail flit
+	uint64 max_latency;
+	uint64 packets;		//measured packets delivered
+	bool drained;		//all the measured packets were delivered
+	uint64 misrouted;
+};
+
+/* Drives the routers of the Cube network with synthetic traffic instead
+ * of the CPU and the accelerators (system_mode=noc_bench). Every node
+ * gets a traffic generator on the local port of its router.
+ *
+ * For each injection rate the network is reset, run for the warmup
+ * cycles and then for the measurement cycles; the packets created in
+ * the measurement window are tracked until they are delivered. The
+ * latency includes the time in the source queue. The data flits carry
+ * the creation cycle so that the sink needs no per-packet state. With
+ * noc_model=tlm the transaction-level model carries the packets, which
+ * gives its latency to compare with that of the routers.
+ */
+class NocBench {
+public:
+	NocBench(const NocTopology *topo_);
+	~NocBench();
+
+	//return false if an option is invalid
+	bool setup();
+	void run();
+	void attach_flittrace(FlitTrace *trace);
+
+private:
+	struct Packet {
+		uint32 dst;
+		int flits;
+		uint64 created;
+	};
+
+	struct Node {
+		Router *router;
+		RouterPortMaster tx;
+		RouterPortSlave rx;
+		std::deque<Packet> queue;
+		int sent_flits; //of the packet at the head of the queue
+		uint32 vch;
+		uint32 next_vch;
+		bool burst_on;
+	};
+
+	const NocTopology *topo;
+	std::vector<Node *> nodes;
+	NocTlm *tlm; //NULL for the flit-level routers
+
+	int pattern;
+	std::string pattern_name;
+	std::vector<int> rates; //percent
+	int packet_flits;
+	int hotspot;
+	uint32 warmup_cycles, measure_cycles;
+	int vch_count; //VCs used by the generators
+	uint64 seed;
+	FILE *csv;
+
+	//measurement window
+	uint64 now;
+	uint64 window_begin, window_end;
+	uint64 outstanding; //measured packets not delivered yet
+	uint64 window_flits, delivered;
+	uint64 latency_sum, latency_max;
+	uint64 misrouted; //flits delivered to a wrong node
+
+	//xorshift64*, to give the same traffic on every host
+	uint64 next_random();
+	double random_real() { return (next_random() >> 11) * (1.0 / 9007199254740992.0); }
+
+	uint32 pick_dst(uint32 src);
+	void generate(uint32 src, double rate);
+	void inject(uint32 src);
+	void receive(uint32 dst);
+	void reset();
+	void step(double rate);
+	NocBenchPoint measure(int percent);
+	void report(const std::vector<NocBenchPoint> &points, double elapsed);
+};
+
+#endif /* _NOCBENCH_H_ */
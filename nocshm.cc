@@ -0,0 +1,367 @@
+/*  Distributed simulation of the Cube network
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "nocshm.h"
+#include "topology.h"
+#include "error.h"
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//busy waits before yielding the host CPU
+#define NOCSHM_SPINS	1000
+//yields between the checks of the process of the neighbor
+#define NOCSHM_CHECK_MASK	0xFFFF
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+	"the processes share the atomics without locks");
+
+/*******************************  NocShmLink  *******************************/
+NocShmLink::NocShmLink(int flow_, NocShmRing *tx_, NocShmRing *rx_, int peer_id_,
+	NocShmNode *peer_)
+	: flow(flow_), tx(tx_), rx(rx_), peer_id(peer_id_), peer(peer_),
+	out(ready), in(NULL), oc(NULL), credit_vcs(0), sent_ready((1 << VCH_SIZE) - 1),
+	sent_flits(0), received_flits(0)
+{
+	for (int i = 0; i < VCH_SIZE; i++) {
+		ready[i] = true;
+		credits[i] = 0;
+	}
+}
+
+bool NocShmLink::peer_alive() const
+{
+	if (peer->exited.load(std::memory_order_acquire)) {
+		return false;
+	}
+	int32 pid = peer->pid.load(std::memory_order_relaxed);
+	return pid == 0 || kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+void NocShmLink::returnCredit(uint32 vch)
+{
+	credits[vch]++;
+	credit_vcs |= 1 << vch;
+}
+
+void NocShmLink::push(const NocShmEntry &entry)
+{
+	//the neighbor takes the entries of the past cycles without waiting
+	//for this process, so a full ring drains
+	uint64 t = tx->tail.load(std::memory_order_relaxed);
+	for (uint64 spins = 0; t - tx->head.load(std::memory_order_acquire) >=
+			NOCSHM_RING_SIZE; spins++) {
+		if (spins < NOCSHM_SPINS) {
+			continue;
+		}
+		std::this_thread::yield();
+		if ((spins & NOCSHM_CHECK_MASK) == 0 && !peer_alive()) {
+			//nobody takes it
+			return;
+		}
+	}
+	tx->entries[t & (NOCSHM_RING_SIZE - 1)] = entry;
+	tx->tail.store(t + 1, std::memory_order_release);
+}
+
+void NocShmLink::send(uint64 now)
+{
+	NocShmEntry entry;
+	memset(&entry, 0, sizeof(entry));
+	entry.cycle = now;
+
+	entry.kind = NOCSHM_FLIT;
+	while (out.haveData()) {
+		out.getData(&entry.flit, &entry.vch);
+		push(entry);
+		sent_flits++;
+	}
+
+	//a credit entry carries the count in the data of the flit
+	memset(&entry.flit, 0, sizeof(entry.flit));
+	entry.kind = NOCSHM_CREDIT;
+	for (uint32 vcs = credit_vcs; vcs != 0; vcs &= vcs - 1) {
+		int i = __builtin_ctz(vcs);
+		entry.vch = i;
+		entry.flit.data = credits[i];
+		push(entry);
+		credits[i] = 0;
+	}
+	credit_vcs = 0;
+
+	//the on/off signals only when they change
+	if (flow == FLOW_ONOFF) {
+		uint32 bits = 0;
+		for (int i = 0; i < VCH_SIZE; i++) {
+			if (in->isReady(i)) {
+				bits |= 1 << i;
+			}
+		}
+		if (bits != sent_ready) {
+			entry.kind = NOCSHM_READY;
+			entry.vch = bits;
+			entry.flit.data = 0;
+			push(entry);
+			sent_ready = bits;
+		}
+	}
+}
+
+void NocShmLink::receive(uint64 now, int latency)
+{
+	uint64 h = rx->head.load(std::memory_order_relaxed);
+	uint64 t = rx->tail.load(std::memory_order_acquire);
+	for (; h != t; h++) {
+		NocShmEntry entry = rx->entries[h & (NOCSHM_RING_SIZE - 1)];
+		if (entry.cycle + latency > now) {
+			break;
+		}
+		switch (entry.kind) {
+			case NOCSHM_FLIT:
+				in->pushData(&entry.flit, entry.vch);
+				received_flits++;
+				break;
+			case NOCSHM_CREDIT:
+				for (uint64 n = 0; n < entry.flit.data; n++) {
+					oc->returnCredit(entry.vch);
+				}
+				break;
+			case NOCSHM_READY:
+				for (int i = 0; i < VCH_SIZE; i++) {
+					ready[i] = (entry.vch >> i) & 1;
+				}
+				break;
+		}
+	}
+	rx->head.store(h, std::memory_order_release);
+}
+
+/*******************************  NocShm  *******************************/
+int NocShm::max_latency(int steps)
+{
+	//a cycle sends a flit per step, a credit per VC and the on/off
+	//signals. A process runs at most the latency ahead of its neighbor,
+	//which has taken the entries up to the latency before itself, so a
+	//link holds the entries of up to 2 * latency + 1 cycles.
+	int per_cycle = steps + VCH_SIZE + 1;
+	return (NOCSHM_RING_SIZE / per_cycle - 1) / 2;
+}
+
+NocShm::NocShm(const NocTopology *topo_, int node_, int latency_)
+	: topo(topo_), node(node_), latency(latency_), segment(NULL),
+	segment_size(0), header(NULL), nodes(NULL), rings(NULL), cycles(0),
+	wait_cycles(0)
+{
+}
+
+NocShm::~NocShm()
+{
+	for (size_t i = 0; i < links.size(); i++) {
+		delete links[i];
+	}
+	if (header != NULL) {
+		nodes[node].exited.store(1, std::memory_order_release);
+		//the last process removes the segment
+		if (header->exited.fetch_add(1) + 1 == (uint32)topo->node_count()) {
+			shm_unlink(name.c_str());
+		}
+	}
+	if (segment != NULL) {
+		munmap(segment, segment_size);
+	}
+}
+
+bool NocShm::open(const char *name_, std::string &error_msg)
+{
+	name = name_;
+	int count = topo->node_count();
+	size_t header_size = (sizeof(NocShmHeader) + 63) & ~(size_t)63;
+	size_t nodes_size = count * sizeof(NocShmNode);
+	segment_size = header_size + nodes_size +
+		count * PORT_COUNT * sizeof(NocShmRing);
+
+	//the processes may start in any order; the first one sizes the
+	//segment, which is filled with zeros
+	int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0600);
+	if (fd < 0) {
+		error_msg = "cannot open " + name + ": " + strerror(errno);
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (st.st_size == 0 &&
+			ftruncate(fd, segment_size) != 0)) {
+		error_msg = "cannot size " + name + ": " + strerror(errno);
+		close(fd);
+		return false;
+	}
+	if (st.st_size != 0 && (size_t)st.st_size != segment_size) {
+		error_msg = name + " is used by a simulation of another network";
+		close(fd);
+		return false;
+	}
+	segment = mmap(NULL, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (segment == MAP_FAILED) {
+		segment = NULL;
+		error_msg = "cannot map " + name + ": " + strerror(errno);
+		return false;
+	}
+	header = (NocShmHeader *)segment;
+	nodes = (NocShmNode *)((char *)segment + header_size);
+	rings = (NocShmRing *)((char *)segment + header_size + nodes_size);
+
+	//all the processes must agree on the configuration
+	struct { std::atomic<uint32> *field; uint32 value; const char *what; } agree[] = {
+		{&header->magic, NOCSHM_MAGIC, "is not a Cube network"},
+		{&header->version, NOCSHM_VERSION, "is of another version"},
+		{&header->node_count, (uint32)count, "has another number of nodes"},
+		{&header->latency, (uint32)latency, "has another cube_shm_latency"},
+	};
+	for (size_t i = 0; i < sizeof(agree) / sizeof(agree[0]); i++) {
+		uint32 expected = 0;
+		if (!agree[i].field->compare_exchange_strong(expected, agree[i].value) &&
+				expected != agree[i].value) {
+			error_msg = name + " " + agree[i].what;
+			header = NULL;
+			return false;
+		}
+	}
+
+	int32 pid = 0;
+	if (!nodes[node].pid.compare_exchange_strong(pid, getpid())) {
+		char msg[160];
+		snprintf(msg, sizeof(msg), "node %d of %s is taken by process %d "
+			"(remove /dev/shm/%s if it is left by an aborted run)",
+			node, name.c_str(), (int)pid, name.c_str() + (name[0] == '/'));
+		error_msg = msg;
+		header = NULL;
+		return false;
+	}
+	return true;
+}
+
+void NocShm::connect(Router *router)
+{
+	for (int port = LOCAL_PORT + 1; port < topo->port_count(); port++) {
+		int peer = topo->neighbor(node, port);
+		if (peer < 0) {
+			continue;
+		}
+		//the neighbor sends from the opposite port
+		NocShmRing *tx = &rings[node * PORT_COUNT + port];
+		NocShmRing *rx = &rings[peer * PORT_COUNT + NocTopology::opposite_port(port)];
+		NocShmLink *link = new NocShmLink(topo->flow_control(port), tx, rx,
+			peer, &nodes[peer]);
+		router->connect_remote(port, link);
+		links.push_back(link);
+	}
+}
+
+bool NocShm::wait_peer(NocShmLink *link, uint64 done)
+{
+	NocShmNode *peer = link->get_peer();
+	bool announced = false;
+	for (uint64 spins = 0; peer->done.load(std::memory_order_acquire) < done;
+			spins++) {
+		//the others stop with the host
+		if (node != 0 && header->halted.load(std::memory_order_acquire)) {
+			return false;
+		}
+		if (spins < NOCSHM_SPINS) {
+			continue;
+		}
+		std::this_thread::yield();
+		if ((spins & NOCSHM_CHECK_MASK) != 0) {
+			continue;
+		}
+		if (!link->peer_alive()) {
+			if (node == 0 || !header->halted.load(std::memory_order_acquire)) {
+				error("node %d left the simulation", link->get_peer_id());
+			}
+			return false;
+		}
+		if (!announced && peer->pid.load(std::memory_order_relaxed) == 0) {
+			fprintf(stderr, "Waiting for node %d to attach to %s\n",
+				link->get_peer_id(), name.c_str());
+			announced = true;
+		}
+	}
+	return true;
+}
+
+bool NocShm::begin_cycle(uint64 now)
+{
+	if (node != 0 && header->halted.load(std::memory_order_acquire)) {
+		return false;
+	}
+
+	//the entries due in NOW were sent in the cycles up to NOW - latency
+	bool waited = false;
+	for (size_t i = 0; i < links.size(); i++) {
+		NocShmLink *link = links[i];
+		if (now + 1 > (uint64)latency) {
+			uint64 done = now + 1 - latency;
+			if (link->get_peer()->done.load(std::memory_order_acquire) < done) {
+				waited = true;
+				if (!wait_peer(link, done)) {
+					return false;
+				}
+			}
+		}
+		link->receive(now, latency);
+	}
+	cycles++;
+	if (waited) {
+		wait_cycles++;
+	}
+	return true;
+}
+
+void NocShm::end_cycle(uint64 now)
+{
+	for (size_t i = 0; i < links.size(); i++) {
+		links[i]->send(now);
+	}
+	nodes[node].done.store(now + 1, std::memory_order_release);
+}
+
+void NocShm::halt()
+{
+	header->halted.store(1, std::memory_order_release);
+}
+
+void NocShm::report()
+{
+	fprintf(stderr, "\tDistributed simulation (node %d, %d cycles/link)\n",
+		node, latency);
+	fprintf(stderr, "\t\tWaited for the neighbors in %llu of %llu cycles\n",
+		(unsigned long long)wait_cycles, (unsigned long long)cycles);
+	for (size_t i = 0; i < links.size(); i++) {
+		fprintf(stderr, "\t\tNode %d: sent %llu flits, received %llu flits\n",
+			links[i]->get_peer_id(),
+			(unsigned long long)links[i]->get_sent_flits(),
+			(unsigned long long)links[i]->get_received_flits());
+	}
+}
@@ -0,0 +1,184 @@
+/*  Headers for the distributed simulation of the Cube network
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _NOCSHM_H_
+#define _NOCSHM_H_
+
+#include "types.h"
+#include "router.h"
+#include <atomic>
+#include <string>
+#include <vector>
+
+class NocTopology;
+
+#define NOCSHM_MAGIC		0x4D485343 //"CSHM"
+#define NOCSHM_VERSION		1
+#define NOCSHM_RING_SIZE	4096 //entries of a link, a power of two
+
+//kinds of the entries of a link
+#define NOCSHM_FLIT		0
+#define NOCSHM_CREDIT	1 //a credit of the VC (credit flow control)
+#define NOCSHM_READY	2 //on/off signals of the VC buffers (bitmap in vch)
+
+struct NocShmEntry {
+	uint64 cycle; //in which the entry was sent
+	FLIT_t flit;
+	uint32 kind;
+	uint32 vch;
+};
+
+/* Entries from a port of a node to its neighbor; the sender moves the
+ * tail and the receiver the head */
+struct NocShmRing {
+	alignas(64) std::atomic<uint64> head;
+	alignas(64) std::atomic<uint64> tail;
+	alignas(64) NocShmEntry entries[NOCSHM_RING_SIZE];
+};
+
+struct NocShmNode {
+	alignas(64) std::atomic<uint64> done; //cycles simulated
+	std::atomic<int32> pid; //0 until the process attaches
+	std::atomic<uint32> exited;
+};
+
+/* The segment starts with the header, which is followed by a NocShmNode
+ * for each node and a NocShmRing for each port of each node. All of it
+ * is zero when the segment is made. */
+struct NocShmHeader {
+	std::atomic<uint32> magic;
+	std::atomic<uint32> version;
+	std::atomic<uint32> node_count;
+	std::atomic<uint32> latency;
+	std::atomic<uint32> halted; //the host halted
+	std::atomic<uint32> exited; //processes which detached
+};
+
+/* A link between a port of the router of this process and the router
+ * of a neighbor in another process. The flits which the router sends
+ * are taken from OUT at the end of the cycle, and the entries from the
+ * neighbor are given to the input port of the router when they are
+ * due. */
+class NocShmLink {
+public:
+	NocShmLink(int flow_, NocShmRing *tx_, NocShmRing *rx_, int peer_id_,
+		NocShmNode *peer_);
+	~NocShmLink() {};
+
+	RouterPortSlave *get_out() { return &out; };
+	void attach(RouterPortSlave *in_, OutputChannel *oc_) { in = in_; oc = oc_; };
+	NocShmNode *get_peer() const { return peer; };
+	int get_peer_id() const { return peer_id; };
+	//the process of the neighbor has not exited (or not attached yet)
+	bool peer_alive() const;
+
+	//a flit left the input buffer of the router (credit flow control)
+	void returnCredit(uint32 vch);
+
+	//deliver the entries sent LATENCY cycles before NOW or earlier
+	void receive(uint64 now, int latency);
+	//send what the router gave in the cycle NOW
+	void send(uint64 now);
+
+	uint64 get_sent_flits() const { return sent_flits; };
+	uint64 get_received_flits() const { return received_flits; };
+
+private:
+	int flow;
+	NocShmRing *tx, *rx;
+	int peer_id;
+	NocShmNode *peer;
+
+	//on/off signals of the VC buffers of the neighbor
+	bool ready[VCH_SIZE];
+	RouterPortSlave out;
+	RouterPortSlave *in;
+	OutputChannel *oc;
+
+	//credits to return at the end of the cycle
+	int credits[VCH_SIZE];
+	uint32 credit_vcs;
+	//on/off signals of the input port last sent
+	uint32 sent_ready;
+
+	uint64 sent_flits, received_flits;
+
+	void push(const NocShmEntry &entry);
+};
+
+/* Distributed simulation of the Cube network (cube_shm). Each chip of
+ * the network is simulated by its own process: node 0 by the one with
+ * the CPU and the others by processes which run only their accelerator
+ * and router (cube_node). The links between the processes are
+ * lock-free rings in a POSIX shared memory segment.
+ *
+ * The processes are synchronized conservatively: an entry sent in
+ * cycle C arrives in cycle C + cube_shm_latency, so a process may start
+ * a cycle once its neighbors have simulated the cycles which send the
+ * entries due in it. The processes are therefore at most the latency
+ * apart, and the results do not depend on their scheduling. The links
+ * take the latency in addition to the cycles of the routers.
+ */
+class NocShm {
+public:
+	NocShm(const NocTopology *topo_, int node_, int latency_);
+	~NocShm();
+
+	//longest latency for which a link never fills up, when the router
+	//takes STEPS steps per cycle
+	static int max_latency(int steps);
+
+	//map the segment NAME and attach to it as the node; return false
+	//with ERROR_MSG if it cannot be done
+	bool open(const char *name_, std::string &error_msg);
+	//link the ports of ROUTER (of the node) to the other processes
+	void connect(Router *router);
+
+	//wait for the neighbors and deliver the entries due in the cycle
+	//NOW. Return false if the simulation is over.
+	bool begin_cycle(uint64 now);
+	void end_cycle(uint64 now);
+	//the host halted; the other processes stop
+	void halt();
+
+	int get_node() const { return node; };
+	void report();
+
+private:
+	const NocTopology *topo;
+	int node;
+	int latency;
+
+	std::string name;
+	void *segment;
+	size_t segment_size;
+	NocShmHeader *header;
+	NocShmNode *nodes;
+	NocShmRing *rings; //indexed by node * PORT_COUNT + port
+	std::vector<NocShmLink *> links;
+
+	//statistics
+	uint64 cycles, wait_cycles;
+
+	//wait until the neighbor of LINK has simulated DONE cycles; false
+	//if the simulation is over
+	bool wait_peer(NocShmLink *link, uint64 done);
+};
+
+#endif /* _NOCSHM_H_ */
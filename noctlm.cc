@@ -0,0 +1,166 @@
+/*  Transaction-level model of the Cube network
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "noctlm.h"
+#include "topology.h"
+#include "stats.h"
+#include "hostprof.h"
+#include "vmips.h"
+#include <cstdio>
+#include <cstring>
+
+NocTlm::NocTlm(const NocTopology *topo_, int hop_latency_, int flits_per_cycle_)
+	: topo(topo_), hop_latency(hop_latency_), flits_per_cycle(flits_per_cycle_)
+{
+	reset();
+}
+
+void NocTlm::attach(const std::vector<Router *> &routers)
+{
+	nodes.resize(routers.size());
+	for (size_t i = 0; i < routers.size(); i++) {
+		routers[i]->set_bypassed(true);
+		nodes[i].ingress = routers[i]->from[LOCAL_PORT];
+		nodes[i].egress = routers[i]->to[LOCAL_PORT];
+	}
+	link_free.assign(routers.size() * PORT_COUNT, 0);
+}
+
+void NocTlm::reset()
+{
+	for (size_t i = 0; i < nodes.size(); i++) {
+		for (int v = 0; v < VCH_SIZE; v++) {
+			nodes[i].packet[v].clear();
+		}
+	}
+	link_free.assign(link_free.size(), 0);
+	while (!pending.empty()) {
+		pending.pop();
+	}
+	seq = 0;
+	packets = flits = 0;
+	latency_cycles = contention_cycles = 0;
+	memset(latency_hist, 0, sizeof(latency_hist));
+}
+
+void NocTlm::send(int src, uint32 vch, uint64 now)
+{
+	Node &node = nodes[src];
+	Delivery d;
+	d.flits.swap(node.packet[vch]);
+	d.vch = vch;
+	d.dst = RouterUtils::extractDst(&d.flits[0]);
+	if (d.dst >= (int)nodes.size()) {
+		//no such node; the routers lose such a packet, too
+		return;
+	}
+	d.seq = seq++;
+
+	//the head flit goes through the routers on the path, and the
+	//others follow it on each link
+	uint64 serialize = (d.flits.size() + flits_per_cycle - 1) / flits_per_cycle;
+	uint64 t = node.head_cycle[vch];
+	int at = src;
+	uint32 in_port = LOCAL_PORT;
+	while (true) {
+		uint32 port = topo->route(at, in_port, d.dst, vch, NULL, &vch);
+		uint64 &free = link_free[at * PORT_COUNT + port];
+		t += hop_latency;
+		if (free > t) {
+			contention_cycles += free - t;
+			t = free;
+		}
+		free = t + serialize;
+		if (port == LOCAL_PORT) {
+			break;
+		}
+		at = topo->neighbor(at, port);
+		in_port = NocTopology::opposite_port(port);
+	}
+
+	d.cycle = t + serialize;
+	if (d.cycle <= now) {
+		d.cycle = now + 1;
+	}
+	uint64 latency = d.cycle - node.head_cycle[d.vch];
+	packets++;
+	flits += d.flits.size();
+	latency_cycles += latency;
+	latency_hist[RouterUtils::hist_bin(latency, ROUTER_LAT_HIST_SIZE)]++;
+	pending.push(d);
+}
+
+void NocTlm::step()
+{
+	HostProfScope prof(HOSTPROF_ROUTER);
+	uint64 now = machine->get_cycles();
+	FLIT_t flit;
+	uint32 vch;
+
+	for (size_t i = 0; i < nodes.size(); i++) {
+		Node &node = nodes[i];
+		while (node.ingress->haveData()) {
+			node.ingress->getData(&flit, &vch);
+			if (flit.ftype == FTYPE_HEAD || flit.ftype == FTYPE_HEADTAIL) {
+				node.packet[vch].clear();
+				node.head_cycle[vch] = now;
+			} else if (node.packet[vch].empty()) {
+				//no head flit
+				continue;
+			}
+			node.packet[vch].push_back(flit);
+			if (flit.ftype == FTYPE_TAIL || flit.ftype == FTYPE_HEADTAIL) {
+				send(i, vch, now);
+			}
+		}
+	}
+
+	while (!pending.empty() && pending.top().cycle <= now) {
+		const Delivery &d = pending.top();
+		for (size_t i = 0; i < d.flits.size(); i++) {
+			FLIT_t f = d.flits[i];
+			nodes[d.dst].egress->send(&f, d.vch);
+		}
+		pending.pop();
+	}
+}
+
+void NocTlm::report()
+{
+	fprintf(stderr, "\tTransaction-level model (%d cycles/hop, %d flits/cycle)\n",
+		hop_latency, flits_per_cycle);
+	fprintf(stderr, "\t\tPackets %llu (%llu flits)\n",
+		(unsigned long long)packets, (unsigned long long)flits);
+	fprintf(stderr, "\t\tAverage latency %.3f cycles\n", packets == 0 ? 0.0 :
+		(double)latency_cycles / (double)packets);
+	fprintf(stderr, "\t\tAverage contention %.3f cycles\n", packets == 0 ? 0.0 :
+		(double)contention_cycles / (double)packets);
+}
+
+void NocTlm::register_stats(StatsRegistry &stats, const std::string &prefix)
+{
+	stats.add_counter(prefix + ".packets", &packets);
+	stats.add_counter(prefix + ".flits", &flits);
+	stats.add_counter(prefix + ".latency_cycles", &latency_cycles);
+	stats.add_counter(prefix + ".contention_cycles", &contention_cycles);
+	stats.add_histogram(prefix + ".latency_hist", latency_hist,
+		ROUTER_LAT_HIST_SIZE);
+	stats.add_formula(prefix + ".average_latency", prefix + ".latency_cycles",
+		prefix + ".packets");
+}
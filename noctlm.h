@@ -0,0 +1,96 @@
+/*  Headers for the transaction-level model of the Cube network
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _NOCTLM_H_
+#define _NOCTLM_H_
+
+#include "types.h"
+#include "router.h"
+#include <queue>
+#include <string>
+#include <vector>
+
+class NocTopology;
+class StatsRegistry;
+
+/* Transaction-level model of the Cube network (noc_model=tlm). The
+ * routers are not stepped; the model takes the flits which the local
+ * modules send to the local ports of their routers and, once the tail
+ * flit is in, delivers the whole packet to the local port of the
+ * destination router after
+ *
+ *   hops * noc_tlm_hop_latency + flits / (flits per cycle)
+ *
+ * cycles from the head flit. Each link (and the ejection to the local
+ * module) is busy while a packet goes through it, so a packet which
+ * finds a link busy waits for it. The paths are those of the flit-level
+ * routers; adaptive routing takes the east port whenever it may.
+ */
+class NocTlm {
+public:
+	//FLITS_PER_CYCLE is the number of router steps in a cycle
+	NocTlm(const NocTopology *topo_, int hop_latency_, int flits_per_cycle_);
+	~NocTlm() {};
+
+	//carry the packets of the local port of ROUTERS (indexed by node ID)
+	void attach(const std::vector<Router *> &routers);
+	void reset();
+	void step();
+
+	void report();
+	void register_stats(StatsRegistry &stats, const std::string &prefix);
+
+private:
+	struct Node {
+		RouterPortSlave *ingress; //flits from the local module
+		RouterPortMaster *egress; //to the local module
+		std::vector<FLIT_t> packet[VCH_SIZE]; //being received
+		uint64 head_cycle[VCH_SIZE];
+	};
+
+	struct Delivery {
+		uint64 cycle;
+		uint64 seq; //keeps the order of the packets due in the same cycle
+		int dst;
+		uint32 vch;
+		std::vector<FLIT_t> flits;
+		bool operator>(const Delivery &d) const {
+			return cycle != d.cycle ? cycle > d.cycle : seq > d.seq;
+		}
+	};
+
+	const NocTopology *topo;
+	int hop_latency;
+	int flits_per_cycle;
+	std::vector<Node> nodes;
+	//cycle from which each link (node * PORT_COUNT + port) is free
+	std::vector<uint64> link_free;
+	std::priority_queue<Delivery, std::vector<Delivery>,
+		std::greater<Delivery> > pending;
+	uint64 seq;
+
+	//statistics
+	uint64 packets, flits;
+	uint64 latency_cycles, contention_cycles;
+	uint64 latency_hist[ROUTER_LAT_HIST_SIZE];
+
+	void send(int src, uint32 vch, uint64 now);
+};
+
+#endif /* _NOCTLM_H_ */
@@ -466,6 +466,35 @@ std::vector<int> Options::get_tuple(const char *option, int len)
 	return v;
 }
 
+std::vector<int> Options::get_list(const char *option)
+{
+	std::vector<int> v;
+	std::string str;
+
+	std::regex format_re;
+	std::regex num_re;
+	std::smatch m;
+
+	try {
+		format_re = std::regex("\\(\\s*[0-9]+\\s*(,\\s*[0-9]+\\s*)*\\)");
+		num_re = std::regex("[0-9]+");
+	} catch(std::regex_error& e) {
+		fatal_error("regex is not supported\nPlease rebuild with GCC 4.9 or higher\n");
+	}
+
+	str = std::string(option);
+	if (std::regex_match(str, format_re)) {
+		while (std::regex_search(str, m, num_re)) {
+			v.push_back(std::stoi(m[0].str()));
+			str = m.suffix();
+		}
+	} else {
+		fatal_error("Invalid list option: %s", option);
+	}
+
+	return v;
+}
+
 void
 Options::print_config_info(void)
 {
@@ -82,6 +82,8 @@ public:
 	virtual void process_options(int argc, char **argv);
 	union OptionValue *option(const char *name);
 	std::vector<int> get_tuple(const char *option, int len);
+	/* same format as get_tuple, but any number of elements */
+	std::vector<int> get_list(const char *option);
 };
 
 #endif /* _OPTIONS_H_ */
@@ -373,6 +373,8 @@ static Option nametable[] = {
 	to enable it. **/
 
     { "system_mode", STR },
+    /** cpu_only, cube, bus_conn or noc_bench. noc_bench runs only the
+        routers of the Cube network with the traffic generators. **/
 
     { "dmac", FLAG },
     /** Enable cube DMAC */
@@ -383,6 +385,103 @@ static Option nametable[] = {
     /** Report router profiling results after emulation **/
     { "exmemprof", FLAG },
     /** Report externam memory profiling results after emulation **/
+    { "sdprof", FLAG },
+    /** Simulate many L1 cache geometries at once with stack distance
+        analysis and report the miss counts after emulation **/
+    { "sdprof_bsizes", STR },
+    /** Block sizes for sdprof, e.g. (16,32,64) **/
+    { "sdprof_sets", STR },
+    /** Numbers of sets for sdprof, e.g. (32,64,128) **/
+    { "sdprof_maxway", NUM },
+    /** Maximum associativity for sdprof **/
+    { "missprof", FLAG },
+    /** Report L1 cache misses per PC and per address region, classified
+        into compulsory, capacity and conflict misses, and the reuse
+        distance histogram after emulation **/
+    { "missprof_top", NUM },
+    /** Number of PCs and regions listed by missprof **/
+    { "missprof_region", NUM },
+    /** Size of an address region for missprof (power of two) **/
+    { "stallprof", FLAG },
+    /** Attribute every stalled cycle of the CPU to its cause (cache
+        miss, uncached access, bus wait, mult/div, load-use hazard or
+        coprocessor suspension) and to the PC of the waiting instruction **/
+    { "stallprof_top", NUM },
+    /** Number of PCs listed by stallprof **/
+    { "stallprof_file", STR },
+    /** File name of the stall profile in collapsed stack format **/
+    { "symfile", STR },
+    /** ELF file of the program to read the function symbols from
+        (.symtab), e.g. the ELF the ROM image was made of. If this is
+        none, the symbols are read from execname if it is an ELF file. **/
+    { "funcprof", FLAG },
+    /** Attribute the cycles, instructions, stalls and L1 cache misses
+        to the functions of the symbol table and follow the calls to
+        build the call graph. The profile is also written to gmonfile
+        for gprof. **/
+    { "funcprof_top", NUM },
+    /** Number of functions and call arcs listed by funcprof **/
+    { "gmonfile", STR },
+    /** File name of the gprof compatible output of funcprof **/
+    { "statsinterval", NUM },
+    /** Dump the statistics registry (caches, bus, memories, DRAM,
+        routers and accelerators) every statsinterval cycles. Each
+        dump has the increase of the counters in the interval.
+        0 disables the dumps. **/
+    { "statsfile", STR },
+    /** File name of the statistics dumps **/
+    { "statsformat", STR },
+    /** Format of the statistics dumps: csv (a row per interval) or
+        json (an object per line) **/
+    { "perfcounter", FLAG },
+    /** Map the performance counters (cycles, instructions, stalls,
+        L1 cache hits and misses, bus wait cycles of the CPU and busy
+        cycles of the accelerators) at 0xBD040000 for the guest
+        program **/
+    { "eventtrace", FLAG },
+    /** Write the activity of the modules (CPU stall episodes, cache
+        fills, DMAC transfers, router packets per VC, CMA and SNACC
+        cores) as a Chrome trace event file (eventtracefile), which
+        chrome://tracing and the Perfetto UI can open. One cycle is
+        shown as one microsecond. **/
+    { "eventtracefile", STR },
+    /** File name of the event trace **/
+    { "hostprof", FLAG },
+    /** Measure the host time spent in the step functions of the
+        components (CPU, caches, DMAC, routers and accelerators) and
+        report it in nanoseconds per simulated cycle at exit. SIGUSR1
+        pauses and resumes the measurement. **/
+    { "hostprof_period", NUM },
+    /** Time one of every hostprof_period cycles **/
+    { "memtrace", FLAG },
+    /** Record every transaction completed on the system bus to a
+        binary trace file (memtracefile) **/
+    { "memtracefile", STR },
+    /** File name of the memory trace **/
+    { "memtrace_compress", STR },
+    /** Compression of the memory trace chunks: none, zlib, zstd or lz4
+        (the codecs must be enabled when building) **/
+    { "insttrace", FLAG },
+    /** Record every committed instruction to a binary trace file
+        (insttracefile). Use tracetool to disassemble it. **/
+    { "insttracefile", STR },
+    /** File name of the instruction trace **/
+    { "insttrace_compress", STR },
+    /** Compression of the instruction trace chunks: none, zlib, zstd
+        or lz4 (the codecs must be enabled when building) **/
+    { "flittrace", FLAG },
+    /** Record every flit through the crossbars of the routers (and the
+        forwarded ACKs) to a binary trace file (flittracefile). Use
+        tracetool to filter the flits or to list the packets with their
+        latency; much faster than routermsg on long runs. **/
+    { "flittracefile", STR },
+    /** File name of the flit trace **/
+    { "flittrace_compress", STR },
+    /** Compression of the flit trace chunks: none, zlib, zstd or lz4
+        (the codecs must be enabled when building) **/
+    { "busprof", FLAG },
+    /** Report bus grants, wait cycles and utilization of each bus
+        master after emulation **/
 
     { "icacheway", NUM },
     { "icachebsize", NUM },
@@ -393,9 +492,75 @@ static Option nametable[] = {
     //bsize&bnum must be the powers of two
     /* cache configration*/
 
+    { "l2cache", FLAG },
+    /** Enable the shared L2 cache between the bus and the external
+        memories (RAM and program memory). **/
+    { "l2cacheway", NUM },
+    { "l2cachebsize", NUM },
+    { "l2cachebnum", NUM },
+    { "l2cachebanks", NUM },
+    /** Number of L2 banks. Each bank accepts one lookup per cycle. **/
+    { "l2cache_latency", NUM },
+    /** Cycles for an L2 hit (excluding the bus latency). **/
+    { "l2cache_policy", STR },
+    /** Inclusion policy of the L2 cache: inclusive, exclusive or
+        nine (non-inclusive non-exclusive). **/
+
     { "mem_bandwidth", NUM },
+    { "bus_bandwidth", NUM },
+    /** Bytes the system bus moves per cycle, shared by all the bus
+        masters. 0 means mem_bandwidth words. **/
+    { "bus_cap_cpu", NUM },
+    { "bus_cap_dmac", NUM },
+    /** Maximum bytes per cycle for each bus master (0: no cap) **/
+    { "bus_arbitration", STR },
+    /** Bus arbitration policy: fcfs (first come first served), fixed
+        (fixed priority), wrr (weighted round robin), tdma or age.
+        On the split transaction bus it chooses the master of each
+        address phase. **/
+    { "bus_weight_cpu", NUM },
+    { "bus_weight_dmac", NUM },
+    { "bus_weight_rtif", NUM },
+    /** Arbitration weight of each bus master: the priority for fixed,
+        grants per turn for wrr and slots per frame for tdma. **/
+    { "bus_tdma_slot", NUM },
+    /** Length of a TDMA slot in cycles. **/
+    { "bus_split", FLAG },
+    /** Use a split transaction bus. Masters do not lock the bus during
+        the latency; requests are issued one per cycle and several
+        transactions per master can be in flight. **/
+    { "bus_outstanding", NUM },
+    { "bus_outstanding_cpu", NUM },
+    { "bus_outstanding_dmac", NUM },
+    /** Transactions each bus master can have in flight on the split
+        transaction bus. 0 for cpu/dmac means bus_outstanding. **/
+    { "bus_order", STR },
+    /** Response order on the split transaction bus for each master:
+        inorder or ooo (out of order). **/
+    { "nif_bandwidth", NUM },
+    /** Words per cycle of the network interfaces between the routers
+        and their local memories. 0 means mem_bandwidth. **/
     { "bus_latency", NUM },
     { "exmem_latency", NUM },
+    { "dram", FLAG },
+    /** Use the DRAM timing model for RAM and program memory instead
+        of the fixed exmem_latency. **/
+    { "dram_banks", NUM },
+    /** Number of DRAM banks. **/
+    { "dram_rowsize", NUM },
+    /** Size of a DRAM row in bytes. **/
+    { "dram_tcas", NUM },
+    { "dram_trcd", NUM },
+    { "dram_trp", NUM },
+    /** DRAM CAS latency, RAS to CAS delay and precharge time in
+        cycles. **/
+    { "dram_trefi", NUM },
+    { "dram_trfc", NUM },
+    /** DRAM refresh interval and refresh time in cycles (dram_trefi=0
+        disables refresh). **/
+    { "dram_page_policy", STR },
+    /** DRAM page policy: open (rows are kept open) or closed (rows are
+        precharged after each burst). **/
 
     /*Router configs*/
     { "vcbufsize", NUM },
@@ -405,6 +570,60 @@ static Option nametable[] = {
     { "accelerator0", STR },
     { "accelerator1", STR },
     { "accelerator2", STR },
+    { "topology", STR },
+    /** File which gives the shape (stack, mesh or torus), the routing
+        and the accelerator of each node of the Cube network. none means
+        a stack of accelerator0-2. **/
+    { "node_bits", NUM },
+    /** Width of the source and destination node fields of the head
+        flits (2 to 5), i.e. up to 2^node_bits nodes. **/
+    { "tci_flow_control", STR },
+    /** Flow control of the links between the chips (the X links):
+        ack (ACK flits on the reverse link), credit (credits on a
+        sideband) or onoff (on/off signal of each VC buffer). **/
+    { "onchip_flow_control", STR },
+    /** Flow control of the on-chip links of a mesh or torus (the Y
+        links): ack, credit or onoff. **/
+    { "noc_model", STR },
+    /** Model of the Cube network: flit (the routers are simulated flit
+        by flit) or tlm (the packets are delivered whole after a latency
+        computed from the hops, the flits and the contention of the
+        links). **/
+    { "noc_tlm_hop_latency", NUM },
+    /** Cycles per hop of the head flit in noc_model=tlm. **/
+    { "cube_shm", STR },
+    /** Name of the POSIX shared memory through which the nodes of the
+        Cube network are simulated by separate processes, or none to
+        simulate all of them in this process. **/
+    { "cube_node", NUM },
+    /** Node which this process simulates with cube_shm. Node 0 runs the
+        program on the CPU; the others run only their accelerator and
+        router until node 0 halts. **/
+    { "cube_shm_latency", NUM },
+    /** Cycles in which a flit goes from a process to another with
+        cube_shm, which is also how far the processes may run apart.
+        It is limited by the entries a link can hold (204 cycles with
+        one router step per cycle). **/
+
+    // Traffic generator benchmark (system_mode=noc_bench)
+    { "noc_traffic", STR },
+    /** Traffic pattern: uniform, hotspot, bitcomp (bit complement),
+        bursty (on/off sources) or dma (packets of the maximum size). **/
+    { "noc_rates", STR },
+    /** Injection rates to sweep, in percent of a flit per node per
+        cycle, e.g. (10,20,30). **/
+    { "noc_packet_flits", NUM },
+    /** Flits per packet including the head (2 to dcachebsize/4 + 1). **/
+    { "noc_hotspot", NUM },
+    /** Node which receives a quarter of the packets of the hotspot
+        traffic. **/
+    { "noc_bench_warmup", NUM },
+    { "noc_bench_cycles", NUM },
+    /** Cycles before and during the measurement of each rate. **/
+    { "noc_seed", NUM },
+    /** Seed of the random traffic. **/
+    { "noc_bench_csv", STR },
+    /** File to write the results as CSV, or none. **/
 
     // SNACC options
     { "snacc_sram_latency", NUM },
@@ -431,11 +650,37 @@ static const char *defaults_table[] = {
     "spimconsole", "notracing", "tracesize=100000", "nobigendian",
     "tracestartpc=0", "traceendpc=0",
     "execname=none", "nofpu", "notestdev", "nocacheprof",
-    "norouterprof", "noexmemprof",
+    "norouterprof", "noexmemprof", "nosdprof", "sdprof_bsizes=(16,32,64,128)",
+    "sdprof_sets=(16,32,64,128,256)", "sdprof_maxway=16",
+    "nomissprof", "missprof_top=10", "missprof_region=0x1000", "nobusprof",
+    "nostallprof", "stallprof_top=20", "stallprof_file=stallprof.folded",
+    "symfile=none", "nofuncprof", "funcprof_top=20", "gmonfile=gmon.out",
+    "statsinterval=0", "statsfile=stats.csv", "statsformat=csv",
+    "perfcounter", "noeventtrace", "eventtracefile=eventtrace.json",
+    "nohostprof", "hostprof_period=16",
+    "nomemtrace", "memtracefile=memtrace.bin", "memtrace_compress=none",
+    "noinsttrace", "insttracefile=insttrace.bin", "insttrace_compress=none",
+    "noflittrace", "flittracefile=flittrace.bin", "flittrace_compress=none",
     "dmac", "icacheway=2", "dcacheway=2", "icachebsize=64", "dcachebsize=64",
-    "icachebnum=64", "dcachebnum=64", "mem_bandwidth=1",
-    "bus_latency=8", "exmem_latency=3", "vcbufsize=24", "noroutermsg",
+    "icachebnum=64", "dcachebnum=64", "nol2cache", "l2cacheway=8",
+    "l2cachebsize=64", "l2cachebnum=512", "l2cachebanks=1",
+    "l2cache_latency=2", "l2cache_policy=nine", "mem_bandwidth=1",
+    "bus_bandwidth=0", "bus_cap_cpu=0", "bus_cap_dmac=0", "bus_arbitration=fcfs",
+    "bus_weight_cpu=1", "bus_weight_dmac=1", "bus_weight_rtif=1",
+    "bus_tdma_slot=16", "nobus_split",
+    "bus_outstanding=4", "bus_outstanding_cpu=0", "bus_outstanding_dmac=0",
+    "bus_order=inorder", "nif_bandwidth=0",
+    "bus_latency=8", "exmem_latency=3", "nodram",
+    "dram_banks=8", "dram_rowsize=2048", "dram_tcas=3", "dram_trcd=3",
+    "dram_trp=3", "dram_trefi=780", "dram_trfc=11", "dram_page_policy=open", "vcbufsize=24", "noroutermsg",
     "accelerator0=none", "accelerator1=none", "accelerator2=none",
+    "topology=none", "node_bits=2",
+    "tci_flow_control=ack", "onchip_flow_control=ack",
+    "noc_model=flit", "noc_tlm_hop_latency=5",
+    "cube_shm=none", "cube_node=0", "cube_shm_latency=1",
+    "noc_traffic=uniform", "noc_rates=(5,10,20,30,40,50,60,70,80)",
+    "noc_packet_flits=2", "noc_hotspot=0", "noc_bench_warmup=1000",
+    "noc_bench_cycles=10000", "noc_seed=1", "noc_bench_csv=none",
     "snacc_sram_latency=1", "snacc_inst_dump=disabled",
     "snacc_mad_debug=disabled", "system_mode=cube",
     NULL
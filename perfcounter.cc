@@ -0,0 +1,117 @@
+/*  Performance counter device
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "perfcounter.h"
+#include "accesstypes.h"
+#include "excnames.h"
+#include "deviceexc.h"
+
+PerfCounter::PerfCounter(const std::vector<StatsRegistry::Getter> &sources_)
+	: DeviceMap(PERFCNT_SIZE), sources(sources_),
+	  base(sources_.size(), 0), frozen(sources_.size(), 0)
+{
+	reset();
+}
+
+uint64 PerfCounter::value(int i) const
+{
+	if (!running) {
+		return frozen[i];
+	}
+	return sources[i] ? sources[i]() - base[i] : 0;
+}
+
+void PerfCounter::reset()
+{
+	running = false;
+	clear();
+	start();
+}
+
+void PerfCounter::start()
+{
+	if (running) {
+		return;
+	}
+	for (size_t i = 0; i < sources.size(); i++) {
+		base[i] = sources[i] ? sources[i]() - frozen[i] : 0;
+	}
+	running = true;
+}
+
+void PerfCounter::stop()
+{
+	if (!running) {
+		return;
+	}
+	for (size_t i = 0; i < sources.size(); i++) {
+		frozen[i] = value(i);
+	}
+	running = false;
+}
+
+void PerfCounter::clear()
+{
+	for (size_t i = 0; i < sources.size(); i++) {
+		frozen[i] = 0;
+		base[i] = sources[i] ? sources[i]() : 0;
+	}
+	latched_high = 0;
+}
+
+uint32 PerfCounter::fetch_word(uint32 offset, int, DeviceExc *client)
+{
+	switch (offset) {
+		case PERFCNT_CTRL_OFFSET:
+			return running ? PERFCNT_RUN_BIT : 0;
+		case PERFCNT_NUM_OFFSET:
+			return sources.size();
+		default:
+			break;
+	}
+
+	uint32 index = (offset - PERFCNT_COUNTER_OFFSET) / 8;
+	if (offset < PERFCNT_COUNTER_OFFSET || index >= sources.size()) {
+		client->exception(DBE, DATALOAD);
+		return 0xFFFFFFFF;
+	}
+	if (offset % 8 == 0) {
+		uint64 v = value(index);
+		latched_high = v >> 32;
+		return (uint32)v;
+	}
+	return latched_high;
+}
+
+void PerfCounter::store_word(uint32 offset, uint32 data, DeviceExc *client)
+{
+	if (offset != PERFCNT_CTRL_OFFSET) {
+		client->exception(DBE, DATASTORE);
+		return;
+	}
+	// clear first, so that CLEAR|RUN restarts the counting from zero
+	if (data & PERFCNT_CLEAR_BIT) {
+		clear();
+	}
+	if (data & PERFCNT_RUN_BIT) {
+		start();
+	} else {
+		stop();
+	}
+}
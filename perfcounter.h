@@ -0,0 +1,81 @@
+/*  Headers for the performance counter device
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _PERFCOUNTER_H_
+#define _PERFCOUNTER_H_
+
+#include "devicemap.h"
+#include "stats.h"
+
+//Address map
+#define PERFCNT_ADDR_BASE		0xBD040000
+#define PERFCNT_SIZE			0x100
+#define PERFCNT_CTRL_OFFSET		0x00000000
+#define PERFCNT_NUM_OFFSET		0x00000004
+#define PERFCNT_COUNTER_OFFSET	0x00000010	// low word, high word
+
+//BITMAP
+#define PERFCNT_RUN_BIT			0x1
+#define PERFCNT_CLEAR_BIT		0x2
+
+//Counters
+#define PERFCNT_CYCLES			0
+#define PERFCNT_INSTRET			1
+#define PERFCNT_STALLS			2
+#define PERFCNT_ICACHE_HITS		3
+#define PERFCNT_ICACHE_MISSES	4
+#define PERFCNT_DCACHE_HITS		5
+#define PERFCNT_DCACHE_MISSES	6
+#define PERFCNT_BUS_WAIT		7	// cycles the CPU waited for the bus
+#define PERFCNT_AC0_BUSY		8
+#define PERFCNT_AC1_BUSY		9
+#define PERFCNT_AC2_BUSY		10
+#define PERFCNT_COUNT			11
+
+/* Memory-mapped block of 64-bit counters for the guest program. The
+ * counters follow the simulator counters (sources) while RUN is set and
+ * hold their values while it is cleared. Reading the low word latches
+ * the high word so that a 64-bit value is read consistently.
+ */
+class PerfCounter : public DeviceMap {
+private:
+	std::vector<StatsRegistry::Getter> sources;
+	std::vector<uint64> base;
+	std::vector<uint64> frozen;
+	bool running;
+	uint32 latched_high;
+
+	uint64 value(int i) const;
+
+public:
+	/* A counter without source (empty function) reads as zero */
+	PerfCounter(const std::vector<StatsRegistry::Getter> &sources_);
+
+	void reset();
+	void start();
+	void stop();
+	void clear();
+
+	uint32 fetch_word(uint32 offset, int mode, DeviceExc *client);
+	void store_word(uint32 offset, uint32 data, DeviceExc *client);
+
+	const char *descriptor_str() const { return "Performance counter"; }
+};
+
+#endif /* _PERFCOUNTER_H_ */
@@ -23,6 +23,7 @@
 #include "range.h"
 #include "accesstypes.h"
 #include "error.h"
+#include "stats.h"
 #include <cassert>
 
 /* Returns true if ADDR is mapped by this Range object; false otherwise. */
@@ -112,6 +113,12 @@ Range::store_byte(uint32 offset, uint8 data, DeviceExc *client)
 	*byte = data;
 }
 
+void Range::register_stats(StatsRegistry &stats, const std::string &prefix)
+{
+	stats.add_counter(prefix + ".reads", &read_count);
+	stats.add_counter(prefix + ".writes", &write_count);
+}
+
 void Range::report_profile()
 {
 	fprintf(stderr, "\tRead Count:\t%d\n", read_count);
@@ -27,6 +27,9 @@
 #include "types.h"
 #include <sys/types.h>
 #include <stdio.h>
+#include <string>
+
+class StatsRegistry;
 
 class DeviceExc;
 
@@ -70,8 +73,11 @@ public:
 	virtual void store_byte(uint32 offset, uint8 data, DeviceExc *client);
 	virtual bool ready(uint32 offset, int32 mode, DeviceExc *client) { return true; } ;
 	virtual int extra_latency() { return 0; };
+	/* Latency of an access to OFFSET issued in the cycle NOW */
+	virtual int access_latency(uint32 offset, int32 mode, uint32 now) { return extra_latency(); };
 
 	void report_profile();
+	void register_stats(StatsRegistry &stats, const std::string &prefix);
 };
 
 
@@ -20,8 +20,8 @@
 
 #include "remoteram.h"
 
-RemoteRam::RemoteRam(uint32 node_ID, Router* upperRouter, int mem_size)
-	: CubeAccelerator(node_ID, upperRouter)
+RemoteRam::RemoteRam(uint32 node_ID, int mem_size)
+	: CubeAccelerator(node_ID)
 {
 	mem = new MemoryModule(mem_size, 0);
 }
@@ -33,7 +33,7 @@ private:
 	MemoryModule *mem;
 
 public:
-	RemoteRam(uint32 node_ID, Router* upperRouter, int mem_size);
+	RemoteRam(uint32 node_ID, int mem_size);
 	~RemoteRam();
 
 	void setup();
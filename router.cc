@@ -20,19 +20,45 @@
 
 #include "router.h"
 #include "options.h"
+#include "stats.h"
+#include "hostprof.h"
+#include "eventtrace.h"
+#include "flittrace.h"
+#include "topology.h"
+#include "nocshm.h"
 #include <stdio.h>
+#include <ctype.h>
+#include <string.h>
 
 //for debug
 #include "vmips.h"
 
 /*******************************  RouterUtils  *******************************/
+//default format; set_node_bits() is called at setup
+int RouterUtils::node_bits = FLIT_NODE_BITS_DEFAULT;
+int RouterUtils::src_lsb = 2;
+int RouterUtils::vch_lsb = 4;
+int RouterUtils::mt_lsb = 7;
+int RouterUtils::mema_lsb = 10;
+
+void RouterUtils::set_node_bits(int bits)
+{
+	node_bits = bits;
+	src_lsb = bits;
+	vch_lsb = src_lsb + bits;
+	mt_lsb = vch_lsb + FLIT_VCH_BITS;
+	mema_lsb = mt_lsb + FLIT_MT_BITS;
+}
+
 void RouterUtils::make_head_flit(FLIT_t* flit, uint32 addr, uint32 mtype, uint32 vch,
 									uint32 src, uint32 dst, bool tail)
 {
-	flit->data = (addr << FLIT_MEMA_LSB) + ((mtype << FLIT_MT_LSB) & FLIT_MT_MASK) +
-					((src << FLIT_SRC_LSB) & FLIT_SRC_MASK) +
-					((vch << FLIT_VCH_LSB) & FLIT_VCH_MASK) +
-					(dst & FLIT_DST_MASK);
+	flit->data = ((flit_data_t)(addr & FLIT_MEMA_MASK) << mema_lsb) +
+					((flit_data_t)(mtype & ((1 << FLIT_MT_BITS) - 1)) << mt_lsb) +
+					((flit_data_t)(src & node_mask()) << src_lsb) +
+					((flit_data_t)(vch & ((1 << FLIT_VCH_BITS) - 1)) << vch_lsb) +
+					(dst & node_mask());
+	flit->inject = 0;
 	if (tail) {
 		flit->ftype = FTYPE_HEADTAIL;
 	} else {
@@ -40,9 +66,10 @@ void RouterUtils::make_head_flit(FLIT_t* flit, uint32 addr, uint32 mtype, uint32
 	}
 }
 
-void RouterUtils::make_data_flit(FLIT_t* flit, uint32 data, bool tail)
+void RouterUtils::make_data_flit(FLIT_t* flit, flit_data_t data, bool tail)
 {
 	flit->data = data;
+	flit->inject = 0;
 	if (tail) {
 		flit->ftype = FTYPE_TAIL;
 	} else {
@@ -53,6 +80,7 @@ void RouterUtils::make_data_flit(FLIT_t* flit, uint32 data, bool tail)
 void RouterUtils::make_ack_flit(FLIT_t *flit, uint32 ftype, int *cnt)
 {
 	flit->ftype = ftype;
+	flit->inject = 0;
 	uint32 data = 0;
 	for (int i = 0; i < FLIT_ACK_ENTRY; i++) {
 		if (cnt[i] >= 1 << FLIT_ACK_CNT_BIT) {
@@ -69,11 +97,11 @@ void RouterUtils::decode_headflit(FLIT_t* flit, uint32 *addr, uint32 *mtype, uin
 									uint32 *src, uint32 *dst)
 {
 	if (flit->ftype == FTYPE_HEAD || flit->ftype == FTYPE_HEADTAIL) {
-		*addr = flit->data >> FLIT_MEMA_LSB;
-		*mtype = (flit->data & FLIT_MT_MASK) >> FLIT_MT_LSB;
-		*vch = (flit->data & FLIT_VCH_MASK) >> FLIT_VCH_LSB;
-		*src = (flit->data & FLIT_SRC_MASK) >> FLIT_SRC_LSB;
-		*dst = flit->data & FLIT_DST_MASK;
+		*addr = (flit->data >> mema_lsb) & FLIT_MEMA_MASK;
+		*mtype = (flit->data >> mt_lsb) & ((1 << FLIT_MT_BITS) - 1);
+		*vch = (flit->data >> vch_lsb) & ((1 << FLIT_VCH_BITS) - 1);
+		*src = (flit->data >> src_lsb) & node_mask();
+		*dst = flit->data & node_mask();
 	} else {
 		*addr = *mtype = *vch = *src = *dst = 0;
 	}
@@ -94,7 +122,7 @@ void RouterUtils::decode_ack(FLIT_t* flit, int *cnt)
 
 uint32 RouterUtils::extractDst(FLIT_t* flit)
 {
-	return flit->data & FLIT_DST_MASK;
+	return flit->data & node_mask();
 }
 
 /*******************************  RouterPortMaster  *******************************/
@@ -128,6 +156,11 @@ void RouterPortMaster::send(FLIT_t *flit, uint32 vch)
 }
 
 /*******************************  RouterPortSlave  *******************************/
+RouterPortSlave::RouterPortSlave(bool *readyStat_) : readyStat(readyStat_)
+{
+	buf.reserve(machine->vcbufsize);
+}
+
 bool RouterPortSlave::isReady(uint32 vch) {
 	if (readyStat != NULL) {
 		return readyStat[vch];
@@ -140,9 +173,7 @@ bool RouterPortSlave::isReady(uint32 vch) {
 
 void RouterPortSlave::clearBuf()
 {
-	std::queue<FLIT_ENTRY_t> empty;
-	// clear
-	std::swap(buf, empty);
+	buf.clear();
 }
 
 void RouterPortSlave::pushData(FLIT_t *flit, uint32 vch)
@@ -157,138 +188,296 @@ void RouterPortSlave::getData(FLIT_t *flit, uint32 *vch)
 {
 	FLIT_ENTRY_t data;
 	data = buf.front();
-	flit->data = data.flit.data;
-	flit->ftype = data.flit.ftype;
+	*flit = data.flit;
 	if (vch != NULL) *vch = data.vch;
 	buf.pop();
 }
 
 /*******************************  Router  *******************************/
-Router::Router(RouterPortMaster* localTx, RouterPortSlave* localRx, Router* upperRouter,
-				int myid_) : myid(myid_)
-{
-	//input ports
-	fromLocal = new RouterPortSlave(icLocalRdy); //ocLocalRdy is set by input channel
-	fromLower = new RouterPortSlave();
-	fromUpper = new RouterPortSlave();
-
-	//output ports
-	toLocal = new RouterPortMaster();
-	toLower = new RouterPortMaster();
-	toUpper = new RouterPortMaster();
+//order in which the channels are stepped and reported
+static const int port_order[PORT_COUNT] = {
+	LOCAL_PORT, UPPER_PORT, LOWER_PORT, NORTH_PORT, SOUTH_PORT
+};
 
-	//output channels
-	ocLocal = new OutputChannel(toLocal, false);
-	ocUpper = new OutputChannel(toUpper);
-	ocLower = new OutputChannel(toLower);
+Router::Router(RouterPortMaster* localTx, RouterPortSlave* localRx, int myid_)
+	: myid(myid_), topo(machine->topology), busy(true), last_step_cycle(0),
+	bypassed(false)
+{
+	port_count = topo->port_count();
+
+	bool *rdy[PORT_COUNT];
+	for (int i = 0; i < port_count; i++) {
+		//ports
+		//icRdy is set by the input channel and read by the sender
+		int flow = topo->flow_control(i);
+		rdy[i] = i == LOCAL_PORT || flow == FLOW_ONOFF ? icRdy[i] : NULL;
+		from[i] = new RouterPortSlave(rdy[i]);
+		to[i] = new RouterPortMaster();
+		//output channels (no flow control to the local module)
+		oc[i] = new OutputChannel(to[i], flow);
+	}
 
-	cb = new Crossbar(&myid, ocLocal, ocUpper, ocLower);
+	cb = new Crossbar(&myid, oc, port_count);
 
 	//input channels
-	icLocal = new InputChannel(fromLocal, cb, &myid, icLocalRdy);
-	icUpper = new InputChannel(fromUpper, cb, &myid);
-	icLower = new InputChannel(fromLower, cb, &myid);
-
-	cb->connectIC(icLocal, icUpper, icLower);
+	for (int i = 0; i < port_count; i++) {
+		ic[i] = new InputChannel(from[i], cb, i, &myid, topo, rdy[i]);
+	}
 
 	//make connections
-	if (upperRouter != NULL) {
-		upperRouter->toLower->connect(fromUpper);
-		toUpper->connect(upperRouter->fromLower);
+	if (localRx != NULL) {
+		to[LOCAL_PORT]->connect(localRx);
+	}
+	if (localTx != NULL) {
+		localTx->connect(from[LOCAL_PORT]);
 	}
-	toLocal->connect(localRx);
-	localTx->connect(fromLocal);
 
 }
 
 Router::~Router()
 {
-	delete fromLocal;
-	delete fromLower;
-	delete fromUpper;
-	delete toLocal;
-	delete toLower;
-	delete toUpper;
-	delete ocLocal;
-	delete ocUpper;
-	delete ocLower;
+	for (int i = 0; i < port_count; i++) {
+		delete from[i];
+		delete to[i];
+		delete oc[i];
+		delete ic[i];
+	}
 	delete cb;
-	delete icLocal;
-	delete icUpper;
-	delete icLower;
+}
+
+void Router::connect(uint32 port, Router *neighbor, uint32 neighbor_port)
+{
+	to[port]->connect(neighbor->from[neighbor_port]);
+	neighbor->to[neighbor_port]->connect(from[port]);
+	oc[port]->connectPeer(neighbor->oc[neighbor_port]);
+	neighbor->oc[neighbor_port]->connectPeer(oc[port]);
+}
+
+void Router::connect_remote(uint32 port, NocShmLink *link)
+{
+	to[port]->connect(link->get_out());
+	link->attach(from[port], oc[port]);
+	oc[port]->connectRemote(link);
 }
 
 void Router::reset()
 {
 
 	//input channels
-	icLocal->reset();
-	icUpper->reset();
-	icLower->reset();
+	for (int i = 0; i < port_count; i++) {
+		ic[port_order[i]]->reset();
+	}
 
 	//cb
 	cb->reset();
 
 	//output channels
-	ocLocal->reset();
-	ocUpper->reset();
-	ocLower->reset();
+	for (int i = 0; i < port_count; i++) {
+		oc[port_order[i]]->reset();
+	}
+
+	busy = true;
+}
+
+bool Router::portsHaveData() const
+{
+	for (int i = 0; i < port_count; i++) {
+		if (from[i]->haveData()) {
+			return true;
+		}
+	}
+	return false;
 }
 
 void Router::step()
 {
+	//the router is stepped several times a cycle (nif_bandwidth)
+	bool new_cycle = (int)machine->num_cycles > last_step_cycle;
+	if (new_cycle) {
+		last_step_cycle = machine->num_cycles;
+	}
+
+	//nothing changes in an idle router until a flit arrives at a port
+	if (bypassed || (!busy && !portsHaveData())) {
+		return;
+	}
+
+	HostProfScope prof(HOSTPROF_ROUTER);
+
 	// Router Pipeline
 	// |FIFO enqueu|->|Routing Computation|->|VC Allocation|->|Output|
 	// handle the stages in reverse order
 
 	//oc
-	ocLocal->step();
-	ocUpper->step();
-	ocLower->step();
+	for (int i = 0; i < port_count; i++) {
+		oc[port_order[i]]->step();
+	}
 
 	// //FIFO enqueue
-	icLocal->step();
-	icUpper->step();
-	icLower->step();
+	//the input channels which come first win the crossbar
+	for (int i = 0; i < port_count; i++) {
+		ic[port_order[i]]->step(new_cycle);
+	}
 
 	cb->step();
 
+	busy = !cb->idle();
+	for (int i = 0; i < port_count && !busy; i++) {
+		busy = !ic[i]->idle() || !oc[i]->idle();
+	}
 }
 
 void Router::report_router()
 {
-	int send_to_upper = ocUpper->get_send_flit_count();
-	int send_to_lower = ocLower->get_send_flit_count();
+	int total = 0;
+	for (int i = 1; i < port_count; i++) {
+		total += oc[port_order[i]]->get_send_flit_count();
+	}
 
 	fprintf(stderr, "\tRouter%d\n", myid);
-	fprintf(stderr, "\t\tTotal %d flits\n",
-		send_to_upper + send_to_lower);
-	fprintf(stderr, "\t\t\tTo Upper %d flits\n", send_to_upper);
-	fprintf(stderr, "\t\t\tTo Lower %d flits\n", send_to_lower);
+	fprintf(stderr, "\t\tTotal %d flits\n", total);
+	for (int i = 1; i < port_count; i++) {
+		std::string name = topo->port_name(port_order[i]);
+		name[0] = toupper(name[0]);
+		fprintf(stderr, "\t\t\tTo %s %d flits\n", name.c_str(),
+			oc[port_order[i]]->get_send_flit_count());
+	}
+
+	const OutputChannelStats &local = oc[LOCAL_PORT]->get_stats();
+	fprintf(stderr, "\t\tPackets to Local %llu (average latency %.3f cycles)\n",
+		(unsigned long long)local.packets, local.packets == 0 ? 0.0 :
+		(double)local.latency_cycles / (double)local.packets);
+	for (int i = 0; i < port_count; i++) {
+		int port = port_order[i];
+		std::string name = topo->port_name(port);
+		name[0] = toupper(name[0]);
+		int flow = oc[port]->get_flow_control();
+		fprintf(stderr, "\t\t%s port (%s flow control)\n", name.c_str(),
+			NocTopology::flow_control_name(flow));
+		fprintf(stderr, "\t\t\tCrossbar conflicts %llu, credit stalls %llu\n",
+			(unsigned long long)cb->get_conflicts()[port],
+			(unsigned long long)cb->get_credit_stalls()[port]);
+		const OutputChannelStats &o = oc[port]->get_stats();
+		if (flow == FLOW_ACK) {
+			fprintf(stderr, "\t\t\tACK flits %llu\n",
+				(unsigned long long)o.ack_flits);
+		}
+		if (flow == FLOW_ACK || flow == FLOW_CREDIT) {
+			fprintf(stderr, "\t\t\tAverage %s round trip %.3f cycles\n",
+				flow == FLOW_ACK ? "ACK" : "credit", o.acked_flits == 0 ? 0.0 :
+				(double)o.ack_rtt_cycles / (double)o.acked_flits);
+		}
+		const InputChannelStats &in = ic[port]->get_stats();
+		for (int v = 0; v < VCH_SIZE; v++) {
+			int last = ROUTER_OCC_HIST_SIZE - 1;
+			while (last > 0 && in.occupancy_hist[v][last] == 0) {
+				last--;
+			}
+			if (last == 0) {
+				//never used
+				continue;
+			}
+			fprintf(stderr, "\t\t\tVC%d: VSA stall %llu cycles, up to %u-", v,
+				(unsigned long long)in.vsa_stall[v], 1u << (last - 1));
+			if (last < ROUTER_OCC_HIST_SIZE - 1) {
+				fprintf(stderr, "%u", (1u << last) - 1);
+			}
+			fprintf(stderr, " flits buffered\n");
+		}
+	}
+}
+
+void Router::register_stats(StatsRegistry &stats, const std::string &prefix)
+{
+	for (int i = 0; i < port_count; i++) {
+		int port = port_order[i];
+		std::string name = prefix + "." + topo->port_name(port);
+		OutputChannel *c = oc[port];
+		stats.add_counter(name + ".flits", StatsRegistry::widen<int>([c]() {
+			return c->get_send_flit_count();
+		}));
+		stats.add_formula(name + ".utilization", name + ".flits", "cycles");
+		stats.add_counter(name + ".xbar_conflicts", &cb->get_conflicts()[port]);
+		stats.add_counter(name + ".credit_stalls", &cb->get_credit_stalls()[port]);
+
+		const OutputChannelStats &o = c->get_stats();
+		int flow = c->get_flow_control();
+		if (flow == FLOW_ACK) {
+			//the bandwidth of the link taken by the ACKs
+			stats.add_counter(name + ".ack_flits", &o.ack_flits);
+			stats.add_counter(name + ".ack_saturated", &o.ack_saturated);
+		}
+		if (flow == FLOW_ACK || flow == FLOW_CREDIT) {
+			stats.add_counter(name + ".acked_flits", &o.acked_flits);
+			stats.add_counter(name + ".ack_rtt_cycles", &o.ack_rtt_cycles);
+			stats.add_histogram(name + ".ack_rtt_hist", o.ack_rtt_hist,
+				ROUTER_LAT_HIST_SIZE);
+			stats.add_formula(name + ".average_ack_rtt", name + ".ack_rtt_cycles",
+				name + ".acked_flits");
+		} else if (flow == FLOW_NONE) {
+			stats.add_counter(name + ".packets", &o.packets);
+			stats.add_counter(name + ".latency_cycles", &o.latency_cycles);
+			stats.add_histogram(name + ".latency_hist", o.latency_hist,
+				ROUTER_LAT_HIST_SIZE);
+			stats.add_formula(name + ".average_latency", name + ".latency_cycles",
+				name + ".packets");
+		}
+
+		//the VC buffers of the input channel of the port
+		const InputChannelStats &in = ic[port]->get_stats();
+		for (int v = 0; v < VCH_SIZE; v++) {
+			std::string vc = name + ".vc" + std::to_string(v);
+			stats.add_counter(vc + ".flits", &o.vc_flits[v]);
+			stats.add_counter(vc + ".vsa_stall_cycles", &in.vsa_stall[v]);
+			const uint64 *bins = in.occupancy_hist[v];
+			std::vector<StatsRegistry::Getter> hist;
+			hist.push_back([&in, bins]() {
+				uint64 busy = 0;
+				for (int b = 1; b < ROUTER_OCC_HIST_SIZE; b++) {
+					busy += bins[b];
+				}
+				return machine->get_cycles() - in.since - busy;
+			});
+			for (int b = 1; b < ROUTER_OCC_HIST_SIZE; b++) {
+				hist.push_back([bins, b]() { return bins[b]; });
+			}
+			stats.add_histogram(vc + ".occupancy_hist", hist);
+		}
+	}
+}
 
+void Router::attach_eventtrace(EventTrace *trace, const std::string &process)
+{
+	for (int i = 0; i < port_count; i++) {
+		oc[port_order[i]]->attach_eventtrace(trace, process,
+			topo->port_name(port_order[i]));
+	}
 }
 
 /*******************************  InputChannel  *******************************/
-InputChannel::InputChannel(RouterPortSlave* iport_, Crossbar *cb_, int *xpos_, bool *ordy_)
-	: iport(iport_), xpos(xpos_), cb(cb_), ordy(ordy_)
+InputChannel::InputChannel(RouterPortSlave* iport_, Crossbar *cb_, uint32 in_port_,
+							int *xpos_, const NocTopology *topo_, bool *ordy_)
+	: iport(iport_), cb(cb_), in_port(in_port_), xpos(xpos_), topo(topo_), ordy(ordy_)
 {
-	for (int i = 0; i < VCH_SIZE; i++) {
-		vc_last_state_update_time[i] = 0;
-	}
 	bufMaxSize = machine->vcbufsize;
 	packetMaxSize = (machine->opt->option("dcachebsize")->num / 4) + 1;
+	for (int i = 0; i < VCH_SIZE; i++) {
+		ibuf[i].reserve(bufMaxSize);
+	}
+	ackbuf.reserve(packetMaxSize);
 };
 
 void InputChannel::reset()
 {
 	// clear
 	for (int i = 0; i < VCH_SIZE; i++) {
-		FBUFFER empty;
-		std::swap(ibuf[i], empty);
+		ibuf[i].clear();
 		vc_state[i] = VC_STATE_RC;
 		vc_next_state[i] = VC_STATE_RC;
 		request_pending[i] = false;
 	}
+	active_vcs = 0;
+	ackbuf.clear();
 	iport->clearBuf();
 	if (ordy != NULL) {
 		for (int i = 0; i < VCH_SIZE; i++) {
@@ -299,6 +488,8 @@ void InputChannel::reset()
 	holding = false;
 	grant_release_time = machine->num_cycles;
 
+	memset(&st, 0, sizeof(st));
+	st.since = machine->get_cycles();
 }
 
 bool InputChannel::isGranted(uint32 vch)
@@ -317,63 +508,79 @@ void InputChannel::release()
 	grant_release_time = machine->num_cycles;
 }
 
-void InputChannel::step()
+void InputChannel::step(bool new_cycle)
 {
 	FLIT_t flit;
 	uint32 recv_vch;
-	int i;
 	bool vc_hold = false;
-	int current_time = machine->num_cycles;
 
-	for (i = 0; i < VCH_SIZE; i++) {
+	if (idle()) {
+		return;
+	}
+
+	if (!ackbuf.empty()) {
+		flit = ackbuf.front();
+		cb->forwardAck(in_port, &flit);
+		ackbuf.pop();
+	}
+
+	//the other VCs are empty and their state does not change
+	for (uint32 vcs = active_vcs; vcs != 0; vcs &= vcs - 1) {
+		int i = __builtin_ctz(vcs);
 		if (!ibuf[i].empty()) {
+			//an idle channel has nothing in its buffers
+			if (new_cycle) {
+				st.occupancy_hist[i][RouterUtils::hist_bin(ibuf[i].size(),
+					ROUTER_OCC_HIST_SIZE)]++;
+			}
 			flit = ibuf[i].front();
-			if (flit.ftype == FTYPE_ACK1 || flit.ftype == FTYPE_ACK2) {
-				cb->forwardAck(this, &flit);
-				ibuf[i].pop();
-			} else {
-				switch (vc_state[i]) {
-					//Swtich Traversal
-					case VC_STATE_ST:
-						vc_hold = true;
-						if (vc_next_state[i] != VC_STATE_RC) {
-							ibuf[i].pop();
-							cb->send(this, &flit, i, send_port[i]);
-							if (flit.ftype == FTYPE_HEADTAIL || flit.ftype == FTYPE_TAIL) {
-								vc_next_state[i] = VC_STATE_RC;
-								//release grant
-								release();
-								cb->close(send_port[i]);
-							}
-						}
-						break;
-					//Virtual Channel Switch Allocation
-					case VC_STATE_VSA:
-						if (!isGranted(i) & !vc_hold) {
-							//if not granted & other vc does not use, request grant
-							request(i);
-							vc_hold = true;
-						} else if (isGranted(i) & cb->ready(this, i, send_port[i])) {
-							//granted & ready
-							vc_next_state[i] = VC_STATE_ST;
-							//grant holding
-							hold();
-							vc_hold = true;
-						}
-						break;
-					//Routing Computation
-					case VC_STATE_RC:
-						if (flit.ftype == FTYPE_HEAD || flit.ftype == FTYPE_HEADTAIL) {
-							vc_next_state[i] = VC_STATE_VSA;
-							send_port[i] = rtcomp(RouterUtils::extractDst(&flit));
+			switch (vc_state[i]) {
+				//Swtich Traversal
+				case VC_STATE_ST:
+					vc_hold = true;
+					if (vc_next_state[i] != VC_STATE_RC) {
+						ibuf[i].pop();
+						cb->send(in_port, &flit, i, send_port[i], send_vch[i]);
+						if (flit.ftype == FTYPE_HEADTAIL || flit.ftype == FTYPE_TAIL) {
+							vc_next_state[i] = VC_STATE_RC;
+							//release grant
+							release();
+							cb->close(send_port[i]);
 						}
-						break;
-				}
+					}
+					break;
+				//Virtual Channel Switch Allocation
+				case VC_STATE_VSA:
+					if (!isGranted(i) & !vc_hold) {
+						//if not granted & other vc does not use, request grant
+						request(i);
+						vc_hold = true;
+					} else if (isGranted(i) && cb->ready(in_port, send_vch[i], send_port[i])) {
+						//granted & ready
+						vc_next_state[i] = VC_STATE_ST;
+						//grant holding
+						hold();
+						vc_hold = true;
+					}
+					if (new_cycle && vc_next_state[i] == VC_STATE_VSA) {
+						st.vsa_stall[i]++;
+					}
+					break;
+				//Routing Computation
+				case VC_STATE_RC:
+					if (flit.ftype == FTYPE_HEAD || flit.ftype == FTYPE_HEADTAIL) {
+						vc_next_state[i] = VC_STATE_VSA;
+						send_port[i] = topo->route(*xpos, in_port,
+								RouterUtils::extractDst(&flit), i, cb, &send_vch[i]);
+					}
+					break;
 			}
 		}
-		if (current_time > vc_last_state_update_time[i]) {
+		if (new_cycle) {
 			vc_state[i] = vc_next_state[i];
-			vc_last_state_update_time[i] = current_time;
+		}
+		if (ibuf[i].empty() && vc_state[i] == vc_next_state[i]) {
+			active_vcs &= ~(1 << i);
 		}
 
 	}
@@ -409,95 +616,187 @@ void InputChannel::step()
 
 void InputChannel::pushData(FLIT_t *flit, uint32 vch)
 {
+	if (flit->ftype == FTYPE_ACK1 || flit->ftype == FTYPE_ACK2) {
+		ackbuf.push(*flit);
+		return;
+	}
+	if (in_port == LOCAL_PORT) {
+		flit->inject = machine->num_cycles;
+	}
 	ibuf[vch].push(*flit);
+	active_vcs |= 1 << vch;
 }
 
 /*******************************  OutputChannel  *******************************/
-OutputChannel::OutputChannel(RouterPortMaster *oport_, bool ackEnabled_)
-	: oport(oport_), ackEnabled(ackEnabled_)
+OutputChannel::OutputChannel(RouterPortMaster *oport_, int flow_)
+	: oport(oport_), flow(flow_), peer(NULL), remote(NULL), eventtrace(NULL)
 {
 	bufMaxSize = machine->vcbufsize;
 	packetMaxSize = (machine->opt->option("dcachebsize")->num / 4) + 1;
+	obuf.reserve(packetMaxSize);
+	iackbuf.reserve(packetMaxSize);
+	if (flow == FLOW_ACK || flow == FLOW_CREDIT) {
+		for (int i = 0; i < VCH_SIZE; i++) {
+			sent_cycles[i].reserve(bufMaxSize);
+		}
+	}
 };
 
+void OutputChannel::attach_eventtrace(EventTrace *trace,
+	const std::string &process, const std::string &port)
+{
+	eventtrace = trace;
+	trace_process = process;
+	trace_port = port;
+	for (int i = 0; i < VCH_SIZE; i++) {
+		// the tracks are made when the VC is used first
+		trace_track[i] = -1;
+		packet_flits[i] = 0;
+	}
+}
+
+void OutputChannel::trace_flit(FLIT_t *flit, uint32 vch)
+{
+	static const char *mtype_names[] = {"?", "single write", "block write",
+		"single read", "block read", "?", "?", "done"};
+
+	if (flit->ftype == FTYPE_HEAD || flit->ftype == FTYPE_HEADTAIL) {
+		head_cycle[vch] = machine->get_cycles();
+		head_data[vch] = flit->data;
+		packet_flits[vch] = 0;
+	}
+	packet_flits[vch]++;
+	if (flit->ftype != FTYPE_TAIL && flit->ftype != FTYPE_HEADTAIL) {
+		return;
+	}
+
+	if (trace_track[vch] < 0) {
+		trace_track[vch] = eventtrace->add_track(trace_process,
+			trace_port + ".vc" + std::to_string(vch));
+	}
+	FLIT_t head = {FTYPE_HEAD, 0, head_data[vch]};
+	uint32 addr, mtype, head_vch, src, dst;
+	RouterUtils::decode_headflit(&head, &addr, &mtype, &head_vch, &src, &dst);
+	char args[128];
+	snprintf(args, sizeof(args),
+		"\"src\":%u,\"dst\":%u,\"addr\":\"0x%x\",\"flits\":%d",
+		src, dst, addr, packet_flits[vch]);
+	eventtrace->span(trace_track[vch], mtype_names[mtype & 0x7],
+		head_cycle[vch], machine->get_cycles() + 1, args);
+}
+
 void OutputChannel::reset()
 {
-	std::queue<FLIT_ENTRY_t> empty_obuf;
-	std::swap(obuf, empty_obuf);
-	FBUFFER empty_ackbuf;
-	std::swap(iackbuf, empty_ackbuf);
+	obuf.clear();
+	iackbuf.clear();
 
 	for (int i = 0; i < VCH_SIZE; i++) {
 		readyStat[i] = true;
 		send_count[i] = 0;
 		ack_count[i] = 0;
+		credit_in[i] = 0;
+		sent_cycles[i].clear();
 	}
+	ack_vcs = 0;
+	credit_vcs = 0;
 	send_flit_count = 0;
+	memset(&st, 0, sizeof(st));
+}
+
+void OutputChannel::eject(FLIT_t *flit, uint32 vch)
+{
+	if (flit->ftype == FTYPE_HEAD || flit->ftype == FTYPE_HEADTAIL) {
+		head_inject[vch] = flit->inject;
+	}
+	if (flit->ftype == FTYPE_TAIL || flit->ftype == FTYPE_HEADTAIL) {
+		//the difference of the low 32 bits is wrap-around safe
+		uint32 latency = machine->num_cycles - head_inject[vch];
+		st.packets++;
+		st.latency_cycles += latency;
+		st.latency_hist[RouterUtils::hist_bin(latency, ROUTER_LAT_HIST_SIZE)]++;
+	}
 }
 
 void OutputChannel::ackSend()
 {
-	bool ackSendEn = false;
+	const uint32 former_vcs = (1 << (VCH_SIZE / 2)) - 1;
 	FLIT_t flit;
 	if (ackFormer()) {
-		for (int i = 0; i < VCH_SIZE / 2; i++) {
-			if (ack_count[i] != 0) {
-				ackSendEn = true;
-				break;
-			}
-		}
-		if (ackSendEn) {
+		if (ack_vcs & former_vcs) {
 			RouterUtils::make_ack_flit(&flit, FTYPE_ACK1, ack_count);
 			oport->send(&flit, ACK_VCH);
 			send_flit_count++;
+			st.ack_flits++;
 			for (int i = 0; i < VCH_SIZE / 2; i++) {
 				if (ack_count[i] > ACK_COUNT_MAX) {
+					st.ack_saturated++;
 					ack_count[i] -= ACK_COUNT_MAX;
 				} else {
 					ack_count[i] = 0;
+					ack_vcs &= ~(1 << i);
 				}
 			}
 		}
 	} else {
-		for (int i = VCH_SIZE / 2; i < VCH_SIZE; i++) {
-			if (ack_count[i] != 0) {
-				ackSendEn = true;
-				break;
-			}
-		}
-		if (ackSendEn) {
+		if (ack_vcs & ~former_vcs) {
 			RouterUtils::make_ack_flit(&flit, FTYPE_ACK2, &ack_count[VCH_SIZE / 2]);
 			oport->send(&flit, ACK_VCH);
 			send_flit_count++;
+			st.ack_flits++;
 			for (int i = VCH_SIZE / 2; i < VCH_SIZE; i++) {
 				if (ack_count[i] > ACK_COUNT_MAX) {
+					st.ack_saturated++;
 				} else {
 					ack_count[i] = 0;
+					ack_vcs &= ~(1 << i);
 				}
 			}
 		}
 	}
 
 }
+
+void OutputChannel::acknowledged(uint32 vch, int count)
+{
+	for (int n = 0; n < count && !sent_cycles[vch].empty(); n++) {
+		uint32 rtt = machine->num_cycles - sent_cycles[vch].front();
+		sent_cycles[vch].pop();
+		st.acked_flits++;
+		st.ack_rtt_cycles += rtt;
+		st.ack_rtt_hist[RouterUtils::hist_bin(rtt, ROUTER_LAT_HIST_SIZE)]++;
+	}
+}
+
 void OutputChannel::step()
 {
 	FLIT_ENTRY_t entry;
 	bool counter_change = false;
 	int recv_ack[VCH_SIZE];
 
+	if (idle()) {
+		return;
+	}
+
 	//send flit
 	if (!obuf.empty()) {
 		entry = obuf.front();
 		oport->send((FLIT_t*)(&entry.flit), entry.vch);
 		send_flit_count++;
+		st.vc_flits[entry.vch]++;
 		obuf.pop();
-		if (ackEnabled) {
+		if (eventtrace != NULL) {
+			trace_flit(&entry.flit, entry.vch);
+		}
+		if (flow == FLOW_ACK || flow == FLOW_CREDIT) {
             send_count[entry.vch]++;
             counter_change = true;
-        }
+			sent_cycles[entry.vch].push(machine->num_cycles);
+        } else if (flow == FLOW_NONE) {
+			eject(&entry.flit, entry.vch);
+		}
 	} else {
 		//return ACK packets
-		if (ackEnabled) {
+		if (flow == FLOW_ACK) {
 			ackSend();
 		}
 	}
@@ -510,12 +809,22 @@ void OutputChannel::step()
 		RouterUtils::decode_ack(&flit, recv_ack);
 		for (int i = 0; i < VCH_SIZE; i++) {
 			send_count[i] -= recv_ack[i];
+			acknowledged(i, recv_ack[i]);
 		}
 		counter_change = true;
 	}
 
+	//take the credits returned since the last step
+	for (uint32 vcs = credit_vcs; vcs != 0; vcs &= vcs - 1) {
+		int i = __builtin_ctz(vcs);
+		send_count[i] -= credit_in[i];
+		credit_in[i] = 0;
+		counter_change = true;
+	}
+	credit_vcs = 0;
+
 	//update ready signal
-	if (counter_change & ackEnabled) {
+	if (counter_change) {
 		for (int i = 0; i < VCH_SIZE; i++) {
 			if (bufMaxSize - send_count[i] >= packetMaxSize) {
 				readyStat[i] = true;
@@ -529,8 +838,7 @@ void OutputChannel::step()
 void OutputChannel::pushData(FLIT_t *flit, uint32 vch)
 {
 	FLIT_ENTRY_t entry;
-	entry.flit.ftype = flit->ftype;
-	entry.flit.data = flit->data;
+	entry.flit = *flit;
 	entry.vch = vch;
 	obuf.push(entry);
 }
@@ -542,167 +850,167 @@ void OutputChannel::pushAck(FLIT_t *flit)
 
 void OutputChannel::ackIncrement(uint32 vch)
 {
-	ack_count[vch]++;
+	//no ACK is returned to the local module, and the sender sees the
+	//buffer itself with on/off flow control
+	if (flow == FLOW_ACK) {
+		ack_count[vch]++;
+		ack_vcs |= 1 << vch;
+	} else if (flow == FLOW_CREDIT && peer != NULL) {
+		peer->returnCredit(vch);
+	} else if (flow == FLOW_CREDIT && remote != NULL) {
+		remote->returnCredit(vch);
+	}
+}
+
+void OutputChannel::returnCredit(uint32 vch)
+{
+	//an idle router takes the credits when it is stepped next, so the
+	//round trip is measured here
+	acknowledged(vch, 1);
+	credit_in[vch]++;
+	credit_vcs |= 1 << vch;
 }
 
 bool OutputChannel::ocReady(uint32 vch)
 {
-	if (ackEnabled) {
-		return readyStat[vch];
-	} else {
-		return true;//oport->slaveReady(vch);
+	switch (flow) {
+		case FLOW_ACK:
+		case FLOW_CREDIT:
+			return readyStat[vch];
+		case FLOW_ONOFF:
+			return oport->slaveReady(vch);
+		default:
+			return true;
 	}
-
 }
 /*******************************  Crossbar  *******************************/
+//for debug msg
+static const char *ic_to_string[PORT_COUNT] = {
+	"InputChannel(from Local)", "InputChannel(from Lower)", "InputChannel(from Upper)",
+	"InputChannel(from South)", "InputChannel(from North)"
+};
+static const char *oc_to_string[PORT_COUNT] = {
+	"OutputChannel(to Local)", "OutputChannel(to Lower)", "OutputChannel(to Upper)",
+	"OutputChannel(to South)", "OutputChannel(to North)"
+};
+
+Crossbar::Crossbar(int *node_id_, OutputChannel **oc_, int port_count_) :
+		node_id(node_id_), port_count(port_count_), flittrace(NULL)
+{
+	routermsg = machine->opt->option("routermsg")->flag;
+	for (int i = 0; i < port_count; i++) {
+		oc[i] = oc_[i];
+	}
+}
+
 void Crossbar::reset()
 {
 	sender_update_time = machine->num_cycles;
-	oc_last_sender[ocLocal] = NULL;
-	oc_last_sender[ocLower] = NULL;
-	oc_last_sender[ocUpper] = NULL;
-	close_pending[ocLocal] = false;
-	close_pending[ocLower] = false;
-	close_pending[ocUpper] = false;
+	for (int i = 0; i < port_count; i++) {
+		oc_last_sender[i] = NO_SENDER;
+		close_pending[i] = false;
+		conflicts[i] = 0;
+		credit_stalls[i] = 0;
+	}
+	closing = false;
 }
 
 void Crossbar::step()
 {
-	if (close_pending[ocLocal]) {
-		close_pending[ocLocal] = false;
-		oc_last_sender[ocLocal] = NULL;
-	}
-	if (close_pending[ocLower]) {
-		close_pending[ocLower] = false;
-		oc_last_sender[ocLower] = NULL;
+	if (!closing) {
+		return;
 	}
-	if (close_pending[ocUpper]) {
-		close_pending[ocUpper] = false;
-		oc_last_sender[ocUpper] = NULL;
+	closing = false;
+	for (int i = 0; i < port_count; i++) {
+		if (close_pending[i]) {
+			close_pending[i] = false;
+			oc_last_sender[i] = NO_SENDER;
+		}
 	}
 }
 
-Crossbar::Crossbar(int *node_id_, OutputChannel *ocLocal_, OutputChannel *ocUpper_, OutputChannel *ocLower_) :
-		node_id(node_id_), ocLocal(ocLocal_), ocUpper(ocUpper_), ocLower(ocLower_)
-{
-	oc_to_string[ocLocal] = "OutputChannel(to Local)";
-	oc_to_string[ocUpper] = "OutputChannel(to Upper)";
-	oc_to_string[ocLower] = "OutputChannel(to Lower)";
-};
-
-void Crossbar::connectIC(InputChannel *icLocal_, InputChannel *icUpper_, InputChannel *icLower_)
-{
-	icLocal = icLocal_;
-	icUpper = icUpper_;
-	icLower = icLower_;
-	ic_oc_map[icLocal] = ocLocal;
-	ic_oc_map[icUpper] = ocUpper;
-	ic_oc_map[icLower] = ocLower;
-	//for debug message
-	ic_to_string[icLocal] = "InputChannel(from Local)";
-	ic_to_string[icUpper] = "InputChannel(from Upper)";
-	ic_to_string[icLower] = "InputChannel(from Lower)";
-}
-
-void Crossbar::send(InputChannel* ic, FLIT_t *flit, uint32 vch, uint32 port)
+void Crossbar::send(uint32 in_port, FLIT_t *flit, uint32 vch, uint32 port, uint32 out_vch)
 {
-	OutputChannel* trans_oc;
+	if (port >= (uint32)port_count || in_port >= (uint32)port_count) abort();
 
 	//data transfer
-	switch (port) {
-		case LOCAL_PORT:
-			trans_oc = ocLocal;
-			break;
-		case LOWER_PORT:
-			trans_oc = ocLower;
-			break;
-		case UPPER_PORT:
-			trans_oc = ocUpper;
-			break;
-		default: abort();
-	}
-	trans_oc->pushData(flit, vch);
-
-	//ack count increment
-	try {
-		OutputChannel* oc = ic_oc_map.at(ic);
-		if (machine->opt->option("routermsg")->flag) {
-			fprintf(stderr, "%10d:\tRouter%d\t %s(VC%d) sends flit %X_%08X to %s\n", machine->num_cycles, *node_id,
-							ic_to_string[ic], vch, flit->ftype, flit->data, oc_to_string[trans_oc]);
+	oc[port]->pushData(flit, out_vch);
+
+	if (flittrace != NULL) {
+		FlitTraceRecord r = {};
+		r.cycle = machine->get_cycles();
+		r.data = flit->data;
+		r.router = *node_id;
+		r.in_port = in_port;
+		r.out_port = port;
+		r.vch = vch;
+		r.out_vch = out_vch;
+		r.ftype = flit->ftype;
+		r.kind = FLITTRACE_FLIT;
+		if (flit->ftype == FTYPE_HEAD || flit->ftype == FTYPE_HEADTAIL) {
+			uint32 addr, mtype, hvch, src, dst;
+			RouterUtils::decode_headflit(flit, &addr, &mtype, &hvch, &src, &dst);
+			r.src = src;
+			r.dst = dst;
+			r.mtype = mtype;
 		}
-		oc->ackIncrement(vch);
-	} catch (std::out_of_range&) {
-		fprintf(stderr, "Crossbar received request from unknown InputChannel\n");
-		abort();
+		flittrace->record(r);
 	}
 
+	//ack count increment
+	if (routermsg) {
+		fprintf(stderr, "%10d:\tRouter%d\t %s(VC%d) sends flit %X_%08llX to %s\n", machine->num_cycles, *node_id,
+						ic_to_string[in_port], vch, flit->ftype, (unsigned long long)flit->data,
+						oc_to_string[port]);
+	}
+	oc[in_port]->ackIncrement(vch);
 }
 
-bool Crossbar::ready(InputChannel* ic, uint32 vch, uint32 port)
+bool Crossbar::ready(uint32 in_port, uint32 vch, uint32 port)
 {
-	switch (port) {
-		case LOCAL_PORT:
-			if (ocLocal->ocReady(vch)) {
-				if (oc_last_sender[ocLocal] == NULL) {
-					oc_last_sender[ocLocal] = ic;
-				}
-				return oc_last_sender[ocLocal] == ic;
-			} else {
-				return false;
-			}
-			break;
-		case LOWER_PORT:
-			if (ocLower->ocReady(vch)) {
-				if (oc_last_sender[ocLower] == NULL) {
-					oc_last_sender[ocLower] = ic;
-				}
-				return oc_last_sender[ocLower] == ic;
-			} else {
-				return false;
-			}
-			break;
-		case UPPER_PORT:
-			if (ocUpper->ocReady(vch)) {
-				if (oc_last_sender[ocUpper] == NULL) {
-					oc_last_sender[ocUpper] = ic;
-				}
-				return oc_last_sender[ocUpper] == ic;
-			} else {
-				return false;
-			}
-			break;
-		default: abort();
+	if (port >= (uint32)port_count) abort();
+
+	if (oc[port]->ocReady(vch)) {
+		if (oc_last_sender[port] == NO_SENDER) {
+			oc_last_sender[port] = in_port;
+		}
+		if (oc_last_sender[port] != (int)in_port) {
+			conflicts[port]++;
+			return false;
+		}
+		return true;
+	} else {
+		credit_stalls[port]++;
+		return false;
 	}
 }
 
 void Crossbar::close(uint32 port)
 {
-	//data transfer
-	switch (port) {
-		case LOCAL_PORT:
-			close_pending[ocLocal] = true;
-			break;
-		case LOWER_PORT:
-			close_pending[ocLower] = true;
-			break;
-		case UPPER_PORT:
-			close_pending[ocUpper] = true;
-			break;
-		default: abort();
-	}
-}
-void Crossbar::forwardAck(InputChannel* ic, FLIT_t *flit)
-{
-	try {
-		OutputChannel* oc = ic_oc_map.at(ic);
-		oc->pushAck(flit);
-		if (machine->opt->option("routermsg")->flag) {
-			fprintf(stderr, "%10d:\tRouter%d\t forwards ACK flit %X_%08X to %s\n",
-							 machine->num_cycles, *node_id, flit->ftype, flit->data, oc_to_string[oc]);
-		}
-	} catch (std::out_of_range&) {
-		fprintf(stderr, "Crossbar forwarded ack flit from unknown InputChannel\n");
-		abort();
-	}
+	if (port >= (uint32)port_count) abort();
+	close_pending[port] = true;
+	closing = true;
+}
 
-}
\ No newline at end of file
+void Crossbar::forwardAck(uint32 in_port, FLIT_t *flit)
+{
+	if (in_port >= (uint32)port_count) abort();
+
+	oc[in_port]->pushAck(flit);
+	if (flittrace != NULL) {
+		FlitTraceRecord r = {};
+		r.cycle = machine->get_cycles();
+		r.data = flit->data;
+		r.router = *node_id;
+		r.in_port = FLITTRACE_NO_PORT;
+		r.out_port = in_port;
+		r.ftype = flit->ftype;
+		r.kind = FLITTRACE_ACK;
+		flittrace->record(r);
+	}
+	if (routermsg) {
+		fprintf(stderr, "%10d:\tRouter%d\t forwards ACK flit %X_%08llX to %s\n",
+						 machine->num_cycles, *node_id, flit->ftype, (unsigned long long)flit->data,
+						 oc_to_string[in_port]);
+	}
+}
@@ -23,8 +23,14 @@
 
 #include "types.h"
 #include "vmips.h"
-#include <queue>
-#include <map>
+#include <cstddef>
+#include <string>
+
+class StatsRegistry;
+class EventTrace;
+class FlitTrace;
+class NocTopology;
+class NocShmLink;
 
 //Ftype
 #define FTYPE_IDLE		0x0
@@ -43,14 +49,14 @@
 #define MTYPE_DONE		0x7
 
 //Router formats
-#define FLIT_DST_MASK		0x3 //0011
-#define FLIT_SRC_LSB		2
-#define FLIT_SRC_MASK		0xC //1100
-#define FLIT_VCH_LSB		4
-#define FLIT_VCH_MASK		0x70 //0111_0000
-#define FLIT_MT_LSB			7
-#define FLIT_MT_MASK		0x380 //11_1000_0000
-#define FLIT_MEMA_LSB		10
+//head flit: |addr(22bit)|mtype(3bit)|vch(3bit)|src|dst|
+//src and dst have node_bits bits (2 by default), so the head flit is
+//wider than 32bit for more than 4 nodes
+#define FLIT_NODE_BITS_DEFAULT	2
+#define FLIT_NODE_BITS_MAX	5
+#define FLIT_VCH_BITS		3
+#define FLIT_MT_BITS		3
+#define FLIT_MEMA_MASK		0x3FFFFF
 #define FLIT_ACK_ENTRY		4
 #define FLIT_ACK_CNT_BIT	4
 #define ACK_COUNT_MAX		((1 << FLIT_ACK_CNT_BIT) - 1)
@@ -63,15 +69,29 @@
 #define VC_STATE_VSA	1
 #define VC_STATE_ST		2
 
+//Ports: LOWER/UPPER lead to larger/smaller node IDs, i.e. +X/-X in a mesh
 #define LOCAL_PORT		0
 #define LOWER_PORT		1
 #define UPPER_PORT		2
+#define SOUTH_PORT		3 //+Y (mesh and torus only)
+#define NORTH_PORT		4 //-Y
+#define PORT_COUNT		5
+#define NO_SENDER		-1
 
 #define NOONE_GRANTED	-1
 
+//statistics have log2 bins: 0, 1, 2-3, 4-7, ...
+#define ROUTER_OCC_HIST_SIZE	8	//flits in a VC buffer
+#define ROUTER_LAT_HIST_SIZE	16	//cycles
+
+typedef uint64 flit_data_t;
+
 struct FLIT_t {
 	uint32 ftype;
-	uint32 data;
+	//low 32 bits of the cycle in which the flit entered the network
+	//from a local module (for the statistics only)
+	uint32 inject;
+	flit_data_t data;
 };
 
 struct FLIT_ENTRY_t
@@ -80,29 +100,89 @@ struct FLIT_ENTRY_t
 	uint32 vch;
 };
 
-typedef std::queue<FLIT_t> FBUFFER;
+/* FIFO on a circular array, which is sized by reserve() at setup so that
+ * the router does not allocate while it steps. The capacity is a power
+ * of two; it is doubled only if the flow control lets more flits in than
+ * were reserved for.
+ */
+template <typename T>
+class FlitRing {
+public:
+	FlitRing() : buf(NULL), mask(0), head(0), count(0) {};
+	~FlitRing() { delete [] buf; };
+	FlitRing(const FlitRing &) = delete;
+	FlitRing &operator=(const FlitRing &) = delete;
+
+	void reserve(size_t capacity) {
+		size_t n = 1;
+		while (n < capacity) n <<= 1;
+		if (buf == NULL || n > mask + 1) resize(n);
+	};
+
+	bool empty() const { return count == 0; };
+	size_t size() const { return count; };
+	T &front() { return buf[head]; };
+	void push(const T &item) {
+		if (buf == NULL || count > mask) resize(buf == NULL ? 1 : (mask + 1) * 2);
+		buf[(head + count) & mask] = item;
+		count++;
+	};
+	void pop() { head = (head + 1) & mask; count--; };
+	void clear() { head = count = 0; };
+
+private:
+	T *buf;
+	size_t mask;
+	size_t head, count;
+
+	void resize(size_t n) {
+		T *nbuf = new T[n];
+		for (size_t i = 0; i < count; i++) {
+			nbuf[i] = buf[(head + i) & mask];
+		}
+		delete [] buf;
+		buf = nbuf;
+		mask = n - 1;
+		head = 0;
+	};
+};
+
+typedef FlitRing<FLIT_t> FBUFFER;
 
 class RouterUtils {
+private:
+	static int node_bits;
+	static int src_lsb, vch_lsb, mt_lsb, mema_lsb;
 public:
+	static void set_node_bits(int bits);
+	static int get_node_bits() { return node_bits; }
+	static uint32 node_mask() { return (1 << node_bits) - 1; }
+
 	static void make_head_flit(FLIT_t* flit, uint32 addr, uint32 mtype, uint32 vch, uint32 src,
 								uint32 dst, bool tail = false);
-	static void make_data_flit(FLIT_t* flit, uint32 data, bool tail = false);
+	static void make_data_flit(FLIT_t* flit, flit_data_t data, bool tail = false);
 	static uint32 extractDst(FLIT_t* flit);
 	static void make_ack_flit(FLIT_t *flit, uint32 ftype, int *cnt);
 	static void decode_ack(FLIT_t* flit, int *cnt);
 
 	static void decode_headflit(FLIT_t* flit, uint32 *addr, uint32 *mtype, uint32 *vch, uint32 *src,
 								uint32 *dst);
+
+	//bin of VALUE in a log2 histogram of SIZE bins
+	static int hist_bin(uint64 value, int size) {
+		int bin = 0;
+		while (value >> bin && bin < size - 1) bin++;
+		return bin;
+	}
 };
 
 class RouterPortSlave {
 private:
 	bool *readyStat;
-	std::queue<FLIT_ENTRY_t> buf;
+	FlitRing<FLIT_ENTRY_t> buf;
 public:
 	//Constructor
-	RouterPortSlave(bool *readyStat_) : readyStat(readyStat_) {};
-	RouterPortSlave() : readyStat(NULL) {};
+	RouterPortSlave(bool *readyStat_ = NULL);
 	~RouterPortSlave() {};
 
 	void clearBuf();
@@ -113,7 +193,7 @@ public:
 	void pushData(FLIT_t *flit, uint32 vch);
 
 	//used by router/core
-	bool haveData() { return !buf.empty(); } ;
+	bool haveData() const { return !buf.empty(); } ;
 	void getData(FLIT_t *flit, uint32 *vch = NULL);
 
 };
@@ -127,94 +207,172 @@ public:
 	~RouterPortMaster() {};
 
 	void connect(RouterPortSlave* slave_);
+	bool isConnected() { return connectedSlave != NULL; };
 	void send(FLIT_t *flit, uint32 vch);
 	bool slaveReady(uint32 vch);
 
 };
 
 
+struct OutputChannelStats {
+	uint64 vc_flits[VCH_SIZE];
+	//packets ejected to the local module, from the injection of the
+	//head flit to the ejection of the tail flit
+	uint64 packets, latency_cycles;
+	uint64 latency_hist[ROUTER_LAT_HIST_SIZE];
+	//from sending a flit to the return of its ACK
+	uint64 acked_flits, ack_rtt_cycles;
+	uint64 ack_rtt_hist[ROUTER_LAT_HIST_SIZE];
+	//ACK flits which could not return the whole count of a VC
+	uint64 ack_saturated;
+	uint64 ack_flits;
+};
+
 class OutputChannel {
 private:
 	bool readyStat[VCH_SIZE];
 	RouterPortMaster *oport;
 
 	//for register emulation
-	std::queue<FLIT_ENTRY_t> obuf;
+	FlitRing<FLIT_ENTRY_t> obuf;
+
+	//flow control of the link (FLOW_* in topology.h)
+	int flow;
+	int send_count[VCH_SIZE]; //cnt: flits not acknowledged yet
+	int bufMaxSize;
+	int packetMaxSize;
 
 	//for piggyback (ACK)
-	bool ackEnabled;
 	FBUFFER iackbuf;
-	int send_count[VCH_SIZE]; //cnt
 	int ack_count[VCH_SIZE]; //oack
-	int bufMaxSize;
-	int packetMaxSize;
+	uint32 ack_vcs; //bitmap of the VCs whose ack_count is not zero
 
 	bool ackFormer() { return machine->num_cycles % 2 == 0; }
 	void ackSend();
 
+	//for credits: the channel at the other end of the link and the
+	//credits returned by it, which are taken at the next step
+	OutputChannel *peer;
+	int credit_in[VCH_SIZE];
+	uint32 credit_vcs;
+	//instead of the peer for a link to another process (cube_shm)
+	NocShmLink *remote;
+
+	//round trip of COUNT flits of VCH which left the buffer at the other end
+	void acknowledged(uint32 vch, int count);
+
 	// for report
 	int send_flit_count;
+
+	// for statistics
+	OutputChannelStats st;
+	FlitRing<uint32> sent_cycles[VCH_SIZE]; //of the flits waiting for ACKs/credits
+	uint32 head_inject[VCH_SIZE];
+	void eject(FLIT_t *flit, uint32 vch);
+
+	// for timeline of the packets
+	EventTrace *eventtrace;
+	std::string trace_process, trace_port;
+	int trace_track[VCH_SIZE];
+	uint64 head_cycle[VCH_SIZE];
+	flit_data_t head_data[VCH_SIZE];
+	int packet_flits[VCH_SIZE];
+	void trace_flit(FLIT_t *flit, uint32 vch);
 public:
-	OutputChannel(RouterPortMaster *oport_, bool ackEnabled_ = true);
+	OutputChannel(RouterPortMaster *oport_, int flow_);
 	~OutputChannel() {};
 
 	void reset();
 	void step();
 	void pushData(FLIT_t *flit, uint32 vch);
 	void pushAck(FLIT_t *flit);
+	//a flit from the other end of the link left the input buffer
 	void ackIncrement(uint32 vch);
+	void connectPeer(OutputChannel *peer_) { peer = peer_; };
+	void connectRemote(NocShmLink *remote_) { remote = remote_; };
+	void returnCredit(uint32 vch);
 	bool ocReady(uint32 vch);
+	//nothing to send and no ACK or credit to handle
+	bool idle() const {
+		return obuf.empty() && iackbuf.empty() && ack_vcs == 0 && credit_vcs == 0;
+	};
 	int get_send_flit_count() { return send_flit_count; };
+	int get_flow_control() const { return flow; };
+	const OutputChannelStats &get_stats() const { return st; };
+	void attach_eventtrace(EventTrace *trace, const std::string &process,
+		const std::string &port);
 
 };
 
-class InputChannel;
-
 class Crossbar {
 private:
 	int *node_id;
-	OutputChannel *ocLocal, *ocUpper, *ocLower;
-	InputChannel *icLocal, *icUpper, *icLower;
 
-	int sender_update_time;
-	std::map<OutputChannel*, InputChannel*> oc_last_sender;
-	std::map<OutputChannel*, bool> close_pending;
-
-	//direct mapping
-	std::map<InputChannel*, OutputChannel*> ic_oc_map;
+	//indexed by port number
+	int port_count;
+	OutputChannel *oc[PORT_COUNT];
+	int oc_last_sender[PORT_COUNT]; //input port or NO_SENDER
+	bool close_pending[PORT_COUNT];
+	bool closing; //any of close_pending is set
 
-	//for debug msg
-	std::map<OutputChannel*, const char*> oc_to_string;
-	std::map<InputChannel*, const char*> ic_to_string;
+	int sender_update_time;
+	bool routermsg;
+	FlitTrace *flittrace; //NULL if not recorded
 
+	//refused requests for an output port (statistics)
+	uint64 conflicts[PORT_COUNT]; //the port is locked by another input
+	uint64 credit_stalls[PORT_COUNT]; //no room on the VC of the next router
 
 public:
-	Crossbar(int *node_id_, OutputChannel *ocLocal_, OutputChannel *ocUpper_, OutputChannel *ocLower_);
-	~Crossbar() { ic_oc_map.clear(); ic_to_string.clear(); };
+	Crossbar(int *node_id_, OutputChannel **oc_, int port_count_);
+	~Crossbar() {};
 
 	void reset();
 	void step();
 
-	void send(InputChannel* ic, FLIT_t *flit, uint32 vch, uint32 port);
-	void forwardAck(InputChannel* ic, FLIT_t *flit);
+	//the ACK and the data from an input port go back through the output
+	//channel of the same port. A flit leaves on OUT_VCH, which differs
+	//from VCH on the wrap-around links of a torus.
+	void send(uint32 in_port, FLIT_t *flit, uint32 vch, uint32 port, uint32 out_vch);
+	void forwardAck(uint32 in_port, FLIT_t *flit);
 
-	void connectIC(InputChannel *icLocal_, InputChannel *icUpper_, InputChannel *icLower_);
-	bool ready(InputChannel* ic, uint32 vch, uint32 port);
+	bool ready(uint32 in_port, uint32 vch, uint32 port);
 	void close(uint32 port);
+	bool idle() const { return !closing; };
+	const uint64 *get_conflicts() const { return conflicts; };
+	const uint64 *get_credit_stalls() const { return credit_stalls; };
+	void attach_flittrace(FlitTrace *trace) { flittrace = trace; };
+
+	//for adaptive routing: PORT can take a packet now
+	bool portFree(uint32 vch, uint32 port) {
+		return oc_last_sender[port] == NO_SENDER && oc[port]->ocReady(vch);
+	}
 
 };
 
+struct InputChannelStats {
+	//cycles with 1, 2-3, ... flits in the VC buffer; the empty cycles
+	//are the rest of the cycles since SINCE
+	uint64 occupancy_hist[VCH_SIZE][ROUTER_OCC_HIST_SIZE];
+	//cycles in VSA without getting the crossbar
+	uint64 vsa_stall[VCH_SIZE];
+	uint64 since;
+};
+
 class InputChannel {
 private:
 	RouterPortSlave *iport;
 	Crossbar *cb;
+	uint32 in_port;
 	int *xpos;
+	const NocTopology *topo;
 	bool *ordy;
 
 	//for vc
 	int vc_state[VCH_SIZE];
 	int vc_next_state[VCH_SIZE];
-	int vc_last_state_update_time[VCH_SIZE];
+	//bitmap of the VCs which have flits or a state to update
+	uint32 active_vcs;
 	int granted_vc;
 	int grant_release_time;
 	bool request_pending[VCH_SIZE];
@@ -222,13 +380,12 @@ private:
 
 	//for fifo
 	FBUFFER ibuf[VCH_SIZE];
+	//ACKs do not queue behind the data, which may wait for these ACKs
+	FBUFFER ackbuf;
 
 	//for rtcomp
 	uint32 send_port[VCH_SIZE];
-	uint32 rtcomp(uint32 dst) {
-		return dst == *xpos ? LOCAL_PORT :
-			   dst > *xpos  ? LOWER_PORT : UPPER_PORT;
-	}
+	uint32 send_vch[VCH_SIZE];
 
 	//for vc mux
 	void request(uint32 vch) { request_pending[vch] = true; }
@@ -239,14 +396,22 @@ private:
 	int bufMaxSize;
 	int packetMaxSize;
 
+	InputChannelStats st;
+
 public:
 	//constructor
-	InputChannel(RouterPortSlave* iport_, Crossbar *cb_, int *xpos_, bool *ordy_ = NULL);
+	InputChannel(RouterPortSlave* iport_, Crossbar *cb_, uint32 in_port_, int *xpos_,
+					const NocTopology *topo_, bool *ordy_ = NULL);
 	~InputChannel() {};
 
 	void pushData(FLIT_t *flit, uint32 vch);
 	void reset();
-	void step();
+	//the VC states advance only at the first step of a cycle
+	void step(bool new_cycle);
+	bool idle() const {
+		return active_vcs == 0 && ackbuf.empty() && !iport->haveData();
+	};
+	const InputChannelStats &get_stats() const { return st; };
 
 };
 
@@ -255,18 +420,30 @@ public:
 class Router {
 private:
 	int myid;
+	const NocTopology *topo;
+	int port_count;
 
-	//router modules
-	InputChannel *icLocal, *icUpper, *icLower;
-	OutputChannel *ocLocal, *ocUpper, *ocLower;
+	//router modules (indexed by port number)
+	InputChannel *ic[PORT_COUNT];
+	OutputChannel *oc[PORT_COUNT];
 	Crossbar *cb;
 
-	//signals between modules
-	bool icLocalRdy[VCH_SIZE];
+	//signals between modules: the ready signals of the VCs of the input
+	//channels of the local port and the ports with on/off flow control
+	bool icRdy[PORT_COUNT][VCH_SIZE];
+
+	//activity: an idle router is not stepped until a flit arrives
+	bool busy;
+	int last_step_cycle;
+	bool portsHaveData() const;
+
+	//the packets are carried by the transaction-level model
+	bool bypassed;
 
 public:
 	//Constructor
-	Router(RouterPortMaster* localTx, RouterPortSlave* localRx,	Router* upperRouter, int myid_ = 0);
+	//localTx/localRx may be NULL for a router without local module
+	Router(RouterPortMaster* localTx, RouterPortSlave* localRx, int myid_ = 0);
 	~Router();
 
 	// control flow
@@ -274,12 +451,23 @@ public:
 	void reset();
 
 	//Ports
-	RouterPortSlave *fromLocal, *fromLower, *fromUpper;
-	RouterPortMaster *toLocal, *toLower, *toUpper;
+	RouterPortSlave *from[PORT_COUNT];
+	RouterPortMaster *to[PORT_COUNT];
+
+	//make a link from PORT of this router to NEIGHBOR_PORT of NEIGHBOR
+	//and the reverse one
+	void connect(uint32 port, Router *neighbor, uint32 neighbor_port);
+	//make a link from PORT to a router in another process
+	void connect_remote(uint32 port, NocShmLink *link);
 
 	void setID(int id) { myid = id; };
+	void set_bypassed(bool bypassed_) { bypassed = bypassed_; };
 
 	void report_router();
+	void register_stats(StatsRegistry &stats, const std::string &prefix);
+	void attach_eventtrace(EventTrace *trace, const std::string &process);
+	//record the flits through the crossbar
+	void attach_flittrace(FlitTrace *trace) { cb->attach_flittrace(trace); };
 };
 
 
@@ -25,6 +25,9 @@
 #include "vmips.h"
 #include "options.h"
 #include "accelerator.h"
+#include "hostprof.h"
+#include "mapper.h"
+#include "topology.h"
 
 /*******************************  RouterIOReg  *******************************/
 RouterIOReg::RouterIOReg(RouterInterface *_rtif) :
@@ -43,9 +46,10 @@ RouterIOReg::~RouterIOReg()
 void RouterIOReg::clear_reg() {
 	//init IO regs
 	abort = 0;
+	dma_desc = 0;
 	*config = {0, {0,0,0}, INIT_IREADY, {0,0,0},
 				INIT_DONEDMAC_STAT, INIT_DONEDMAC_STAT,
-				INIT_DONEDMAC_MASK, INIT_DONEDMAC_MASK};
+				INIT_DONEDMAC_MASK, INIT_DONEDMAC_MASK, 0};
 }
 
 //convert binary to Boolean array
@@ -75,7 +79,13 @@ uint32 RouterIOReg::bool2bin(bool *boolarray, int len)
 //ready signal to mapper(client)
 bool RouterIOReg::ready(uint32 offset, int32 mode, DeviceExc *client)
 {
-	return (offset == ROUTER_ABORT_OFFSET) || !rtif->isBusy();
+	//OFFSET is the physical address here
+	offset -= getBase();
+	if (offset == ROUTER_ABORT_OFFSET || offset == ROUTER_DMA_STAT_OFFSET ||
+		offset == ROUTER_DMA_COUNT_OFFSET) {
+		return true;
+	}
+	return !rtif->isBusy() && !rtif->isDMABusy();
 }
 
 //read from client
@@ -108,20 +118,35 @@ uint32 RouterIOReg::fetch_word(uint32 offset, int mode, DeviceExc *client)
 			return config->int_vch[2];
 			break;
 		case ROUTER_DONE_STAT_OFFSET:
-			return bool2bin(config->done_status, REMOTE_NODE_COUNT);
+			return bool2bin(config->done_status, RouterUtils::node_mask());
 			break;
 		case ROUTER_DONE_MASK_OFFSET:
-			return bool2bin(config->done_mask, REMOTE_NODE_COUNT);
+			return bool2bin(config->done_mask, RouterUtils::node_mask());
 			break;
 		case ROUTER_DMAC_STAT_OFFSET:
-			return bool2bin(config->dmac_status, REMOTE_NODE_COUNT);
+			return bool2bin(config->dmac_status, RouterUtils::node_mask());
 			break;
 		case ROUTER_DMAC_MASK_OFFSET:
-			return bool2bin(config->dmac_mask, REMOTE_NODE_COUNT);
+			return bool2bin(config->dmac_mask, RouterUtils::node_mask());
 			break;
 		case ROUTER_ABORT_OFFSET:
 			return abort;
 			break;
+		case ROUTER_WINDOW_BASE_OFFSET:
+			return config->window_base;
+			break;
+		case ROUTER_DMA_DESC_OFFSET:
+			return dma_desc;
+			break;
+		case ROUTER_DMA_CTRL_OFFSET:
+			return rtif->dmaCtrl();
+			break;
+		case ROUTER_DMA_STAT_OFFSET:
+			return rtif->dmaStatus();
+			break;
+		case ROUTER_DMA_COUNT_OFFSET:
+			return rtif->dmaCount();
+			break;
 		default:
 			client->exception(DBE, DATALOAD);
 			return 0xFFFFFFFF;
@@ -131,12 +156,14 @@ uint32 RouterIOReg::fetch_word(uint32 offset, int mode, DeviceExc *client)
 //write from client
 void RouterIOReg::store_word(uint32 offset, uint32 data, DeviceExc *client)
 {
-	bool clear_flag[REMOTE_NODE_COUNT];
+	bool clear_flag[REMOTE_NODE_MAX];
+	//one bit per remote node
+	int remote_nodes = RouterUtils::node_mask();
 
 	// Write to IO Regs
 	switch(offset) {
 		case ROUTER_ID_OFFSET:
-			config->router_id = data & ROUTER_ID_BITMASK;
+			config->router_id = data & RouterUtils::node_mask();
 			break;
 		case ROUTER_DVCH_NODE0_OFFSET:
 			config->data_vch[0] = data & ROUTER_DVCH_NODE0_BITMASK;
@@ -160,22 +187,22 @@ void RouterIOReg::store_word(uint32 offset, uint32 data, DeviceExc *client)
 			config->int_vch[2] = data & ROUTER_INTVCH_NODE2_BITMASK;
 			break;
 		case ROUTER_DONE_STAT_OFFSET:
-			bin2bool(data & ROUTER_DONE_STAT_BITMASK, clear_flag, REMOTE_NODE_COUNT);
-			for (int i = 0; i < REMOTE_NODE_COUNT; i++) {
+			bin2bool(data, clear_flag, remote_nodes);
+			for (int i = 0; i < remote_nodes; i++) {
 				if (clear_flag[i]) config->done_status[i] = false;
 			}
 			break;
 		case ROUTER_DONE_MASK_OFFSET:
-			bin2bool(data & ROUTER_DONE_MASK_BITMASK, config->done_mask, REMOTE_NODE_COUNT);
+			bin2bool(data, config->done_mask, remote_nodes);
 			break;
 		case ROUTER_DMAC_STAT_OFFSET:
-			bin2bool(data & ROUTER_DMAC_STAT_BITMASK, clear_flag, REMOTE_NODE_COUNT);
-			for (int i = 0; i < REMOTE_NODE_COUNT; i++) {
+			bin2bool(data, clear_flag, remote_nodes);
+			for (int i = 0; i < remote_nodes; i++) {
 				if (clear_flag[i]) config->dmac_status[i] = false;
 			}
 			break;
 		case ROUTER_DMAC_MASK_OFFSET:
-			bin2bool(data & ROUTER_DMAC_MASK_BITMASK, config->dmac_mask, REMOTE_NODE_COUNT);
+			bin2bool(data, config->dmac_mask, remote_nodes);
 			break;
 		case ROUTER_ABORT_OFFSET:
 			//reset signal handling here
@@ -190,6 +217,29 @@ void RouterIOReg::store_word(uint32 offset, uint32 data, DeviceExc *client)
 			}
 			abort = data & ROUTER_ABORT_BITMASK;
 			break;
+		case ROUTER_WINDOW_BASE_OFFSET:
+			//the window of node 1 must stay in the network
+			if (data != 0 &&
+				data >= (uint32)machine->topology->node_count() - 1) {
+				if (machine->opt->option("dbemsg")->flag) {
+					fprintf(stderr, "window base %u is out of the network"
+							" of %d nodes\n", data,
+							machine->topology->node_count());
+				}
+				client->exception(DBE, DATASTORE);
+				break;
+			}
+			config->window_base = data;
+			break;
+		case ROUTER_DMA_DESC_OFFSET:
+			dma_desc = data;
+			break;
+		case ROUTER_DMA_CTRL_OFFSET:
+			rtif->dmaStart(dma_desc, data);
+			break;
+		case ROUTER_DMA_STAT_OFFSET:
+			rtif->dmaClear(data);
+			break;
 		default:
 			client->exception(DBE, DATASTORE);
 			break;
@@ -204,6 +254,22 @@ RouterRange::RouterRange(RouterInterface *_rtif, bool block_en) :
 //ready signal to mapper(client)
 bool RouterRange::ready(uint32 offset, int32 mode, DeviceExc *client) {
 
+	if (rtif->isDMABusy() && (mode == DATALOAD || mode == DATASTORE)) {
+		//wait until the block DMA is done
+		return false;
+	}
+
+	if ((mode == DATALOAD || mode == DATASTORE) &&
+		!rtif->isInNetwork(offset - getBase())) {
+		//Bus Error
+		if (machine->opt->option("dbemsg")->flag) {
+			fprintf(stderr, "no node is behind physical address 0x%x"
+					" via router\n", offset);
+		}
+		client->exception(DBE, mode);
+		return false;
+	}
+
 	if (mode == DATALOAD) {
 		if (!rtif->isBusy()) {
 			//in case of idle, kick router
@@ -253,16 +319,29 @@ void RouterRange::store_word(uint32 offset, uint32 data, DeviceExc *client) {
 }
 
 /*******************************  RouterInterface  *******************************/
-RouterInterface::RouterInterface() {
+RouterInterface::RouterInterface(Mapper &m) : bus(&m) {
 	next_state = state = RT_STATE_IDLE;
 	packet_size = machine->opt->option("dcachebsize")->num / 4; //word size
 	registed_router_id = 0;
+	dma_state = RT_DMA_IDLE;
+	dma_inten = dma_done = dma_adrerr = dma_buserr = false;
+	dma_granted = false;
+	dma_count = 0;
+	exception_pending = false;
+	dma_bus_weight = machine->opt->option("bus_weight_rtif")->num;
+
+	//room for a block being sent and the next one loaded by the DMA
+	send_fifo.reserve(packet_size * 2);
+	recv_fifo.reserve(packet_size);
 
 	//make router ports
 	rtRx = new RouterPortSlave(); //receiver
 	rtTx = new RouterPortMaster(); //sender
-	localRouter = new Router(rtTx, rtRx, NULL); //Router for cpu core
-	mem_bandwidth = machine->opt->option("mem_bandwidth")->num;
+	localRouter = new Router(rtTx, rtRx); //Router for cpu core
+	nif_bandwidth = machine->opt->option("nif_bandwidth")->num;
+	if (nif_bandwidth == 0) {
+		nif_bandwidth = machine->mem_bandwidth;
+	}
 }
 
 RouterInterface::~RouterInterface()
@@ -278,20 +357,26 @@ const char *RouterInterface::descriptor_str() const
 	return "Router Interface";
 }
 
-//decode remote node ID
-int RouterInterface::getNodeID(uint32 addr)
+//decode address window (node ID is shifted by the window base)
+int RouterInterface::getWindow(uint32 addr)
 {
 	if ((ROUTER_NODE1_OFFSET > addr) && (addr >= ROUTER_NODE0_OFFSET)) {
-		return 1;
+		return 0;
 	} else if ((ROUTER_NODE2_OFFSET > addr) && (addr >= ROUTER_NODE1_OFFSET)) {
-		return 2;
+		return 1;
 	} else if (addr >= ROUTER_NODE2_OFFSET) {
-		return 3;
+		return 2;
 	}
 
 	return -1;
 }
 
+//the window of addr reaches a node of the network
+bool RouterInterface::isInNetwork(uint32 addr)
+{
+	return getNodeID(addr) < machine->topology->node_count();
+}
+
 //router kicker
 void RouterInterface::start(uint32 offset, int32 mode,
 							DeviceExc *client, bool block_mode) {
@@ -312,6 +397,8 @@ void RouterInterface::start(uint32 offset, int32 mode,
 }
 
 void RouterInterface::step() {
+	HostProfScope prof(HOSTPROF_RTIF);
+
 	FLIT_t flit;
 	int node_id;
 	uint32 send_data;
@@ -322,7 +409,7 @@ void RouterInterface::step() {
 	}
 
 	// exec router
-	for (int i = 0; i < mem_bandwidth; i++) {
+	for (int i = 0; i < nif_bandwidth; i++) {
 		localRouter->step();
 
 		//handle received data
@@ -367,47 +454,48 @@ void RouterInterface::step() {
 				}
 				break;
 			case RT_STATE_BW_SETUP:
-				if (send_fifo.size() == packet_size) {
+				if ((int)send_fifo.size() >= packet_size) {
 					next_state = RT_STATE_BW_HEAD;
 				}
 				break;
 			case RT_STATE_SR_HEAD:
 				node_id = getNodeID(req_addr);
-				use_vch = config->data_vch[node_id - 1];
+				use_vch = config->data_vch[getWindow(req_addr)];
 				if (rtTx->slaveReady(use_vch)) {
 					RouterUtils::make_head_flit(&flit, req_addr, MTYPE_SR, use_vch ,
-											config->router_id, getNodeID(req_addr), true);
+											config->router_id, node_id, true);
 					rtTx->send(&flit, use_vch);
 					next_state = RT_STATE_SR_WAIT;
 				}
 				break;
 			case RT_STATE_SW_HEAD:
 				node_id = getNodeID(req_addr);
-				use_vch = config->data_vch[node_id - 1];
+				use_vch = config->data_vch[getWindow(req_addr)];
 				if (rtTx->slaveReady(use_vch)) {
 					RouterUtils::make_head_flit(&flit, req_addr, MTYPE_SW, use_vch,
-											config->router_id, getNodeID(req_addr));
+											config->router_id, node_id);
 					rtTx->send(&flit, use_vch);
 					next_state = RT_STATE_SW_DATA;
 				}
 				break;
 			case RT_STATE_BR_HEAD:
 				node_id = getNodeID(req_addr);
-				use_vch = config->data_vch[node_id - 1];
+				use_vch = config->data_vch[getWindow(req_addr)];
 				if (rtTx->slaveReady(use_vch)) {
 					RouterUtils::make_head_flit(&flit, req_addr, MTYPE_BR, use_vch,
-											config->router_id, getNodeID(req_addr), true);
+											config->router_id, node_id, true);
 					rtTx->send(&flit, use_vch);
 					next_state = RT_STATE_BR_WAIT;
 				}
 				break;
 			case RT_STATE_BW_HEAD:
 				node_id = getNodeID(req_addr);
-				use_vch = config->data_vch[node_id - 1];
+				use_vch = config->data_vch[getWindow(req_addr)];
 				if (rtTx->slaveReady(use_vch)) {
 					RouterUtils::make_head_flit(&flit, req_addr, MTYPE_BW, use_vch,
-											config->router_id, getNodeID(req_addr));
+											config->router_id, node_id);
 					rtTx->send(&flit, use_vch);
+					send_left = packet_size;
 					next_state = RT_STATE_BW_DATA;
 				}
 				break;
@@ -421,12 +509,13 @@ void RouterInterface::step() {
 				break;
 			case RT_STATE_BW_DATA:
 				//without ready check
-				for (int i = 0; i < mem_bandwidth; i++) {
+				for (int i = 0; i < nif_bandwidth; i++) {
 					send_data = send_fifo.front();
 					send_fifo.pop();
-					RouterUtils::make_data_flit(&flit, send_data, send_fifo.size() == 0);
+					send_left--;
+					RouterUtils::make_data_flit(&flit, send_data, send_left == 0);
 					rtTx->send(&flit, use_vch);
-					if (send_fifo.size() == 0) {
+					if (send_left == 0) {
 						next_state = RT_STATE_IDLE;
 						break;
 					}
@@ -438,7 +527,7 @@ void RouterInterface::step() {
 				}
 				break;
 			case RT_STATE_BR_WAIT:
-				if (recv_fifo.size() == packet_size) {
+				if ((int)recv_fifo.size() == packet_size) {
 					next_state = RT_STATE_DATA_RDY;
 				}
 				break;
@@ -449,6 +538,194 @@ void RouterInterface::step() {
 				break;
 		}
 	}
+
+	step_dma();
+}
+
+//move a block of WORDS words between the local memory at ADDR and the
+//FIFOs (or the descriptor) over the bus; return true when it is done
+bool RouterInterface::dma_burst(uint32 addr, int words, int32 mode)
+{
+	if (!dma_granted) {
+		if (!bus->acquire_bus(this)) {
+			return false;
+		}
+		dma_granted = true;
+		dma_word = 0;
+		for (int i = 0; i < words; i++) {
+			bus->request_word(addr + 4 * i, mode, this, false, true);
+		}
+	}
+
+	// move while the bus has bandwidth in this cycle
+	while (dma_word < words && bus->ready(addr + 4 * dma_word, mode, this)) {
+		uint32 word_addr = addr + 4 * dma_word;
+		if (mode == DATASTORE) {
+			bus->store_word(word_addr, bus->host_to_mips_word(recv_fifo.front()), this);
+			recv_fifo.pop();
+		} else if (dma_state == RT_DMA_DESC) {
+			dma_desc[dma_word] = bus->fetch_word(word_addr, DATALOAD, this);
+		} else {
+			//flits carry the words as the core stores them to the router range
+			send_fifo.push(bus->mips_to_host_word(
+				bus->fetch_word(word_addr, DATALOAD, this)));
+		}
+		dma_word++;
+	}
+
+	if (dma_word < words) {
+		return false;
+	}
+	bus->release_bus(this);
+	dma_granted = false;
+	return true;
+}
+
+void RouterInterface::step_dma()
+{
+	uint32 block_bytes = packet_size * 4;
+
+	switch (dma_state) {
+		case RT_DMA_IDLE:
+			return;
+		case RT_DMA_DESC:
+			if (dma_burst(dma_desc_addr, ROUTER_DMA_DESC_WORDS, DATALOAD)) {
+				dma_blocks = dma_desc[2] & ROUTER_DMA_DESC_LEN_MASK;
+				dma_loaded = dma_sent = 0;
+				if (dma_desc[0] % block_bytes != 0 ||
+					dma_desc[1] % block_bytes != 0 ||
+					!isInNetwork(dma_desc[1]) || (dma_blocks > 0 &&
+					!isInNetwork(dma_desc[1] + (dma_blocks - 1) * block_bytes))) {
+					dma_adrerr = true;
+					dma_finish();
+				} else if (dma_blocks == 0) {
+					dma_next_desc();
+				} else if ((dma_desc[2] & ROUTER_DMA_DESC_READ_BIT) != 0) {
+					dma_state = RT_DMA_READ;
+				} else {
+					dma_state = RT_DMA_WRITE;
+				}
+			}
+			break;
+		case RT_DMA_WRITE:
+			//load the next block while the previous one is sent
+			if (dma_loaded < dma_blocks &&
+				(dma_granted || (int)send_fifo.size() <= packet_size)) {
+				if (dma_burst(dma_desc[0] + dma_loaded * block_bytes,
+							  packet_size, DATALOAD)) {
+					dma_loaded++;
+				}
+			}
+			if (next_state == RT_STATE_IDLE) {
+				if (dma_sent < dma_loaded) {
+					req_addr = dma_desc[1] + dma_sent * block_bytes;
+					next_state = RT_STATE_BW_HEAD;
+					dma_sent++;
+					dma_count++;
+				} else if (dma_sent == dma_blocks) {
+					dma_next_desc();
+				}
+			}
+			break;
+		case RT_DMA_READ:
+			//dma_loaded counts the blocks requested, dma_sent those stored
+			if (dma_granted || (state == RT_STATE_DATA_RDY &&
+								(int)recv_fifo.size() == packet_size)) {
+				if (dma_burst(dma_desc[0] + dma_sent * block_bytes,
+							  packet_size, DATASTORE)) {
+					dma_sent++;
+					dma_count++;
+				}
+			} else if (next_state == RT_STATE_IDLE) {
+				if (dma_loaded < dma_blocks) {
+					req_addr = dma_desc[1] + dma_loaded * block_bytes;
+					clear_recv_fifo();
+					next_state = RT_STATE_BR_HEAD;
+					dma_loaded++;
+				} else if (dma_sent == dma_blocks) {
+					dma_next_desc();
+				}
+			}
+			break;
+	}
+
+	if (exception_pending) {
+		dma_buserr = true;
+		exception_pending = false;
+		dma_finish();
+	}
+}
+
+void RouterInterface::dma_next_desc()
+{
+	dma_desc_addr = dma_desc[3];
+	if (dma_desc_addr == 0) {
+		dma_done = true;
+		dma_finish();
+	} else if (dma_desc_addr % 4 != 0) {
+		dma_adrerr = true;
+		dma_finish();
+	} else {
+		dma_state = RT_DMA_DESC;
+	}
+}
+
+void RouterInterface::dma_finish()
+{
+	if (dma_granted) {
+		bus->release_bus(this);
+		dma_granted = false;
+	}
+	dma_state = RT_DMA_IDLE;
+}
+
+void RouterInterface::exception(uint16 excCode, int mode, int coprocno)
+{
+	//only the block DMA accesses the bus as the router interface
+	if (excCode == DBE || excCode == AdEL || excCode == AdES) {
+		exception_pending = true;
+	}
+}
+
+void RouterInterface::dmaStart(uint32 desc_addr, uint32 ctrl)
+{
+	if (isDMABusy()) {
+		return;
+	}
+	dma_inten = (ctrl & ROUTER_DMA_INTEN_BIT) != 0;
+	if ((ctrl & ROUTER_DMA_START_BIT) == 0) {
+		return;
+	}
+	//a bus master from the first transfer on (it takes no TDMA slots
+	//in the programs without the block DMA)
+	bus->register_master(this, "rtif", dma_bus_weight);
+	dma_done = dma_adrerr = dma_buserr = false;
+	dma_count = 0;
+	exception_pending = false;
+	clear_send_fifo();
+	clear_recv_fifo();
+	dma_desc[3] = desc_addr;
+	dma_next_desc();
+}
+
+uint32 RouterInterface::dmaCtrl()
+{
+	return dma_inten ? ROUTER_DMA_INTEN_BIT : 0;
+}
+
+uint32 RouterInterface::dmaStatus()
+{
+	return (isDMABusy() ? ROUTER_DMA_BUSY_BIT : 0) |
+		(dma_done ? ROUTER_DMA_DONE_BIT : 0) |
+		(dma_adrerr ? ROUTER_DMA_ADRERR_BIT : 0) |
+		(dma_buserr ? ROUTER_DMA_BUSERR_BIT : 0);
+}
+
+void RouterInterface::dmaClear(uint32 bits)
+{
+	if ((bits & ROUTER_DMA_DONE_BIT) != 0) dma_done = false;
+	if ((bits & ROUTER_DMA_ADRERR_BIT) != 0) dma_adrerr = false;
+	if ((bits & ROUTER_DMA_BUSERR_BIT) != 0) dma_buserr = false;
 }
 
 void RouterInterface::reset() {
@@ -457,10 +734,15 @@ void RouterInterface::reset() {
 	localRouter->reset();
 	clear_send_fifo();
 	clear_recv_fifo();
+	dma_finish();
+	dma_inten = dma_done = dma_adrerr = dma_buserr = false;
+	dma_count = 0;
+	exception_pending = false;
 }
 
 void RouterInterface::abort() {
 	next_state = state = RT_STATE_IDLE;
+	dma_finish();
 }
 
 //registted by RouterIOReg
@@ -472,15 +754,11 @@ void RouterInterface::setConfig(RTConfig_t* config_)
 
 //FIFO controlling functions
 void RouterInterface::clear_send_fifo() {
-	FIFO empty;
-	// clear
-	std::swap(send_fifo, empty);
+	send_fifo.clear();
 }
 
 void RouterInterface::clear_recv_fifo() {
-	FIFO empty;
-	// clear
-	std::swap(recv_fifo, empty);
+	recv_fifo.clear();
 }
 
 void RouterInterface::enqueue(uint32 data)
@@ -498,9 +776,10 @@ uint32 RouterInterface::dequeue()
 bool RouterInterface::checkHWint()
 {
 	bool int_signal = false;
-	for (int i = 0; i < REMOTE_NODE_COUNT; i++) {
+	for (int i = 0; i < (int)RouterUtils::node_mask(); i++) {
 		int_signal |= config->done_status[i] & config->done_mask[i];
 		int_signal |= config->dmac_status[i] & config->dmac_mask[i];
 	}
+	int_signal |= dma_done & dma_inten;
 	return int_signal;
 }
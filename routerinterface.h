@@ -25,11 +25,11 @@
 #include "devicemap.h"
 #include "router.h"
 #include "deviceint.h"
-#include <queue>
 
-#define REMOTE_NODE_COUNT			0x3
+#define REMOTE_NODE_COUNT			0x3 //address windows for the remote nodes
+#define REMOTE_NODE_MAX				((1 << FLIT_NODE_BITS_MAX) - 1)
 // router setting regs
-#define ROUTER_ID_OFFSET			0x0000 //2bit
+#define ROUTER_ID_OFFSET			0x0000 //node_bits bit
 #define ROUTER_DVCH_NODE0_OFFSET	0x0004 //3bit virtual channel for data trans
 #define ROUTER_DVCH_NODE1_OFFSET	0x0008 //3bit
 #define ROUTER_DVCH_NODE2_OFFSET	0x000C //3bit
@@ -37,11 +37,16 @@
 #define ROUTER_INTVCH_NODE0_OFFSET	0x0014 //3bit virtual channel for done nortif.
 #define ROUTER_INTVCH_NODE1_OFFSET	0x0018 //3bit
 #define ROUTER_INTVCH_NODE2_OFFSET	0x001C //3bit
-#define ROUTER_DONE_STAT_OFFSET		0x0020 //3bit
-#define ROUTER_DONE_MASK_OFFSET		0x0024 //3bit(1: Interrupt Enabled)
-#define ROUTER_DMAC_STAT_OFFSET		0x0028 //3bit
-#define ROUTER_DMAC_MASK_OFFSET		0x002C //3bit(1: Interrupt Enabled)
+#define ROUTER_DONE_STAT_OFFSET		0x0020 //bit i for node i+1 (3bit by default)
+#define ROUTER_DONE_MASK_OFFSET		0x0024 //(1: Interrupt Enabled)
+#define ROUTER_DMAC_STAT_OFFSET		0x0028
+#define ROUTER_DMAC_MASK_OFFSET		0x002C //(1: Interrupt Enabled)
 #define ROUTER_ABORT_OFFSET			0x0030 //3bit
+#define ROUTER_WINDOW_BASE_OFFSET	0x0034 //NODEn window accesses node (base + n + 1)
+#define ROUTER_DMA_DESC_OFFSET		0x0038 //address of the first block DMA descriptor
+#define ROUTER_DMA_CTRL_OFFSET		0x003C
+#define ROUTER_DMA_STAT_OFFSET		0x0040 //(write 1 to clear done/errors)
+#define ROUTER_DMA_COUNT_OFFSET		0x0044 //blocks transferred (read only)
 #define ROUTER_RESET_BIT			0x1
 #define ROUTER_ABORT_BIT			0x2
 #define ROUTER_BERR_ABORT_BIT		0x4 //not implemented
@@ -56,7 +61,6 @@
 
 
 //BITMASK
-#define ROUTER_ID_BITMASK			0x3
 #define ROUTER_DVCH_NODE0_BITMASK	0x7
 #define ROUTER_DVCH_NODE1_BITMASK	0x7
 #define ROUTER_DVCH_NODE2_BITMASK	0x7
@@ -64,11 +68,23 @@
 #define ROUTER_INTVCH_NODE0_BITMASK	0x7
 #define ROUTER_INTVCH_NODE1_BITMASK	0x7
 #define ROUTER_INTVCH_NODE2_BITMASK	0x7
-#define ROUTER_DONE_STAT_BITMASK	0x7
-#define ROUTER_DONE_MASK_BITMASK	0x7
-#define ROUTER_DMAC_STAT_BITMASK	0x7
-#define ROUTER_DMAC_MASK_BITMASK	0x7
 #define ROUTER_ABORT_BITMASK		0x7
+#define ROUTER_DMA_START_BIT		0x1 //CTRL
+#define ROUTER_DMA_INTEN_BIT		0x2 //CTRL
+#define ROUTER_DMA_BUSY_BIT			0x1 //STAT
+#define ROUTER_DMA_DONE_BIT			0x2 //STAT
+#define ROUTER_DMA_ADRERR_BIT		0x4 //STAT
+#define ROUTER_DMA_BUSERR_BIT		0x8 //STAT
+
+/* Block DMA descriptor (4 words in the local memory)
+ *   +0: local address (block aligned)
+ *   +4: remote address, as an offset in the router window (block aligned)
+ *   +8: bit 31 set to read the remote blocks, bit 15-0 block count
+ *  +12: address of the next descriptor (0: last)
+ */
+#define ROUTER_DMA_DESC_WORDS		4
+#define ROUTER_DMA_DESC_READ_BIT	0x80000000
+#define ROUTER_DMA_DESC_LEN_MASK	0xFFFF
 
 //ROUTER IF STATE
 #define RT_STATE_IDLE		0x0
@@ -84,13 +100,20 @@
 #define RT_STATE_BR_WAIT	0xA
 #define RT_STATE_DATA_RDY	0xB //waiting for arrived data is read
 
+//BLOCK DMA STATE
+#define RT_DMA_IDLE			0x0
+#define RT_DMA_DESC			0x1 //fetching a descriptor
+#define RT_DMA_WRITE		0x2 //local blocks to the remote node
+#define RT_DMA_READ			0x3 //remote blocks to the local memory
+
 class RouterUtils;
 class Router;
 class RouterPortMaster;
 class RouterPortSlave;
 class DeviceInt;
+class Mapper;
 
-typedef std::queue<uint32> FIFO;
+typedef FlitRing<uint32> FIFO;
 
 class RouterInterface : public DeviceExc, public DeviceInt {
 public:
@@ -99,21 +122,37 @@ public:
 		uint32 data_vch[3];
 		bool iready[VCH_SIZE];
 		uint32 int_vch[3];
-		bool done_status[REMOTE_NODE_COUNT];
-		bool dmac_status[REMOTE_NODE_COUNT];
-		bool done_mask[REMOTE_NODE_COUNT];
-		bool dmac_mask[REMOTE_NODE_COUNT];
+		bool done_status[REMOTE_NODE_MAX];
+		bool dmac_status[REMOTE_NODE_MAX];
+		bool done_mask[REMOTE_NODE_MAX];
+		bool dmac_mask[REMOTE_NODE_MAX];
+		uint32 window_base;
 	};
 
 private:
 	int registed_router_id;
 	int packet_size; //equals to data cache block size
-	int mem_bandwidth;
+	int nif_bandwidth;
 
 	//Send/Recv FIFO
 	FIFO send_fifo, recv_fifo;
 	uint32 req_addr;
 	uint32 use_vch;
+	int send_left; //data flits of the block write being sent
+
+	//Block DMA: moves blocks between the local memory and the FIFOs on
+	//the bus, and sends/requests the packets itself
+	Mapper *bus;
+	uint32 dma_bus_weight;
+	int dma_state;
+	bool dma_inten, dma_done, dma_adrerr, dma_buserr;
+	uint32 dma_desc_addr;
+	uint32 dma_desc[ROUTER_DMA_DESC_WORDS];
+	uint32 dma_blocks; //of the current descriptor
+	uint32 dma_loaded, dma_sent; //blocks in/out of the FIFO
+	uint32 dma_count;
+	bool dma_granted;
+	int dma_word; //of the burst in progress
 
 	//router status
 	int state, next_state;
@@ -125,22 +164,27 @@ private:
 
 	RTConfig_t* config;
 
-	int getNodeID(uint32 addr);
+	int getWindow(uint32 addr);
+	int getNodeID(uint32 addr) { return getWindow(addr) + 1 + config->window_base; };
 	void clear_send_fifo();
 	void clear_recv_fifo();
 	bool checkHWint();
+	void step_dma();
+	bool dma_burst(uint32 addr, int words, int32 mode);
+	void dma_next_desc();
+	void dma_finish();
 
 public:
 
 	//Constructor
-	RouterInterface();
+	RouterInterface(Mapper &m);
 	~RouterInterface();
 
 	// Control-flow methods.
 	void step ();
 	void reset ();
 	void exception(uint16 excCode, int mode = ANY,
-		int coprocno = -1) { };
+		int coprocno = -1);
 
 	// router control
 	bool isBusy() { return next_state != RT_STATE_IDLE; };
@@ -148,9 +192,18 @@ public:
 	bool isUnderSetup() { return state == RT_STATE_SW_SETUP || state == RT_STATE_BW_SETUP ||
 									next_state == RT_STATE_SW_SETUP || next_state == RT_STATE_BW_SETUP; };
 	void start(uint32 offset, int32 mode, DeviceExc *client, bool block_mode); //kick data trans. via router
+	bool isInNetwork(uint32 addr); //the window of addr reaches a node
     void abort(); //stop sending & waiting for data
     void setConfig(RTConfig_t* config_);
 
+    //block DMA (the router is not available to the core while it is busy)
+    bool isDMABusy() { return dma_state != RT_DMA_IDLE; };
+    void dmaStart(uint32 desc_addr, uint32 ctrl);
+    uint32 dmaCtrl();
+    uint32 dmaStatus();
+    void dmaClear(uint32 bits);
+    uint32 dmaCount() { return dma_count; };
+
     //data to/from core
     void enqueue(uint32 data);
     uint32 dequeue();
@@ -166,6 +219,7 @@ private:
 	//IO Regs
 	RouterInterface::RTConfig_t *config;
 	uint32 abort;
+	uint32 dma_desc;
 	RouterInterface *rtif;
 	//clear regs.
 	void clear_reg();
@@ -21,6 +21,8 @@
 #include "snacc.h"
 #include "snaccmodules.h"
 #include "error.h"
+#include "hostprof.h"
+#include "eventtrace.h"
 
 #include <string>
 
@@ -31,9 +33,9 @@ SNACC::SNACC(int core_count_) : core_count(core_count_)
 
 }
 
-SNACC::SNACC(uint32 node_ID, Router* upperRouter, int core_count_)
+SNACC::SNACC(uint32 node_ID, int core_count_)
 	: core_count(core_count_),
-	CubeAccelerator(node_ID, upperRouter, SNACC_GLB_OUTOFRANGE, false)
+	CubeAccelerator(node_ID, SNACC_GLB_OUTOFRANGE, false)
 {
 
 }
@@ -124,8 +126,12 @@ void SNACC::setup()
 
 void SNACC::core_step()
 {
+	HostProfScope prof(HOSTPROF_SNACC);
+	bool busy = false;
+
 	for (int i = 0; i < core_count; i++) {
 		if (confReg->isStart(i)) {
+			busy |= !cores[i]->isDone();
 			cores[i]->step();
 			if (cores[i]->isDone()) {
 				confReg->setDone(i);
@@ -138,6 +144,31 @@ void SNACC::core_step()
 
 	wbuf_arb->step();
 
+	if (busy) {
+		busy_cycles++;
+	}
+
+	if (eventtrace != NULL) {
+		static const char *stall_names[] = {"run", "wbuf stall", "mad stall",
+			"dbchange stall", "dma req stall", "dma ex stall"};
+		uint64 now = machine->get_cycles();
+		for (int i = 0; i < core_count; i++) {
+			const char *state = NULL;
+			if (confReg->isStart(i) && !cores[i]->isDone()) {
+				state = stall_names[cores[i]->getStallCause()];
+			}
+			eventtrace->set_state(core_tracks[i], state, now);
+		}
+	}
+}
+
+void SNACC::attach_eventtrace(EventTrace *trace, const std::string &process)
+{
+	eventtrace = trace;
+	for (int i = 0; i < core_count; i++) {
+		core_tracks.push_back(trace->add_track(process,
+			"core" + std::to_string(i)));
+	}
 }
 
 void SNACC::core_reset()
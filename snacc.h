@@ -56,10 +56,13 @@ class SNACC : public CubeAccelerator, public BusConAccelerator {
 		// Conf Regs
 		SNACCComponents::ConfRegCtrl *confReg;
 
+		//timeline of each core
+		std::vector<int> core_tracks;
+
 
 	public:
 		//for Cube Mode
-		SNACC(uint32 node_ID, Router* upperRouter, int core_count_);
+		SNACC(uint32 node_ID, int core_count_);
 		//for Bus Mode
 		SNACC(int core_count_);
 		~SNACC();
@@ -67,6 +70,7 @@ class SNACC : public CubeAccelerator, public BusConAccelerator {
 		const char *accelerator_name() { return "SNACC"; }
 		void core_step();
 		void core_reset();
+		void attach_eventtrace(EventTrace *trace, const std::string &process);
 
 		//for debuger
 		virtual void send_commnad(uint32 cmd, uint32 arg);
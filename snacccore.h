@@ -187,6 +187,7 @@ class SNACCCore {
 		void step();
 		void reset();
 		bool isDone() { return done; };
+		int getStallCause() { return stall_cause; };
 		void enable_inst_dump() { inst_dump = true; };
 		void enable_mad_debug() { mad_unit->enable_debug(); };
 
@@ -0,0 +1,68 @@
+/*  Lock-free single producer single consumer ring buffer
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SPSCRING_H_
+#define _SPSCRING_H_
+
+#include <atomic>
+#include <cstddef>
+
+/* The simulator thread pushes and a writer thread pops. CAPACITY must
+   be a power of two. */
+template <typename T>
+class SPSCRing {
+public:
+	SPSCRing(size_t capacity) : mask(capacity - 1), head(0), tail(0) {
+		buf = new T[capacity];
+	}
+	~SPSCRing() { delete [] buf; }
+
+	/* Return false if the ring is full */
+	bool push(const T &item) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) > mask) {
+			return false;
+		}
+		buf[t & mask] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	/* Pop up to MAX items to OUT and return the number of them */
+	size_t pop(T *out, size_t max) {
+		size_t h = head.load(std::memory_order_relaxed);
+		size_t n = tail.load(std::memory_order_acquire) - h;
+		if (n > max) {
+			n = max;
+		}
+		for (size_t i = 0; i < n; i++) {
+			out[i] = buf[(h + i) & mask];
+		}
+		head.store(h + n, std::memory_order_release);
+		return n;
+	}
+
+private:
+	T *buf;
+	size_t mask;
+	std::atomic<size_t> head;
+	std::atomic<size_t> tail;
+};
+
+#endif /* _SPSCRING_H_ */
@@ -0,0 +1,97 @@
+/*  Stack distance profiler for single pass cache design space exploration
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "stackdist.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+StackDistProfiler::StackDistProfiler(const std::vector<int> &bsizes,
+	const std::vector<int> &sets, unsigned int max_way_) :
+	max_way(max_way_), ref_count(0)
+{
+	//bsize & sets must be the powers of two
+	for (auto bsize : bsizes) {
+		for (auto set : sets) {
+			Geometry g;
+			g.bsize = bsize;
+			g.sets = set;
+			g.offset_len = int(std::log2(bsize));
+			g.stacks.assign(set * max_way, 0);
+			g.depth.assign(set, 0);
+			g.hist.assign(max_way, 0);
+			geometries.push_back(g);
+		}
+	}
+}
+
+void StackDistProfiler::access(uint32 addr)
+{
+	ref_count++;
+
+	for (auto &g : geometries) {
+		uint32 block = addr >> g.offset_len;
+		uint32 index = block & (g.sets - 1);
+		uint32 *stack = &g.stacks[index * max_way];
+		unsigned int &depth = g.depth[index];
+		unsigned int d;
+
+		for (d = 0; d < depth; d++) {
+			if (stack[d] == block) {
+				break;
+			}
+		}
+
+		if (d < depth) {
+			g.hist[d]++;
+		} else if (depth < max_way) {
+			// not found in the stack (cold or deeper than max_way)
+			d = depth++;
+		} else {
+			d = max_way - 1;
+		}
+
+		// move to the top
+		std::memmove(&stack[1], &stack[0], d * sizeof(uint32));
+		stack[0] = block;
+	}
+}
+
+void StackDistProfiler::report_prof()
+{
+	fprintf(stderr, "\tReference Count %llu\n", (unsigned long long)ref_count);
+	fprintf(stderr, "\t%8s %8s %6s %10s %12s %12s\n",
+		"bsize", "sets", "ways", "size(B)", "misses", "miss ratio");
+
+	for (auto &g : geometries) {
+		uint64 hits = 0;
+		for (unsigned int way = 1; way <= max_way; way++) {
+			hits += g.hist[way - 1];
+			// show the powers of two only
+			if ((way & (way - 1)) != 0) {
+				continue;
+			}
+			uint64 misses = ref_count - hits;
+			fprintf(stderr, "\t%8u %8u %6u %10u %12llu %11.5f%%\n",
+				g.bsize, g.sets, way, g.bsize * g.sets * way,
+				(unsigned long long)misses,
+				ref_count ? (double)misses / (double)ref_count * 100.0 : 0.0);
+		}
+	}
+}
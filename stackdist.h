@@ -0,0 +1,59 @@
+/*  Headers for the stack distance cache profiler
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _STACKDIST_H_
+#define _STACKDIST_H_
+
+#include "types.h"
+#include <vector>
+
+/* Single pass simulation of many cache geometries (Mattson et al.).
+ * For each pair of block size and set count, an LRU stack is kept per
+ * set. A reference found at depth d of its stack hits in every cache of
+ * that geometry with more than d ways, so one run gives the miss counts
+ * for all associativities up to max_way.
+ */
+class StackDistProfiler {
+public:
+	StackDistProfiler(const std::vector<int> &bsizes,
+					  const std::vector<int> &sets,
+					  unsigned int max_way_);
+
+	/* record a reference to ADDR */
+	void access(uint32 addr);
+
+	/* print a table of miss counts per configuration */
+	void report_prof();
+
+private:
+	struct Geometry {
+		unsigned int bsize;
+		unsigned int sets;
+		unsigned int offset_len;
+		std::vector<uint32> stacks;		// sets * max_way, MRU first
+		std::vector<unsigned int> depth;	// valid entries per set
+		std::vector<uint64> hist;		// hits at each stack depth
+	};
+
+	unsigned int max_way;
+	uint64 ref_count;
+	std::vector<Geometry> geometries;
+};
+
+#endif /* _STACKDIST_H_ */
@@ -0,0 +1,95 @@
+/*  Pipeline stall profiler
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "stallprof.h"
+#include "vmips.h"
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+StallProfiler::StallProfiler(unsigned int top_n_) : top_n(top_n_), total()
+{
+}
+
+const char *StallProfiler::cause_name(int cause)
+{
+	static const char *names[STALL_CAUSES] = {
+		"icache_miss", "ifetch_uncached", "dcache_miss", "data_uncached",
+		"bus_loss", "mul_div", "load_use", "cop_suspend"
+	};
+	return names[cause];
+}
+
+void StallProfiler::report_prof()
+{
+	uint64 lost = total.sum();
+
+	fprintf(stderr, "\tLost cycles %llu (%.3f%% of %u cycles)\n",
+		(unsigned long long)lost,
+		(double)lost / (double)machine->num_cycles * 100.0,
+		machine->num_cycles);
+	for (int i = 0; i < STALL_CAUSES; i++) {
+		fprintf(stderr, "\t%16s %12llu (%.3f%%)\n", cause_name(i),
+			(unsigned long long)total.count[i],
+			lost == 0 ? 0.0 : (double)total.count[i] / (double)lost * 100.0);
+	}
+
+	std::vector<std::pair<uint32, StallCount> > sorted(pc_stalls.begin(),
+		pc_stalls.end());
+	std::sort(sorted.begin(), sorted.end(),
+		[](const std::pair<uint32, StallCount> &a,
+		   const std::pair<uint32, StallCount> &b) {
+			return a.second.sum() > b.second.sum();
+		});
+
+	fprintf(stderr, "\tTop %u stalled PCs\n", top_n);
+	fprintf(stderr, "\t%10s %10s  %s\n", "pc", "cycles", "main cause");
+	for (unsigned int i = 0; i < sorted.size() && i < top_n; i++) {
+		const StallCount &c = sorted[i].second;
+		int main_cause = std::max_element(c.count, c.count + STALL_CAUSES)
+			- c.count;
+		fprintf(stderr, "\t0x%08x %10llu  %s (%.1f%%)\n", sorted[i].first,
+			(unsigned long long)c.sum(), cause_name(main_cause),
+			(double)c.count[main_cause] / (double)c.sum() * 100.0);
+	}
+}
+
+bool StallProfiler::write_collapsed(const char *filename,
+	const SymbolTable *symtab)
+{
+	FILE *fp = fopen(filename, "w");
+	if (fp == NULL) {
+		return false;
+	}
+	for (auto &p : pc_stalls) {
+		for (int i = 0; i < STALL_CAUSES; i++) {
+			if (p.second.count[i] == 0) {
+				continue;
+			}
+			int func = symtab != NULL ? symtab->lookup(p.first) : -1;
+			if (func >= 0) {
+				fprintf(fp, "%s;", symtab->symbol(func).name.c_str());
+			}
+			fprintf(fp, "0x%08x;%s %llu\n", p.first, cause_name(i),
+				(unsigned long long)p.second.count[i]);
+		}
+	}
+	fclose(fp);
+	return true;
+}
@@ -0,0 +1,78 @@
+/*  Headers for the pipeline stall profiler
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _STALLPROF_H_
+#define _STALLPROF_H_
+
+#include "types.h"
+#include "symtab.h"
+#include <unordered_map>
+
+/* Causes of the lost cycles of the CPU pipeline */
+enum StallCause {
+	STALL_ICACHE_MISS,		// instruction cache miss
+	STALL_IFETCH_UNCACHED,	// uncached instruction fetch
+	STALL_DCACHE_MISS,		// data cache miss (and cache instructions)
+	STALL_DATA_UNCACHED,	// uncached load/store
+	STALL_BUS_LOSS,			// waiting for the bus grant
+	STALL_MUL_DIV,			// mult/div unit interlock
+	STALL_LOAD_USE,			// load-use hazard
+	STALL_COP_SUSPEND,		// coprocessor instruction in progress
+	STALL_CAUSES
+};
+
+/* Attributes every lost cycle of the CPU to its cause and to the PC of
+ * the instruction which is waiting. The result is reported as the top N
+ * PCs and written as a collapsed stack file (one "frames count" line per
+ * PC and cause) for flame graph tools.
+ */
+class StallProfiler {
+public:
+	StallProfiler(unsigned int top_n_);
+
+	void add(uint32 pc, int cause) {
+		pc_stalls[pc].count[cause]++;
+		total.count[cause]++;
+	}
+
+	void report_prof();
+	/* Write the collapsed stacks. The PCs are grouped by function if
+	   SYMTAB is given. */
+	bool write_collapsed(const char *filename, const SymbolTable *symtab);
+
+	static const char *cause_name(int cause);
+
+private:
+	struct StallCount {
+		uint64 count[STALL_CAUSES];
+		uint64 sum() const {
+			uint64 s = 0;
+			for (int i = 0; i < STALL_CAUSES; i++) {
+				s += count[i];
+			}
+			return s;
+		}
+	};
+
+	unsigned int top_n;
+	StallCount total;
+	std::unordered_map<uint32, StallCount> pc_stalls;
+};
+
+#endif /* _STALLPROF_H_ */
@@ -0,0 +1,199 @@
+/*  Statistics registry with interval dumps
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "stats.h"
+#include <cstring>
+
+StatsRegistry::StatsRegistry() : fp(NULL), format(STATS_FORMAT_CSV),
+	header_written(false), last_cycle(0)
+{
+}
+
+StatsRegistry::~StatsRegistry()
+{
+	close();
+}
+
+void StatsRegistry::add_stat(const std::string &name, int kind,
+	const std::vector<Getter> &getters)
+{
+	Stat s;
+	s.name = name;
+	s.kind = kind;
+	s.getters = getters;
+	s.last.resize(getters.size(), 0);
+	s.delta.resize(getters.size(), 0);
+	s.num = s.den = -1;
+	s.scale = 1.0;
+	if (fp != NULL) {
+		// the first interval of a late statistic starts now
+		for (size_t i = 0; i < getters.size(); i++) {
+			s.last[i] = getters[i]();
+		}
+		header_written = false;
+	}
+	stats.push_back(s);
+}
+
+void StatsRegistry::add_counter(const std::string &name, Getter getter)
+{
+	add_stat(name, STAT_COUNTER, std::vector<Getter>(1, getter));
+}
+
+void StatsRegistry::add_histogram(const std::string &name,
+	const std::vector<Getter> &bins)
+{
+	add_stat(name, STAT_HISTOGRAM, bins);
+}
+
+int StatsRegistry::find(const std::string &name) const
+{
+	for (size_t i = 0; i < stats.size(); i++) {
+		if (stats[i].name == name && stats[i].kind == STAT_COUNTER) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+void StatsRegistry::add_formula(const std::string &name,
+	const std::string &num, const std::string &den, double scale)
+{
+	int n = find(num);
+	int d = find(den);
+	if (n < 0 || d < 0) {
+		fprintf(stderr, "stats: %s refers to an unknown counter\n",
+			name.c_str());
+		return;
+	}
+	add_stat(name, STAT_FORMULA, std::vector<Getter>());
+	stats.back().num = n;
+	stats.back().den = d;
+	stats.back().scale = scale;
+}
+
+StatsRegistry::Getter StatsRegistry::counter(const std::string &name) const
+{
+	int i = find(name);
+	return i < 0 ? Getter() : stats[i].getters[0];
+}
+
+int StatsRegistry::format_by_name(const char *name)
+{
+	if (strcmp(name, "csv") == 0) {
+		return STATS_FORMAT_CSV;
+	} else if (strcmp(name, "json") == 0) {
+		return STATS_FORMAT_JSON;
+	}
+	return -1;
+}
+
+bool StatsRegistry::open(const char *filename, int format_)
+{
+	fp = fopen(filename, "w");
+	if (fp == NULL) {
+		return false;
+	}
+	format = format_;
+	// the first interval starts now
+	for (auto &s : stats) {
+		for (size_t i = 0; i < s.getters.size(); i++) {
+			s.last[i] = s.getters[i]();
+		}
+	}
+	return true;
+}
+
+void StatsRegistry::write_header()
+{
+	fprintf(fp, "cycle");
+	for (auto &s : stats) {
+		if (s.kind == STAT_HISTOGRAM) {
+			for (size_t i = 0; i < s.getters.size(); i++) {
+				fprintf(fp, ",%s.%u", s.name.c_str(), (unsigned int)i);
+			}
+		} else {
+			fprintf(fp, ",%s", s.name.c_str());
+		}
+	}
+	fprintf(fp, "\n");
+	header_written = true;
+}
+
+void StatsRegistry::dump(uint32 cycle)
+{
+	if (fp == NULL || cycle == last_cycle) {
+		return;
+	}
+	last_cycle = cycle;
+
+	// take the increase since the last dump first, formulas use them
+	for (auto &s : stats) {
+		for (size_t i = 0; i < s.getters.size(); i++) {
+			uint64 v = s.getters[i]();
+			s.delta[i] = v - s.last[i];
+			s.last[i] = v;
+		}
+	}
+
+	if (format == STATS_FORMAT_CSV && !header_written) {
+		write_header();
+	}
+	bool json = (format == STATS_FORMAT_JSON);
+	fprintf(fp, json ? "{\"cycle\":%u" : "%u", cycle);
+	for (auto &s : stats) {
+		if (json) {
+			fprintf(fp, ",\"%s\":", s.name.c_str());
+		} else {
+			fprintf(fp, ",");
+		}
+		switch (s.kind) {
+			case STAT_COUNTER:
+				fprintf(fp, "%llu", (unsigned long long)s.delta[0]);
+				break;
+			case STAT_HISTOGRAM:
+				if (json) {
+					fputc('[', fp);
+				}
+				for (size_t i = 0; i < s.delta.size(); i++) {
+					fprintf(fp, "%s%llu", i == 0 ? "" : ",",
+						(unsigned long long)s.delta[i]);
+				}
+				if (json) {
+					fputc(']', fp);
+				}
+				break;
+			case STAT_FORMULA: {
+				uint64 den = stats[s.den].delta[0];
+				fprintf(fp, "%.6g", den == 0 ? 0.0 :
+					(double)stats[s.num].delta[0] / (double)den * s.scale);
+				break;
+			}
+		}
+	}
+	fprintf(fp, json ? "}\n" : "\n");
+}
+
+void StatsRegistry::close()
+{
+	if (fp != NULL) {
+		fclose(fp);
+		fp = NULL;
+	}
+}
@@ -0,0 +1,135 @@
+/*  Headers for the statistics registry
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include "types.h"
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#define STATS_FORMAT_CSV	0
+#define STATS_FORMAT_JSON	1
+
+/* Registry of the named statistics of the modules. The names are
+ * hierarchical with dots (e.g. "cpu.dcache.misses"). Statistics refer to
+ * the counters owned by the modules, so the registry costs nothing until
+ * it is sampled:
+ *   counter:   a monotonically increasing value
+ *   histogram: an array of counters
+ *   formula:   ratio of two counters (times a scale)
+ * Every dump writes the increase of the counters and histograms and the
+ * formulas evaluated over the interval since the previous dump, as a CSV
+ * row or a JSON object per line. Statistics may be added after the first
+ * dump (e.g. a bus master which appears later), and then the CSV header
+ * is written again with the new columns.
+ */
+class StatsRegistry {
+public:
+	typedef std::function<uint64()> Getter;
+
+	StatsRegistry();
+	~StatsRegistry();
+
+	void add_counter(const std::string &name, Getter getter);
+	template <typename T>
+	void add_counter(const std::string &name, const T *value) {
+		add_counter(name, widen<T>([value]() { return *value; }));
+	}
+	void add_histogram(const std::string &name,
+		const std::vector<Getter> &bins);
+	template <typename T>
+	void add_histogram(const std::string &name, const T *bins, int n) {
+		std::vector<Getter> getters;
+		for (int i = 0; i < n; i++) {
+			const T *bin = &bins[i];
+			getters.push_back(widen<T>([bin]() { return *bin; }));
+		}
+		add_histogram(name, getters);
+	}
+	/* NUM and DEN are the names of the counters registered before */
+	void add_formula(const std::string &name, const std::string &num,
+		const std::string &den, double scale = 1.0);
+
+	/* Return a getter which extends the counter of type T read by GET to
+	 * 64 bits, so that the increase stays right when a narrower counter
+	 * wraps around. It must be called at least once per wrap, which the
+	 * dumps take care of. */
+	template <typename T, typename F>
+	static Getter widen(F get) {
+		typedef typename std::make_unsigned<T>::type U;
+		struct State {
+			U last;
+			uint64 total;
+		};
+		U v = (U)get();
+		std::shared_ptr<State> st(new State{v, (uint64)v});
+		return [get, st]() {
+			U v = (U)get();
+			st->total += (U)(v - st->last);
+			st->last = v;
+			return st->total;
+		};
+	}
+
+	/* Return the getter of the counter NAME, or an empty function */
+	Getter counter(const std::string &name) const;
+
+	/* Return the format number of NAME (csv or json), or -1 */
+	static int format_by_name(const char *name);
+
+	bool open(const char *filename, int format_);
+	/* Write the statistics of the interval ending at CYCLE */
+	void dump(uint32 cycle);
+	void close();
+
+	size_t size() const { return stats.size(); }
+
+private:
+	enum { STAT_COUNTER, STAT_HISTOGRAM, STAT_FORMULA };
+
+	struct Stat {
+		std::string name;
+		int kind;
+		std::vector<Getter> getters;
+		std::vector<uint64> last;
+		std::vector<uint64> delta;
+		// formula
+		int num, den;
+		double scale;
+	};
+
+	std::vector<Stat> stats;
+
+	FILE *fp;
+	int format;
+	bool header_written;
+	uint32 last_cycle;
+
+	void add_stat(const std::string &name, int kind,
+		const std::vector<Getter> &getters);
+	int find(const std::string &name) const;
+	void write_header();
+};
+
+#endif /* _STATS_H_ */
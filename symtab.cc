@@ -0,0 +1,184 @@
+/*  Symbol table of the guest program
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "symtab.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// ELF32 constants
+#define EI_CLASS		4
+#define EI_DATA			5
+#define ELFCLASS32		1
+#define ELFDATA2MSB		2
+#define SHT_SYMTAB		2
+#define SHF_EXECINSTR	0x4
+#define STT_NOTYPE		0
+#define STT_FUNC		2
+#define SHN_UNDEF		0
+#define SHN_LORESERVE	0xff00
+
+#define ELF32_EHDR_SIZE	52
+#define ELF32_SHDR_SIZE	40
+#define ELF32_SYM_SIZE	16
+
+/* Reader of the integers in the byte order of the ELF file */
+class ElfImage {
+public:
+	std::vector<uint8> data;
+	bool bigendian;
+
+	bool has(uint32 offset, uint32 len) const {
+		return offset <= data.size() && len <= data.size() - offset;
+	}
+	uint16 u16(uint32 offset) const {
+		const uint8 *p = &data[offset];
+		return bigendian ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+	}
+	uint32 u32(uint32 offset) const {
+		const uint8 *p = &data[offset];
+		return bigendian ?
+			((uint32)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3] :
+			((uint32)p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+	}
+};
+
+SymbolTable::SymbolTable() : bigendian(false)
+{
+}
+
+bool SymbolTable::load_elf(const char *filename, std::string &errstr)
+{
+	ElfImage elf;
+
+	FILE *fp = fopen(filename, "rb");
+	if (fp == NULL) {
+		errstr = "Could not open symbol file `" + std::string(filename) + "'";
+		return false;
+	}
+	uint8 buf[4096];
+	size_t len;
+	while ((len = fread(buf, 1, sizeof(buf), fp)) > 0) {
+		elf.data.insert(elf.data.end(), buf, buf + len);
+	}
+	fclose(fp);
+
+	if (!elf.has(0, ELF32_EHDR_SIZE) || memcmp(&elf.data[0], "\177ELF", 4) != 0
+			|| elf.data[EI_CLASS] != ELFCLASS32) {
+		errstr = std::string(filename) + " is not a 32-bit ELF file";
+		return false;
+	}
+	elf.bigendian = (elf.data[EI_DATA] == ELFDATA2MSB);
+
+	uint32 shoff = elf.u32(32);
+	uint32 shentsize = elf.u16(46);
+	uint32 shnum = elf.u16(48);
+	if (shentsize < ELF32_SHDR_SIZE || !elf.has(shoff, shentsize * shnum)) {
+		errstr = "Broken section headers in " + std::string(filename);
+		return false;
+	}
+
+	symbols.clear();
+	bigendian = elf.bigendian;
+	for (uint32 i = 0; i < shnum; i++) {
+		uint32 sh = shoff + i * shentsize;
+		if (elf.u32(sh + 4) != SHT_SYMTAB) {
+			continue;
+		}
+		uint32 sym_off = elf.u32(sh + 16);
+		uint32 sym_size = elf.u32(sh + 20);
+		uint32 link = elf.u32(sh + 24);
+		if (link >= shnum || !elf.has(sym_off, sym_size)) {
+			continue;
+		}
+		uint32 str_sh = shoff + link * shentsize;
+		uint32 str_off = elf.u32(str_sh + 16);
+		uint32 str_size = elf.u32(str_sh + 20);
+		if (!elf.has(str_off, str_size)) {
+			continue;
+		}
+
+		for (uint32 s = sym_off; s + ELF32_SYM_SIZE <= sym_off + sym_size;
+				s += ELF32_SYM_SIZE) {
+			uint32 name = elf.u32(s);
+			uint8 type = elf.data[s + 12] & 0xf;
+			uint16 shndx = elf.u16(s + 14);
+			if (shndx == SHN_UNDEF || shndx >= SHN_LORESERVE
+					|| shndx >= shnum || name >= str_size) {
+				continue;
+			}
+			// labels of assembly routines have no type
+			uint32 sec = shoff + shndx * shentsize;
+			uint32 flags = elf.u32(sec + 8);
+			if (type != STT_FUNC &&
+				!(type == STT_NOTYPE && (flags & SHF_EXECINSTR))) {
+				continue;
+			}
+			const char *str = (const char *)&elf.data[str_off + name];
+			size_t max_len = str_size - name;
+			Symbol sym;
+			sym.addr = elf.u32(s + 4);
+			sym.size = elf.u32(s + 8);
+			sym.name = std::string(str, strnlen(str, max_len));
+			if (sym.size == 0) {
+				// up to the next symbol or the end of the section
+				uint32 sec_end = elf.u32(sec + 12) + elf.u32(sec + 20);
+				sym.size = sec_end > sym.addr ? sec_end - sym.addr : 4;
+			}
+			if (sym.name.empty() || sym.name[0] == '$' ||
+				sym.name.compare(0, 2, ".L") == 0) {
+				continue;
+			}
+			symbols.push_back(sym);
+		}
+	}
+
+	if (symbols.empty()) {
+		errstr = "No function symbols in " + std::string(filename);
+		return false;
+	}
+
+	// sized symbols win over the labels at the same address
+	std::stable_sort(symbols.begin(), symbols.end(),
+		[](const Symbol &a, const Symbol &b) {
+			return a.addr < b.addr || (a.addr == b.addr && a.size > b.size);
+		});
+	symbols.erase(std::unique(symbols.begin(), symbols.end(),
+		[](const Symbol &a, const Symbol &b) { return a.addr == b.addr; }),
+		symbols.end());
+	for (size_t i = 0; i + 1 < symbols.size(); i++) {
+		uint32 gap = symbols[i + 1].addr - symbols[i].addr;
+		symbols[i].size = std::min(symbols[i].size, gap);
+	}
+	return true;
+}
+
+int SymbolTable::lookup(uint32 addr) const
+{
+	auto it = std::upper_bound(symbols.begin(), symbols.end(), addr,
+		[](uint32 a, const Symbol &s) { return a < s.addr; });
+	if (it == symbols.begin()) {
+		return -1;
+	}
+	--it;
+	if (addr - it->addr >= it->size) {
+		return -1;
+	}
+	return it - symbols.begin();
+}
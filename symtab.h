@@ -0,0 +1,57 @@
+/*  Headers for the symbol table of the guest program
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SYMTAB_H_
+#define _SYMTAB_H_
+
+#include "types.h"
+#include <string>
+#include <vector>
+
+/* Function symbols read from the .symtab section of a 32-bit ELF file,
+ * sorted by address. A symbol without size extends to the next one (or
+ * to the end of its section).
+ */
+class SymbolTable {
+public:
+	struct Symbol {
+		uint32 addr;
+		uint32 size;
+		std::string name;
+	};
+
+	SymbolTable();
+
+	/* Read the symbols of FILENAME. Return false and set the reason
+	   to ERRSTR if the file is not an ELF file with a symbol table. */
+	bool load_elf(const char *filename, std::string &errstr);
+
+	/* Return the index of the symbol containing ADDR, or -1 */
+	int lookup(uint32 addr) const;
+
+	size_t size() const { return symbols.size(); }
+	const Symbol &symbol(int i) const { return symbols[i]; }
+	bool is_bigendian() const { return bigendian; }
+
+private:
+	std::vector<Symbol> symbols;
+	bool bigendian;
+};
+
+#endif /* _SYMTAB_H_ */
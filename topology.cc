@@ -0,0 +1,315 @@
+/*  Topology of the Cube network
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "topology.h"
+#include "router.h"
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+NocTopology::NocTopology() : routing(ROUTING_XY), tci_flow(FLOW_ACK),
+	onchip_flow(FLOW_ACK)
+{
+	set_stack(1);
+}
+
+void NocTopology::set_shape(int shape_, int width_, int height_)
+{
+	shape = shape_;
+	width = width_;
+	height = height_;
+	node_types.assign(width * height, "none");
+	node_types[0] = "host";
+}
+
+void NocTopology::set_stack(int count)
+{
+	set_shape(TOPO_STACK, count, 1);
+}
+
+void NocTopology::set_node_type(int node, const std::string &type)
+{
+	node_types[node] = type;
+}
+
+bool NocTopology::load(const char *filename, std::string &error_msg)
+{
+	FILE *fp = fopen(filename, "r");
+	if (fp == NULL) {
+		error_msg = std::string("cannot open ") + filename;
+		return false;
+	}
+
+	char line[256], word[64], type[64];
+	int lineno = 0, w, h, id;
+	bool have_shape = false;
+	std::vector<std::pair<int, std::string> > nodes;
+	error_msg.clear();
+
+	while (error_msg.empty() && fgets(line, sizeof(line), fp) != NULL) {
+		lineno++;
+		char *comment = strchr(line, '#');
+		if (comment != NULL) {
+			*comment = '\0';
+		}
+		if (sscanf(line, "%63s", word) != 1) {
+			continue;
+		}
+
+		bool ok;
+		if (strcmp(word, "stack") == 0) {
+			ok = sscanf(line, "%*s %d", &w) == 1 && w >= 1;
+			if (ok) set_shape(TOPO_STACK, w, 1);
+			have_shape = true;
+		} else if (strcmp(word, "mesh") == 0 || strcmp(word, "torus") == 0) {
+			ok = sscanf(line, "%*s %d %d", &w, &h) == 2 && w >= 1 && h >= 1;
+			if (ok) set_shape(word[0] == 'm' ? TOPO_MESH : TOPO_TORUS, w, h);
+			have_shape = true;
+		} else if (strcmp(word, "routing") == 0) {
+			ok = sscanf(line, "%*s %63s", type) == 1;
+			if (ok && strcmp(type, "xy") == 0) {
+				routing = ROUTING_XY;
+			} else if (ok && strcmp(type, "westfirst") == 0) {
+				routing = ROUTING_WESTFIRST;
+			} else {
+				ok = false;
+			}
+		} else if (strcmp(word, "node") == 0) {
+			ok = sscanf(line, "%*s %d %63s", &id, type) == 2;
+			if (ok) nodes.push_back(std::make_pair(id, std::string(type)));
+		} else {
+			ok = false;
+		}
+		if (!ok) {
+			char msg[64];
+			snprintf(msg, sizeof(msg), "%s:%d: syntax error", filename, lineno);
+			error_msg = msg;
+		}
+	}
+	fclose(fp);
+
+	if (error_msg.empty() && !have_shape) {
+		error_msg = std::string(filename) + ": no stack, mesh or torus line";
+	}
+	for (size_t i = 0; error_msg.empty() && i < nodes.size(); i++) {
+		if (nodes[i].first < 1 || nodes[i].first >= node_count()) {
+			char msg[64];
+			snprintf(msg, sizeof(msg), "%s: node %d is out of the %s",
+				filename, nodes[i].first, shape_name());
+			error_msg = msg;
+		} else {
+			node_types[nodes[i].first] = nodes[i].second;
+		}
+	}
+	return error_msg.empty();
+}
+
+bool NocTopology::check(int node_bits, std::string &error_msg) const
+{
+	char msg[128];
+	if (node_bits < FLIT_NODE_BITS_DEFAULT || node_bits > FLIT_NODE_BITS_MAX) {
+		snprintf(msg, sizeof(msg), "node_bits must be %d to %d",
+			FLIT_NODE_BITS_DEFAULT, FLIT_NODE_BITS_MAX);
+	} else if (node_count() > (1 << node_bits)) {
+		snprintf(msg, sizeof(msg), "%d nodes need node_bits=%d or more",
+			node_count(), 32 - __builtin_clz(node_count() - 1));
+	} else if (shape == TOPO_TORUS && routing != ROUTING_XY) {
+		snprintf(msg, sizeof(msg), "%s routing is not deadlock free on a torus",
+			routing_name());
+	} else {
+		return true;
+	}
+	error_msg = msg;
+	return false;
+}
+
+bool NocTopology::set_flow_control(const char *tci, const char *onchip,
+	std::string &error_msg)
+{
+	const char *names[] = {tci, onchip};
+	int *flows[] = {&tci_flow, &onchip_flow};
+	for (int i = 0; i < 2; i++) {
+		int flow;
+		for (flow = FLOW_ACK; flow <= FLOW_ONOFF; flow++) {
+			if (strcmp(names[i], flow_control_name(flow)) == 0) {
+				break;
+			}
+		}
+		if (flow > FLOW_ONOFF) {
+			error_msg = std::string("unknown flow control: ") + names[i];
+			return false;
+		}
+		*flows[i] = flow;
+	}
+	return true;
+}
+
+int NocTopology::port_count() const
+{
+	return shape == TOPO_STACK ? UPPER_PORT + 1 : PORT_COUNT;
+}
+
+int NocTopology::neighbor(int node, int port) const
+{
+	int x = xpos(node), y = ypos(node);
+	switch (port) {
+		case LOWER_PORT: x++; break;
+		case UPPER_PORT: x--; break;
+		case SOUTH_PORT: y++; break;
+		case NORTH_PORT: y--; break;
+		default: return -1;
+	}
+	if (shape == TOPO_STACK && (port == SOUTH_PORT || port == NORTH_PORT)) {
+		return -1;
+	}
+	if (shape == TOPO_TORUS) {
+		x = (x + width) % width;
+		y = (y + height) % height;
+	}
+	if (x < 0 || x >= width || y < 0 || y >= height) {
+		return -1;
+	}
+	int id = y * width + x;
+	return id == node ? -1 : id;
+}
+
+int NocTopology::flow_control(int port) const
+{
+	switch (port) {
+		case LOWER_PORT: case UPPER_PORT: return tci_flow;
+		case SOUTH_PORT: case NORTH_PORT: return onchip_flow;
+		default: return FLOW_NONE;
+	}
+}
+
+int NocTopology::opposite_port(int port)
+{
+	switch (port) {
+		case LOWER_PORT: return UPPER_PORT;
+		case UPPER_PORT: return LOWER_PORT;
+		case SOUTH_PORT: return NORTH_PORT;
+		case NORTH_PORT: return SOUTH_PORT;
+		default: return LOCAL_PORT;
+	}
+}
+
+bool NocTopology::is_dateline(int node, int port) const
+{
+	if (shape != TOPO_TORUS) {
+		return false;
+	}
+	switch (port) {
+		case LOWER_PORT: return xpos(node) == width - 1;
+		case UPPER_PORT: return xpos(node) == 0;
+		case SOUTH_PORT: return ypos(node) == height - 1;
+		case NORTH_PORT: return ypos(node) == 0;
+		default: return false;
+	}
+}
+
+void NocTopology::connect(const std::vector<Router *> &routers) const
+{
+	//both directions at once from the +X/+Y side
+	for (int node = 0; node < node_count(); node++) {
+		int ports[] = {LOWER_PORT, SOUTH_PORT};
+		for (int j = 0; j < 2 && ports[j] < port_count(); j++) {
+			int peer = neighbor(node, ports[j]);
+			if (peer >= 0) {
+				routers[node]->connect(ports[j], routers[peer],
+					opposite_port(ports[j]));
+			}
+		}
+	}
+}
+
+uint32 NocTopology::route_xy(int dx, int dy) const
+{
+	if (dx > 0) return LOWER_PORT;
+	if (dx < 0) return UPPER_PORT;
+	if (dy > 0) return SOUTH_PORT;
+	if (dy < 0) return NORTH_PORT;
+	return LOCAL_PORT;
+}
+
+uint32 NocTopology::route(int node, uint32 in_port, uint32 dst, uint32 vch,
+						Crossbar *cb, uint32 *out_vch) const
+{
+	int dx = xpos(dst) - xpos(node);
+	int dy = ypos(dst) - ypos(node);
+	uint32 port;
+
+	*out_vch = vch;
+	if (shape == TOPO_TORUS) {
+		//go around the shorter way
+		if (dx > width / 2) dx -= width;
+		else if (dx < -width / 2) dx += width;
+		if (dy > height / 2) dy -= height;
+		else if (dy < -height / 2) dy += height;
+	}
+
+	if (routing == ROUTING_WESTFIRST && dx > 0 && dy != 0) {
+		//west first, then east or south/north whichever is free (east
+		//without a crossbar to ask)
+		uint32 yport = dy > 0 ? SOUTH_PORT : NORTH_PORT;
+		port = cb == NULL || cb->portFree(vch, LOWER_PORT) ||
+				!cb->portFree(vch, yport) ? LOWER_PORT : yport;
+	} else {
+		port = route_xy(dx, dy);
+	}
+
+	if (shape == TOPO_TORUS) {
+		//dateline: the packets which crossed the wrap-around link of the
+		//ring use the upper half of the VCs until they leave the ring
+		uint32 upper = vch & (VCH_SIZE / 2);
+		bool same_ring = (in_port == LOWER_PORT || in_port == UPPER_PORT) ==
+						 (port == LOWER_PORT || port == UPPER_PORT);
+		if (port == LOCAL_PORT || in_port == LOCAL_PORT || !same_ring) {
+			upper = 0;
+		}
+		if (is_dateline(node, port)) {
+			upper = VCH_SIZE / 2;
+		}
+		*out_vch = (vch & (VCH_SIZE / 2 - 1)) | upper;
+	}
+	return port;
+}
+
+const char *NocTopology::port_name(int port) const
+{
+	static const char *stack_names[] = {"local", "lower", "upper"};
+	static const char *mesh_names[] = {"local", "east", "west", "south", "north"};
+	return shape == TOPO_STACK ? stack_names[port] : mesh_names[port];
+}
+
+const char *NocTopology::shape_name() const
+{
+	static const char *names[] = {"stack", "mesh", "torus"};
+	return names[shape];
+}
+
+const char *NocTopology::routing_name() const
+{
+	return routing == ROUTING_XY ? "xy" : "westfirst";
+}
+
+const char *NocTopology::flow_control_name(int flow)
+{
+	static const char *names[] = {"none", "ack", "credit", "onoff"};
+	return names[flow];
+}
@@ -0,0 +1,113 @@
+/*  Headers for the topology of the Cube network
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TOPOLOGY_H_
+#define _TOPOLOGY_H_
+
+#include "types.h"
+#include <string>
+#include <vector>
+
+class Crossbar;
+class Router;
+
+//Shape
+#define TOPO_STACK			0 //chain of chips (default)
+#define TOPO_MESH			1
+#define TOPO_TORUS			2
+
+//Routing
+#define ROUTING_XY			0 //dimension order
+#define ROUTING_WESTFIRST	1 //minimal adaptive with the west-first turn model
+
+//Flow control of the links
+#define FLOW_NONE			0 //local port: the module always takes the flits
+#define FLOW_ACK			1 //ACK flits on the reverse link (default)
+#define FLOW_CREDIT			2 //credits on a sideband of the reverse link
+#define FLOW_ONOFF			3 //on/off signal of each VC buffer
+
+/* Layout of the routers of the Cube network. Node 0 is the host (CPU and
+ * router interface) and node N is at x = N % width, y = N / width. A
+ * stack is a row whose routers have only the local, LOWER(+X) and
+ * UPPER(-X) ports. The X links are the inductive coupling (TCI) links
+ * between the chips and the Y links are on-chip wires; each kind has
+ * its own flow control.
+ *
+ * The topology file has one directive per line ('#' starts a comment):
+ *   stack N | mesh W H | torus W H
+ *   routing xy|westfirst
+ *   node ID TYPE       accelerator of the node (none: router only)
+ */
+class NocTopology {
+private:
+	int shape;
+	int routing;
+	int width, height;
+	std::vector<std::string> node_types;
+	int tci_flow, onchip_flow;
+
+	int xpos(int node) const { return shape == TOPO_STACK ? node : node % width; }
+	int ypos(int node) const { return shape == TOPO_STACK ? 0 : node / width; }
+	uint32 route_xy(int dx, int dy) const;
+	void set_shape(int shape_, int width_, int height_);
+
+public:
+	NocTopology();
+
+	//chain of the host and COUNT - 1 accelerators
+	void set_stack(int count);
+	void set_node_type(int node, const std::string &type);
+	//return false with a message in ERROR_MSG
+	bool load(const char *filename, std::string &error_msg);
+	bool check(int node_bits, std::string &error_msg) const;
+	//flow control by name (ack, credit or onoff) of each kind of link
+	bool set_flow_control(const char *tci, const char *onchip,
+		std::string &error_msg);
+
+	int get_shape() const { return shape; }
+	int get_routing() const { return routing; }
+	int node_count() const { return width * height; }
+	int port_count() const;
+	//accelerator type of NODE ("none" for a router only)
+	const std::string &node_type(int node) const { return node_types[node]; }
+
+	//node at the other end of the link from PORT, or -1
+	int neighbor(int node, int port) const;
+	//port of the neighbor to which the link from PORT arrives
+	static int opposite_port(int port);
+	//the link from PORT is a wrap-around link of a torus
+	bool is_dateline(int node, int port) const;
+	//FLOW_* of the link from PORT
+	int flow_control(int port) const;
+	//link ROUTERS (indexed by node ID) to their neighbors
+	void connect(const std::vector<Router *> &routers) const;
+
+	//output port of NODE for a packet to DST which arrived from IN_PORT
+	//on VCH. OUT_VCH is the VC on the next link. CB is asked which ports
+	//are free by the adaptive routing, and may be NULL.
+	uint32 route(int node, uint32 in_port, uint32 dst, uint32 vch,
+				Crossbar *cb, uint32 *out_vch) const;
+
+	const char *port_name(int port) const;
+	const char *shape_name() const;
+	const char *routing_name() const;
+	static const char *flow_control_name(int flow);
+};
+
+#endif /* _TOPOLOGY_H_ */
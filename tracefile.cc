@@ -0,0 +1,324 @@
+/*  Chunked binary trace files written by a background thread
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "tracefile.h"
+#include <cstring>
+#include <string>
+
+#if defined(HAVE_ZLIB)
+#include <zlib.h>
+#endif
+#if defined(HAVE_ZSTD)
+#include <zstd.h>
+#endif
+#if defined(HAVE_LZ4)
+#include <lz4.h>
+#endif
+
+TraceFile::TraceFile(const char *filename, const char *magic, uint16 version,
+	int codec_) : codec(codec_), comp_buf(NULL), comp_buf_size(0),
+	total_raw(0), total_stored(0), total_header(0)
+{
+	fp = fopen(filename, "wb");
+	if (fp == NULL) {
+		return;
+	}
+
+	uint8 header[8];
+	std::memcpy(header, magic, 4);
+	header[4] = version & 0xff;
+	header[5] = version >> 8;
+	header[6] = codec & 0xff;
+	header[7] = codec >> 8;
+	fwrite(header, 1, sizeof(header), fp);
+	total_header += sizeof(header);
+
+	// worst case of the compressed chunk
+	switch (codec) {
+#if defined(HAVE_ZLIB)
+		case TRACE_CODEC_ZLIB:
+			comp_buf_size = compressBound(TRACE_CHUNK_SIZE);
+			break;
+#endif
+#if defined(HAVE_ZSTD)
+		case TRACE_CODEC_ZSTD:
+			comp_buf_size = ZSTD_compressBound(TRACE_CHUNK_SIZE);
+			break;
+#endif
+#if defined(HAVE_LZ4)
+		case TRACE_CODEC_LZ4:
+			comp_buf_size = LZ4_compressBound(TRACE_CHUNK_SIZE);
+			break;
+#endif
+		default:
+			break;
+	}
+	if (comp_buf_size > 0) {
+		comp_buf = new uint8[comp_buf_size];
+	}
+}
+
+TraceFile::~TraceFile()
+{
+	close();
+	delete [] comp_buf;
+}
+
+int TraceFile::codec_by_name(const char *name)
+{
+	std::string s = std::string(name);
+	if (s == std::string("none")) {
+		return TRACE_CODEC_NONE;
+#if defined(HAVE_ZLIB)
+	} else if (s == std::string("zlib")) {
+		return TRACE_CODEC_ZLIB;
+#endif
+#if defined(HAVE_ZSTD)
+	} else if (s == std::string("zstd")) {
+		return TRACE_CODEC_ZSTD;
+#endif
+#if defined(HAVE_LZ4)
+	} else if (s == std::string("lz4")) {
+		return TRACE_CODEC_LZ4;
+#endif
+	}
+	return -1;
+}
+
+void TraceFile::write_u32(uint32 v)
+{
+	uint8 b[4] = {(uint8)v, (uint8)(v >> 8), (uint8)(v >> 16), (uint8)(v >> 24)};
+	fwrite(b, 1, 4, fp);
+}
+
+void TraceFile::write_chunk(const uint8 *raw, uint32 size)
+{
+	const uint8 *data = raw;
+	size_t stored = size;
+
+	if (fp == NULL || size == 0) {
+		return;
+	}
+
+	switch (codec) {
+#if defined(HAVE_ZLIB)
+		case TRACE_CODEC_ZLIB: {
+			uLongf len = comp_buf_size;
+			if (compress2(comp_buf, &len, raw, size, 1) == Z_OK) {
+				stored = len;
+				data = comp_buf;
+			}
+			break;
+		}
+#endif
+#if defined(HAVE_ZSTD)
+		case TRACE_CODEC_ZSTD: {
+			size_t len = ZSTD_compress(comp_buf, comp_buf_size, raw, size, 1);
+			if (!ZSTD_isError(len)) {
+				stored = len;
+				data = comp_buf;
+			}
+			break;
+		}
+#endif
+#if defined(HAVE_LZ4)
+		case TRACE_CODEC_LZ4: {
+			int len = LZ4_compress_default((const char *)raw,
+				(char *)comp_buf, size, comp_buf_size);
+			if (len > 0) {
+				stored = len;
+				data = comp_buf;
+			}
+			break;
+		}
+#endif
+		default:
+			break;
+	}
+
+	if (stored >= size) {
+		// not compressible
+		data = raw;
+		stored = size;
+	}
+
+	write_u32(size);
+	write_u32(stored);
+	fwrite(data, 1, stored, fp);
+	total_raw += size;
+	total_stored += stored;
+	total_header += 8;
+}
+
+void TraceFile::close()
+{
+	if (fp != NULL) {
+		fclose(fp);
+		fp = NULL;
+	}
+}
+
+TraceReader::TraceReader(const char *filename) : version(0), codec(-1)
+{
+	uint8 header[8];
+
+	magic[0] = magic[4] = '\0';
+	fp = fopen(filename, "rb");
+	if (fp == NULL) {
+		return;
+	}
+	if (fread(header, 1, sizeof(header), fp) != sizeof(header)) {
+		fclose(fp);
+		fp = NULL;
+		return;
+	}
+	std::memcpy(magic, header, 4);
+	version = header[4] | (header[5] << 8);
+	codec = header[6] | (header[7] << 8);
+}
+
+TraceReader::~TraceReader()
+{
+	if (fp != NULL) {
+		fclose(fp);
+	}
+}
+
+bool TraceReader::read_u32(uint32 &v)
+{
+	uint8 b[4];
+	if (fread(b, 1, 4, fp) != 4) {
+		return false;
+	}
+	v = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32)b[3] << 24);
+	return true;
+}
+
+bool TraceReader::next_chunk(std::vector<uint8> &buf)
+{
+	uint32 raw_size, stored_size;
+
+	if (fp == NULL || !read_u32(raw_size) || !read_u32(stored_size)) {
+		return false;
+	}
+	buf.resize(raw_size);
+	if (stored_size == raw_size) {
+		return fread(buf.data(), 1, raw_size, fp) == raw_size;
+	}
+
+	stored.resize(stored_size);
+	if (fread(stored.data(), 1, stored_size, fp) != stored_size) {
+		return false;
+	}
+	switch (codec) {
+#if defined(HAVE_ZLIB)
+		case TRACE_CODEC_ZLIB: {
+			uLongf len = raw_size;
+			return uncompress(buf.data(), &len, stored.data(),
+				stored_size) == Z_OK && len == raw_size;
+		}
+#endif
+#if defined(HAVE_ZSTD)
+		case TRACE_CODEC_ZSTD:
+			return ZSTD_decompress(buf.data(), raw_size, stored.data(),
+				stored_size) == raw_size;
+#endif
+#if defined(HAVE_LZ4)
+		case TRACE_CODEC_LZ4:
+			return LZ4_decompress_safe((const char *)stored.data(),
+				(char *)buf.data(), stored_size, raw_size) == (int)raw_size;
+#endif
+		default:
+			fprintf(stderr, "codec %d is not supported in this build\n",
+				codec);
+			return false;
+	}
+}
+
+TraceWriter::TraceWriter(TraceFile *file_) : file(file_), fill(0),
+	back_fill(0), pending(false), stopping(false), closed(false)
+{
+	front = new uint8[TRACE_CHUNK_SIZE];
+	back = new uint8[TRACE_CHUNK_SIZE];
+	worker = std::thread(&TraceWriter::run, this);
+}
+
+TraceWriter::~TraceWriter()
+{
+	close();
+	delete [] front;
+	delete [] back;
+}
+
+uint8 *TraceWriter::reserve(size_t max_len, bool &new_chunk)
+{
+	new_chunk = (fill == 0);
+	if (fill + max_len > TRACE_CHUNK_SIZE) {
+		flush();
+		new_chunk = true;
+	}
+	return front + fill;
+}
+
+void TraceWriter::flush()
+{
+	std::unique_lock<std::mutex> lock(mtx);
+	// wait for the writer to finish the previous chunk
+	cv.wait(lock, [this] { return !pending; });
+	std::swap(front, back);
+	back_fill = fill;
+	fill = 0;
+	pending = true;
+	cv.notify_all();
+}
+
+void TraceWriter::run()
+{
+	std::unique_lock<std::mutex> lock(mtx);
+	while (true) {
+		cv.wait(lock, [this] { return pending || stopping; });
+		if (pending) {
+			lock.unlock();
+			file->write_chunk(back, back_fill);
+			lock.lock();
+			pending = false;
+			cv.notify_all();
+		} else if (stopping) {
+			break;
+		}
+	}
+}
+
+void TraceWriter::close()
+{
+	if (closed) {
+		return;
+	}
+	if (fill > 0) {
+		flush();
+	}
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		stopping = true;
+		cv.notify_all();
+	}
+	worker.join();
+	file->close();
+	closed = true;
+}
@@ -0,0 +1,157 @@
+/*  Headers for the chunked binary trace files
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TRACEFILE_H_
+#define _TRACEFILE_H_
+
+#include "types.h"
+#include <cstdio>
+#include <cstddef>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+/* Compression of the chunks. zlib, zstd and lz4 are available only
+   if CubeSim is built with HAVE_ZLIB, HAVE_ZSTD or HAVE_LZ4. */
+#define TRACE_CODEC_NONE	0
+#define TRACE_CODEC_ZLIB	1
+#define TRACE_CODEC_ZSTD	2
+#define TRACE_CODEC_LZ4		3
+
+#define TRACE_CHUNK_SIZE	(256 * 1024)
+
+/* File format:
+ *   header: char magic[4], uint16 version, uint16 codec
+ *   chunks: uint32 raw_size, uint32 stored_size, data[stored_size]
+ * A chunk is stored without compression if stored_size == raw_size.
+ * Every chunk can be decoded independently.
+ * All the integers are little endian.
+ */
+class TraceFile {
+public:
+	TraceFile(const char *filename, const char *magic, uint16 version,
+		int codec_);
+	~TraceFile();
+
+	bool is_open() const { return fp != NULL; }
+	void write_chunk(const uint8 *raw, uint32 size);
+	void close();
+
+	/* Bytes of the chunk data before and after compression, and of
+	   the file and chunk headers */
+	uint64 raw_bytes() const { return total_raw; }
+	uint64 stored_bytes() const { return total_stored; }
+	uint64 header_bytes() const { return total_header; }
+
+	/* Return the codec number of NAME, or -1 if it is not supported
+	   in this build */
+	static int codec_by_name(const char *name);
+
+private:
+	FILE *fp;
+	int codec;
+	uint8 *comp_buf;
+	size_t comp_buf_size;
+	uint64 total_raw;
+	uint64 total_stored;
+	uint64 total_header;
+
+	void write_u32(uint32 v);
+};
+
+/* Reader of the trace files for the offline tools */
+class TraceReader {
+public:
+	TraceReader(const char *filename);
+	~TraceReader();
+
+	bool is_open() const { return fp != NULL; }
+	const char *get_magic() const { return magic; }
+	uint16 get_version() const { return version; }
+	int get_codec() const { return codec; }
+
+	/* Read the next chunk into BUF. Return false at the end of the
+	   file or if the chunk cannot be decoded. */
+	bool next_chunk(std::vector<uint8> &buf);
+
+private:
+	FILE *fp;
+	char magic[5];
+	uint16 version;
+	int codec;
+	std::vector<uint8> stored;
+
+	bool read_u32(uint32 &v);
+};
+
+/* Double buffered chunk writer. The simulator fills the front buffer
+ * and a background thread compresses and writes the back buffer, so
+ * the simulation waits only if the writer falls behind by a chunk.
+ */
+class TraceWriter {
+public:
+	TraceWriter(TraceFile *file_);
+	~TraceWriter();
+
+	/* Return a pointer to write up to MAX_LEN bytes of a record.
+	   NEW_CHUNK is set if the record starts a new chunk, where the
+	   delta encoding has to be reset. */
+	uint8 *reserve(size_t max_len, bool &new_chunk);
+	/* Commit the LEN bytes written to the reserved area */
+	void commit(size_t len) { fill += len; }
+
+	/* Write the remaining data and stop the writer thread */
+	void close();
+
+private:
+	TraceFile *file;
+	uint8 *front;
+	uint8 *back;
+	size_t fill;
+	size_t back_fill;
+	bool pending;
+	bool stopping;
+	bool closed;
+
+	std::thread worker;
+	std::mutex mtx;
+	std::condition_variable cv;
+
+	void flush();
+	void run();
+};
+
+/* LEB128 style variable length integers */
+static inline uint8 *put_varint(uint8 *p, uint64 v)
+{
+	while (v >= 0x80) {
+		*p++ = (uint8)(v | 0x80);
+		v >>= 7;
+	}
+	*p++ = (uint8)v;
+	return p;
+}
+
+static inline uint64 zigzag(int64 v)
+{
+	return ((uint64)v << 1) ^ (uint64)(v >> 63);
+}
+
+#endif /* _TRACEFILE_H_ */
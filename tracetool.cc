@@ -0,0 +1,406 @@
+/*  Offline viewer of the binary traces recorded by CubeSim
+    Copyright (c) 2021 Amano laboratory, Keio University.
+
+    This file is part of CubeSim, a cycle accurate simulator for 3-D stacked system.
+
+    CubeSim is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    CubeSim is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CubeSim.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "tracefile.h"
+#include "insttrace.h"
+#include "memtrace.h"
+#include "flittrace.h"
+#include "router.h"
+#include "stub-dis.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unistd.h>
+
+static uint64 skip_count = 0;
+static uint64 max_count = ~0ULL;
+static uint64 seen = 0;
+static uint64 shown = 0;
+
+//filters of the flit trace (-1: any)
+static int filter_router = -1;
+static int filter_vch = -1;
+static int filter_node = -1;
+static int64 filter_packet = -1;
+static bool list_packets = false;
+
+/* return true if the record should be shown, false after the last one */
+static bool select_record(bool &show)
+{
+	show = seen++ >= skip_count;
+	if (show && shown++ >= max_count) {
+		return false;
+	}
+	return true;
+}
+
+static bool host_is_bigendian()
+{
+	uint32 x = 1;
+	return *((uint8 *)&x) == 0;
+}
+
+static bool dump_insttrace(TraceReader &reader)
+{
+	Disassembler disasm(host_is_bigendian(), stdout);
+	std::vector<uint8> buf;
+
+	while (reader.next_chunk(buf)) {
+		InstTraceRecord *r = (InstTraceRecord *)buf.data();
+		size_t n = buf.size() / sizeof(InstTraceRecord);
+		for (size_t i = 0; i < n; i++, r++) {
+			bool show;
+			if (!select_record(show)) {
+				return true;
+			} else if (!show) {
+				continue;
+			}
+			printf("%10llu PC=0x%08x %08x ", (unsigned long long)r->cycle,
+				r->pc, r->instr);
+			if (r->flags & INSTTRACE_REG_WRITE) {
+				printf("r%-2d=0x%08x ", r->reg, r->reg_value);
+			} else {
+				printf("%16s", "");
+			}
+			if (r->flags & INSTTRACE_MEM_READ) {
+				printf("ld[0x%08x]            ", r->mem_addr);
+			} else if (r->flags & INSTTRACE_MEM_WRITE) {
+				printf("st[0x%08x]=0x%08x ", r->mem_addr, r->mem_data);
+			} else {
+				printf("%26s", "");
+			}
+			printf("%s", r->flags & INSTTRACE_DELAY_SLOT ? "d " : "  ");
+			disasm.disassemble(r->pc, r->instr);
+		}
+	}
+	return true;
+}
+
+static uint64 get_varint(const uint8 *&p)
+{
+	uint64 v = 0;
+	int shift = 0;
+	while (*p & 0x80) {
+		v |= (uint64)(*p++ & 0x7f) << shift;
+		shift += 7;
+	}
+	v |= (uint64)(*p++) << shift;
+	return v;
+}
+
+static bool dump_memtrace(TraceReader &reader)
+{
+	static const char *mode_names[] = {"ifetch", "load", "store", "?"};
+	std::vector<uint8> buf;
+	//the names of the masters (version 2), which the old traces lack
+	std::vector<std::string> names;
+
+	while (reader.next_chunk(buf)) {
+		const uint8 *p = buf.data();
+		const uint8 *end = p + buf.size();
+		uint32 cycle = 0, addr = 0;
+		while (p < end) {
+			uint8 flags = *p++;
+			uint32 master = flags >> 5;
+			if (master == 7) {
+				master = get_varint(p);
+			}
+			if (master >= names.size()) {
+				names.resize(master + 1);
+			}
+			if ((flags & 0x3) == 0x3) {
+				uint64 len = get_varint(p);
+				names[master].assign((const char *)p, len);
+				p += len;
+				continue;
+			}
+			if (names[master].empty()) {
+				names[master] = "master" + std::to_string(master);
+			}
+			cycle += get_varint(p);
+			uint64 z = get_varint(p);
+			addr += (uint32)((z >> 1) ^ -(int64)(z & 1));
+
+			bool show;
+			if (!select_record(show)) {
+				return true;
+			} else if (!show) {
+				continue;
+			}
+			printf("%10u %-8s %-6s 0x%08x %u %s\n", cycle,
+				names[master].c_str(), mode_names[flags & 0x3], addr, 1 << ((flags >> 3) & 0x3),
+				flags & 0x4 ? "cached" : "uncached");
+		}
+	}
+	return true;
+}
+
+/* A packet followed through the routers. The body flits take the path
+   of their head flit on the same input VC of each router. */
+struct FlitPacket {
+	uint64 head;		//data of the head flit
+	uint32 src, dst, mtype;
+	uint64 inject;		//cycle when the head flit left the source router
+	uint64 eject;		//cycle when the tail flit reached the destination
+	uint32 flits;
+	std::vector<uint16> routers; //visited by the head flit
+	bool done;
+};
+
+class FlitPacketTracker {
+public:
+	//return the packet index of the flit R (-1 if unknown)
+	int64 track(const FlitTraceRecord &r);
+	const std::vector<FlitPacket> &get_packets() const { return packets; }
+
+private:
+	std::vector<FlitPacket> packets;
+	//packet on each input VC: router << 16 | in_port << 8 | vch
+	std::map<uint32, int64> current;
+	//packets whose tail has not arrived, by the data of the head flit
+	std::multimap<uint64, int64> in_flight;
+};
+
+int64 FlitPacketTracker::track(const FlitTraceRecord &r)
+{
+	uint32 key = ((uint32)r.router << 16) | (r.in_port << 8) | r.vch;
+	bool head = r.ftype == FTYPE_HEAD || r.ftype == FTYPE_HEADTAIL;
+	bool tail = r.ftype == FTYPE_TAIL || r.ftype == FTYPE_HEADTAIL;
+	int64 id = -1;
+
+	if (head && r.in_port == LOCAL_PORT) {
+		FlitPacket p = {r.data, r.src, r.dst, r.mtype, r.cycle, 0, 0,
+			std::vector<uint16>(), false};
+		id = packets.size();
+		packets.push_back(p);
+		in_flight.insert(std::make_pair(r.data, id));
+	} else if (head) {
+		//the oldest packet with the same head which has not been here
+		auto range = in_flight.equal_range(r.data);
+		for (auto it = range.first; it != range.second && id < 0; ++it) {
+			const std::vector<uint16> &v = packets[it->second].routers;
+			bool visited = false;
+			for (size_t i = 0; i < v.size(); i++) {
+				visited |= v[i] == r.router;
+			}
+			if (!visited) {
+				id = it->second;
+			}
+		}
+	} else {
+		auto it = current.find(key);
+		if (it != current.end()) {
+			id = it->second;
+		}
+	}
+	if (id < 0) {
+		return -1;
+	}
+
+	FlitPacket &p = packets[id];
+	if (head) {
+		p.routers.push_back(r.router);
+		current[key] = id;
+	}
+	if (r.in_port == LOCAL_PORT) {
+		p.flits++;
+	}
+	if (tail) {
+		current.erase(key);
+		if (r.out_port == LOCAL_PORT) {
+			p.eject = r.cycle;
+			p.done = true;
+			auto range = in_flight.equal_range(p.head);
+			for (auto it = range.first; it != range.second; ++it) {
+				if (it->second == id) {
+					in_flight.erase(it);
+					break;
+				}
+			}
+		}
+	}
+	return id;
+}
+
+static bool packet_selected(const FlitPacket *p, int64 id)
+{
+	if (filter_packet >= 0 && id != filter_packet) {
+		return false;
+	}
+	if (filter_node >= 0 && (p == NULL ||
+			((int)p->src != filter_node && (int)p->dst != filter_node))) {
+		return false;
+	}
+	return true;
+}
+
+static bool dump_flittrace(TraceReader &reader)
+{
+	static const char *port_names[] = {"local", "lower", "upper", "south",
+		"north"};
+	static const char *ftype_names[] = {"idle", "head", "tail", "headtail",
+		"data", "rsvd", "ack1", "ack2"};
+	std::vector<uint8> buf;
+	FlitPacketTracker tracker;
+
+	while (reader.next_chunk(buf)) {
+		FlitTraceRecord *r = (FlitTraceRecord *)buf.data();
+		size_t n = buf.size() / sizeof(FlitTraceRecord);
+		for (size_t i = 0; i < n; i++, r++) {
+			int64 id = r->kind == FLITTRACE_FLIT ? tracker.track(*r) : -1;
+			if (list_packets) {
+				continue;
+			}
+			const FlitPacket *p = id >= 0 ? &tracker.get_packets()[id] : NULL;
+			if ((filter_router >= 0 && r->router != filter_router) ||
+				(filter_vch >= 0 && r->vch != filter_vch &&
+				 r->out_vch != filter_vch) ||
+				((filter_packet >= 0 || filter_node >= 0) &&
+				 (r->kind != FLITTRACE_FLIT || !packet_selected(p, id)))) {
+				continue;
+			}
+
+			bool show;
+			if (!select_record(show)) {
+				return true;
+			} else if (!show) {
+				continue;
+			}
+			printf("%10llu router%-2u ", (unsigned long long)r->cycle,
+				r->router);
+			if (r->kind == FLITTRACE_ACK) {
+				printf("%-11s-> %-10s %-8s %016llx\n", "ack",
+					port_names[r->out_port % PORT_COUNT],
+					ftype_names[r->ftype & 0x7],
+					(unsigned long long)r->data);
+				continue;
+			}
+			printf("%-5s(VC%u) -> %-5s(VC%u) %-8s %016llx",
+				port_names[r->in_port % PORT_COUNT], r->vch,
+				port_names[r->out_port % PORT_COUNT], r->out_vch,
+				ftype_names[r->ftype & 0x7], (unsigned long long)r->data);
+			if (p != NULL) {
+				printf(" packet %lld (%u->%u)", (long long)id, p->src, p->dst);
+			}
+			printf("\n");
+		}
+	}
+
+	if (list_packets) {
+		const std::vector<FlitPacket> &packets = tracker.get_packets();
+		uint64 delivered = 0, latency = 0;
+		for (size_t i = 0; i < packets.size(); i++) {
+			const FlitPacket &p = packets[i];
+			bool show;
+			if (!packet_selected(&p, i)) {
+				continue;
+			} else if (!select_record(show)) {
+				break;
+			} else if (!show) {
+				continue;
+			}
+			printf("packet %-6zu %u->%u mtype %u flits %-3u hops %-2zu "
+				"inject %10llu ", i, p.src, p.dst, p.mtype, p.flits,
+				p.routers.size(), (unsigned long long)p.inject);
+			if (p.done) {
+				printf("eject %10llu latency %llu\n", (unsigned long long)p.eject,
+					(unsigned long long)(p.eject - p.inject));
+				delivered++;
+				latency += p.eject - p.inject;
+			} else {
+				printf("not delivered\n");
+			}
+		}
+		printf("%llu packets delivered, average latency %.3f cycles\n",
+			(unsigned long long)delivered,
+			delivered == 0 ? 0.0 : (double)latency / (double)delivered);
+	}
+	return true;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-s skip] [-n count] [-r router] [-v vc] "
+		"[-N node] [-p packet] [-L] tracefile\n", name);
+	fprintf(stderr, "  Print a binary trace recorded by cube_sim\n");
+	fprintf(stderr, "  (insttrace, memtrace or flittrace)\n");
+	fprintf(stderr, "  flittrace only:\n");
+	fprintf(stderr, "    -r, -v   flits through a router / on a VC\n");
+	fprintf(stderr, "    -N, -p   flits of the packets from or to a node / "
+		"of a packet\n");
+	fprintf(stderr, "    -L       list the packets with their latency\n");
+}
+
+int main(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "s:n:r:v:N:p:Lh")) != -1) {
+		switch (c) {
+			case 's':
+				skip_count = strtoull(optarg, NULL, 0);
+				break;
+			case 'n':
+				max_count = strtoull(optarg, NULL, 0);
+				break;
+			case 'r':
+				filter_router = atoi(optarg);
+				break;
+			case 'v':
+				filter_vch = atoi(optarg);
+				break;
+			case 'N':
+				filter_node = atoi(optarg);
+				break;
+			case 'p':
+				filter_packet = strtoll(optarg, NULL, 0);
+				break;
+			case 'L':
+				list_packets = true;
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (optind + 1 != argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	TraceReader reader(argv[optind]);
+	if (!reader.is_open()) {
+		fprintf(stderr, "Could not open trace file `%s'\n", argv[optind]);
+		return 1;
+	}
+
+	if (strcmp(reader.get_magic(), INSTTRACE_MAGIC) == 0) {
+		dump_insttrace(reader);
+	} else if (strcmp(reader.get_magic(), MEMTRACE_MAGIC) == 0) {
+		dump_memtrace(reader);
+	} else if (strcmp(reader.get_magic(), FLITTRACE_MAGIC) == 0) {
+		dump_flittrace(reader);
+	} else {
+		fprintf(stderr, "Unknown trace format\n");
+		return 1;
+	}
+	return 0;
+}
@@ -56,15 +56,32 @@
 #include <cstdarg>
 #include <cstring>
 #include <string>
+#include <algorithm>
 #include <exception>
 #include "rs232c.h"
 #include "routerinterface.h"
+#include "topology.h"
+#include "nocbench.h"
+#include "noctlm.h"
+#include "nocshm.h"
 #include "accelerator.h"
 #include "remoteram.h"
 #include "cma.h"
 #include "snacc.h"
 #include "dmac.h"
 #include "debugutils.h"
+#include "l2cache.h"
+#include "dram.h"
+#include "memtrace.h"
+#include "insttrace.h"
+#include "flittrace.h"
+#include "stallprof.h"
+#include "symtab.h"
+#include "funcprof.h"
+#include "stats.h"
+#include "hostprof.h"
+#include "perfcounter.h"
+#include "eventtrace.h"
 #include <vector>
 
 vmips *machine;
@@ -126,6 +143,7 @@ void vmips::check_mode()
 	mode_cpu_only = false;
 	mode_cube = false;
 	mode_bus_conn = false;
+	mode_noc_bench = false;
 	std::string mode_str = std::string(
 		opt->option("system_mode")->str);
 
@@ -138,6 +156,10 @@ void vmips::check_mode()
 	} else if (mode_str == std::string("bus_conn")) {
 		mode_bus_conn = true;
 		step_ptr = &vmips::step_bus_conn;
+	} else if (mode_str == std::string("noc_bench")) {
+		//only the routers run (see run_noc_bench)
+		mode_noc_bench = true;
+		step_ptr = NULL;
 	} else {
 		fatal_error("unknown system model: %s\n",
 					mode_str.c_str());
@@ -151,7 +173,12 @@ void vmips::check_mode()
 vmips::vmips(int argc, char *argv[])
 	: opt(new Options), state(HALT),
 	  clock(0), clock_device(0), halt_device(0), spim_console(0),
-	  num_cycles(0), interactor(0), stall_count(0)
+	  num_cycles(0), num_cycles_high(0), interactor(0), stall_count(0), l2cache(0),
+	  dram(0), memtrace(0),
+	  insttrace(0), stallprof(0), symtab(0), funcprof(0), stats(0),
+	  stats_interval(0), next_stats_dump(0), hostprof(0),
+	  perfcounter(0), eventtrace(0), flittrace(0), topology(0), router_steps(1), noc_tlm(0),
+	  noc_shm(0)
 {
     opt->process_options (argc, argv);
 	refresh_options();
@@ -166,14 +193,22 @@ vmips::~vmips()
 	//if (clock) delete clock;  // crash in this dtor - double free?
 	if (intc) delete intc;
 	if (opt) delete opt;
+	for (size_t i = 0; i < cube_acs.size(); i++) {
+		if (cube_acs[i] != NULL) {
+			delete cube_acs[i];
+		} else {
+			delete noc_routers[i + 1];
+		}
+	}
 	if (rtif) delete rtif;
-	if (ac0) delete ac0;
-	if (ac1) delete ac1;
-	if (ac2) delete ac2;
+	if (noc_tlm) delete noc_tlm;
+	if (noc_shm) delete noc_shm;
+	if (topology) delete topology;
 	if (bus_ac0) delete bus_ac0;
 	if (bus_ac1) delete bus_ac1;
 	if (bus_ac2) delete bus_ac2;
 	if (dmac) delete dmac;
+	if (l2cache) delete l2cache;
 }
 
 void
@@ -183,6 +218,10 @@ vmips::setup_machine(void)
 	intc = new IntCtrl;
 	physmem = new Mapper;
 	cpu = new CPU (*physmem, *intc);
+	physmem->register_master (cpu, "cpu", opt->option("bus_weight_cpu")->num);
+	physmem->set_master_cap (cpu, opt->option("bus_cap_cpu")->num);
+	physmem->set_master_outstanding (cpu,
+		opt->option("bus_outstanding_cpu")->num);
 
 	/* Set up the debugger interface, if applicable. */
 	if (opt_debug)
@@ -430,20 +469,53 @@ void vmips::dump_cpu_info(bool dumpcpu, bool dumpcp0) {
 
 void vmips::step(void)
 {
-	(this->*step_ptr)();
+	if (hostprof != NULL) {
+		hostprof->cycle_begin();
+		(this->*step_ptr)();
+		hostprof->cycle_end();
+	} else {
+		(this->*step_ptr)();
+	}
+	if (num_cycles == 0) {
+		num_cycles_high++;
+	}
+
+	if (stats_interval > 0 && num_cycles == next_stats_dump) {
+		stats->dump(num_cycles);
+		next_stats_dump += stats_interval;
+	}
 }
 
 void
 vmips::step_cube(void)
 {
+	//the flits from the other processes
+	if (noc_shm != NULL && !noc_shm->begin_cycle(get_cycles())) {
+		halt();
+		return;
+	}
+
 	/* Process instructions. */
 	cpu->step();
 	if (dmac != NULL) dmac->step();
 	rtif->step();
 
-	if (ac0 != NULL) ac0->step();
-	if (ac1 != NULL) ac1->step();
-	if (ac2 != NULL) ac2->step();
+	for (size_t i = 0; i < cube_acs.size(); i++) {
+		if (cube_acs[i] != NULL) {
+			cube_acs[i]->step();
+		} else if (noc_routers[i + 1] != NULL) {
+			//router without accelerator
+			for (int j = 0; j < router_steps; j++) {
+				noc_routers[i + 1]->step();
+			}
+		}
+	}
+	if (noc_tlm != NULL) {
+		noc_tlm->step();
+	}
+	if (noc_shm != NULL) {
+		noc_shm->end_cycle(get_cycles());
+	}
 
 	/* Keep track of time passing. Each instruction either takes
 	 * clock_nanos nanoseconds, or we use pass_realtime() to check the
@@ -460,6 +532,27 @@ vmips::step_cube(void)
 	num_cycles++;
 }
 
+void
+vmips::step_cube_node(void)
+{
+	if (!noc_shm->begin_cycle(get_cycles())) {
+		halt();
+		return;
+	}
+
+	int node = noc_shm->get_node();
+	if (cube_acs[node - 1] != NULL) {
+		cube_acs[node - 1]->step();
+	} else {
+		for (int j = 0; j < router_steps; j++) {
+			noc_routers[node]->step();
+		}
+	}
+
+	noc_shm->end_cycle(get_cycles());
+	num_cycles++;
+}
+
 void
 vmips::step_cpu_only(void)
 {
@@ -585,6 +678,433 @@ vmips::setup_ram ()
   return true;
 }
 
+bool
+vmips::setup_dram ()
+{
+  if (!opt->option("dram")->flag)
+    return true;
+
+  int page_policy;
+  std::string policy_str = std::string(opt->option("dram_page_policy")->str);
+  if (policy_str == std::string("open")) {
+    page_policy = DRAM_PAGE_OPEN;
+  } else if (policy_str == std::string("closed")) {
+    page_policy = DRAM_PAGE_CLOSED;
+  } else {
+    error ("unknown DRAM page policy: %s", policy_str.c_str());
+    return false;
+  }
+
+  dram = new DRAMModel(opt->option("dram_banks")->num,
+                       opt->option("dram_rowsize")->num,
+                       opt->option("dram_tcas")->num,
+                       opt->option("dram_trcd")->num,
+                       opt->option("dram_trp")->num,
+                       opt->option("dram_trefi")->num,
+                       opt->option("dram_trfc")->num,
+                       page_policy);
+  memmod->attach_dram(dram);
+  mem_prog->attach_dram(dram);
+
+  boot_msg ("DRAM timing model (%u banks, %u-byte rows, %s page) "
+            "for RAM and program memory\n",
+            opt->option("dram_banks")->num, opt->option("dram_rowsize")->num,
+            policy_str.c_str());
+  return true;
+}
+
+bool
+vmips::setup_memtrace ()
+{
+  if (!opt->option("memtrace")->flag)
+    return true;
+
+  const char *codec_str = opt->option("memtrace_compress")->str;
+  int codec = TraceFile::codec_by_name(codec_str);
+  if (codec < 0) {
+    error ("memory trace compression %s is not supported in this build",
+           codec_str);
+    return false;
+  }
+
+  const char *filename = opt->option("memtracefile")->str;
+  memtrace = new MemTrace(filename, codec);
+  if (!memtrace->is_open()) {
+    error ("Could not open memory trace file `%s': %s", filename,
+           strerror (errno));
+    return false;
+  }
+  physmem->attach_memtrace(memtrace);
+
+  boot_msg ("Recording memory trace to %s (compression %s)\n",
+            filename, codec_str);
+  return true;
+}
+
+bool
+vmips::setup_stallprof ()
+{
+  if (!opt->option("stallprof")->flag)
+    return true;
+
+  stallprof = new StallProfiler(opt->option("stallprof_top")->num);
+  cpu->attach_stallprof(stallprof);
+  return true;
+}
+
+bool
+vmips::setup_symbols ()
+{
+  const char *filename = opt->option("symfile")->str;
+  bool from_exe = false;
+
+  if (strcmp (filename, "none") == 0) {
+    // an ELF executable may carry the symbols by itself
+    if (strcmp (opt_execname, "none") == 0)
+      return true;
+    filename = opt_execname;
+    from_exe = true;
+  }
+
+  std::string errstr;
+  symtab = new SymbolTable;
+  if (!symtab->load_elf(filename, errstr)) {
+    delete symtab;
+    symtab = 0;
+    if (from_exe)
+      return true;
+    error ("%s", errstr.c_str ());
+    return false;
+  }
+
+  boot_msg ("Read %u function symbols from %s\n",
+            (unsigned int) symtab->size(), filename);
+  return true;
+}
+
+bool
+vmips::setup_funcprof ()
+{
+  if (!opt->option("funcprof")->flag)
+    return true;
+
+  if (symtab == NULL) {
+    error ("funcprof needs the symbol table of the program (symfile)");
+    return false;
+  }
+  funcprof = new FuncProfiler(symtab, opt->option("funcprof_top")->num);
+  cpu->attach_funcprof(funcprof);
+  return true;
+}
+
+bool
+vmips::setup_stats ()
+{
+  // the registry is also the source of the performance counters
+  stats = new StatsRegistry;
+  stats->add_counter("cycles", [this]() { return get_cycles(); });
+  stats->add_counter("cpu.instructions", &cpu->inst_retired);
+  stats->add_counter("cpu.stall_cycles", &stall_count);
+  stats->add_formula("cpu.ipc", "cpu.instructions", "cycles");
+  cpu->icache->register_stats(*stats, "cpu.icache");
+  cpu->dcache->register_stats(*stats, "cpu.dcache");
+  if (l2cache != NULL)
+    l2cache->register_stats(*stats, "l2cache");
+  physmem->register_bus_stats(*stats, "bus");
+  memmod->register_stats(*stats, "mem.main");
+  mem_prog->register_stats(*stats, "mem.prog");
+  rm->register_stats(*stats, "mem.rom");
+  if (dram != NULL)
+    dram->register_stats(*stats, "dram");
+
+  // accelerators are named by their type and index, e.g. cma0, and
+  // routers by their node ID
+  BusConAccelerator *bus_acs[] = {bus_ac0, bus_ac1, bus_ac2};
+  if (mode_cube && rtif != NULL)
+    rtif->getRouter()->register_stats(*stats, "router0");
+  if (noc_tlm != NULL)
+    noc_tlm->register_stats(*stats, "noc");
+  for (size_t i = 0; i < std::max(cube_acs.size(), (size_t)3); i++) {
+    AcceleratorBase *ac = NULL;
+    if (i < cube_acs.size()) {
+      // the nodes of the other processes with cube_shm are not built
+      if (noc_routers[i + 1] != NULL)
+        noc_routers[i + 1]->register_stats(*stats,
+          "router" + std::to_string(i + 1));
+      ac = cube_acs[i];
+    } else {
+      ac = bus_acs[i];
+    }
+    if (ac == NULL)
+      continue;
+    std::string name = ac->accelerator_name();
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    ac->register_stats(*stats, name + std::to_string(i));
+  }
+
+  stats_interval = opt->option("statsinterval")->num;
+  if (stats_interval == 0)
+    return true;
+
+  const char *format_str = opt->option("statsformat")->str;
+  int format = StatsRegistry::format_by_name(format_str);
+  if (format < 0) {
+    error ("unknown stats format %s (csv or json)", format_str);
+    return false;
+  }
+
+  const char *filename = opt->option("statsfile")->str;
+  if (!stats->open(filename, format)) {
+    error ("Could not open stats file `%s': %s", filename, strerror (errno));
+    return false;
+  }
+  next_stats_dump = num_cycles + stats_interval;
+
+  boot_msg ("Dumping %u statistics every %u cycles to %s\n",
+            (unsigned int) stats->size(), stats_interval, filename);
+  return true;
+}
+
+bool
+vmips::setup_perfcounter ()
+{
+  if (!opt->option("perfcounter")->flag)
+    return true;
+
+  std::vector<StatsRegistry::Getter> sources(PERFCNT_COUNT);
+  sources[PERFCNT_CYCLES] = stats->counter("cycles");
+  sources[PERFCNT_INSTRET] = stats->counter("cpu.instructions");
+  sources[PERFCNT_STALLS] = stats->counter("cpu.stall_cycles");
+  sources[PERFCNT_ICACHE_HITS] = stats->counter("cpu.icache.hits");
+  sources[PERFCNT_ICACHE_MISSES] = stats->counter("cpu.icache.misses");
+  sources[PERFCNT_DCACHE_HITS] = stats->counter("cpu.dcache.hits");
+  sources[PERFCNT_DCACHE_MISSES] = stats->counter("cpu.dcache.misses");
+  sources[PERFCNT_BUS_WAIT] = stats->counter("bus.cpu.wait_cycles");
+  // accelerators which are not built read as zero
+  BusConAccelerator *bus_acs[] = {bus_ac0, bus_ac1, bus_ac2};
+  for (size_t i = 0; i < 3; i++) {
+    AcceleratorBase *ac = bus_acs[i];
+    if (i < cube_acs.size())
+      ac = cube_acs[i];
+    if (ac != NULL)
+      sources[PERFCNT_AC0_BUSY + i] = [ac]() { return ac->get_busy_cycles(); };
+  }
+
+  perfcounter = new PerfCounter(sources);
+  if (physmem->map_at_physical_address(perfcounter, PERFCNT_ADDR_BASE) != 0) {
+    error ("Could not map the performance counters at 0x%08x",
+           PERFCNT_ADDR_BASE);
+    return false;
+  }
+  boot_msg ("Mapping %s to physical address 0x%08x\n",
+            perfcounter->descriptor_str(), PERFCNT_ADDR_BASE);
+  return true;
+}
+
+bool
+vmips::setup_eventtrace ()
+{
+  if (!opt->option("eventtrace")->flag)
+    return true;
+
+  const char *filename = opt->option("eventtracefile")->str;
+  eventtrace = new EventTrace(filename);
+  if (!eventtrace->is_open()) {
+    error ("Could not open event trace file `%s': %s", filename,
+           strerror (errno));
+    return false;
+  }
+
+  // same names as the statistics
+  cpu->attach_eventtrace(eventtrace);
+  if (dmac != NULL)
+    dmac->attach_eventtrace(eventtrace);
+  if (mode_cube && rtif != NULL)
+    rtif->getRouter()->attach_eventtrace(eventtrace, "router0");
+  BusConAccelerator *bus_acs[] = {bus_ac0, bus_ac1, bus_ac2};
+  for (size_t i = 0; i < std::max(cube_acs.size(), (size_t)3); i++) {
+    AcceleratorBase *ac = NULL;
+    if (i < cube_acs.size()) {
+      if (noc_routers[i + 1] != NULL)
+        noc_routers[i + 1]->attach_eventtrace(eventtrace,
+          "router" + std::to_string(i + 1));
+      ac = cube_acs[i];
+    } else {
+      ac = bus_acs[i];
+    }
+    if (ac == NULL)
+      continue;
+    std::string name = ac->accelerator_name();
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    ac->attach_eventtrace(eventtrace, name + std::to_string(i));
+  }
+
+  boot_msg ("Recording event trace to %s\n", filename);
+  return true;
+}
+
+bool
+vmips::setup_flittrace ()
+{
+  if (!opt->option("flittrace")->flag)
+    return true;
+
+  const char *codec_str = opt->option("flittrace_compress")->str;
+  int codec = TraceFile::codec_by_name(codec_str);
+  if (codec < 0) {
+    error ("flit trace compression %s is not supported in this build",
+           codec_str);
+    return false;
+  }
+
+  const char *filename = opt->option("flittracefile")->str;
+  flittrace = new FlitTrace(filename, codec);
+  if (!flittrace->is_open()) {
+    error ("Could not open flit trace file `%s': %s", filename,
+           strerror (errno));
+    return false;
+  }
+
+  boot_msg ("Recording flit trace to %s (compression %s)\n",
+            filename, codec_str);
+  return true;
+}
+
+static void
+toggle_hostprof_by_signal (int sig)
+{
+  HostProfiler::request_toggle();
+}
+
+bool
+vmips::setup_hostprof ()
+{
+  if (!opt->option("hostprof")->flag)
+    return true;
+
+  uint32 period = opt->option("hostprof_period")->num;
+  hostprof = new HostProfiler(period);
+  signal (SIGUSR1, toggle_hostprof_by_signal);
+
+  boot_msg ("Timing the components every %u cycles, "
+            "send SIGUSR1 to pause or resume\n", period);
+  return true;
+}
+
+bool
+vmips::setup_insttrace ()
+{
+  if (!opt->option("insttrace")->flag)
+    return true;
+
+  const char *codec_str = opt->option("insttrace_compress")->str;
+  int codec = TraceFile::codec_by_name(codec_str);
+  if (codec < 0) {
+    error ("instruction trace compression %s is not supported in this build",
+           codec_str);
+    return false;
+  }
+
+  const char *filename = opt->option("insttracefile")->str;
+  insttrace = new InstTrace(filename, codec);
+  if (!insttrace->is_open()) {
+    error ("Could not open instruction trace file `%s': %s", filename,
+           strerror (errno));
+    return false;
+  }
+  cpu->attach_insttrace(insttrace);
+
+  boot_msg ("Recording instruction trace to %s (compression %s)\n",
+            filename, codec_str);
+  return true;
+}
+
+bool
+vmips::setup_cacheprof ()
+{
+  if (opt->option("sdprof")->flag) {
+    // the index and the offset are bit fields of the address
+    std::vector<int> bsizes = opt->get_list(opt->option("sdprof_bsizes")->str);
+    std::vector<int> sets = opt->get_list(opt->option("sdprof_sets")->str);
+    for (int bsize : bsizes) {
+      if (bsize < 4 || (bsize & (bsize - 1)) != 0) {
+        error ("sdprof_bsizes must be powers of two of 4 or more");
+        return false;
+      }
+    }
+    for (int set : sets) {
+      if (set < 1 || (set & (set - 1)) != 0) {
+        error ("sdprof_sets must be powers of two");
+        return false;
+      }
+    }
+    if (opt->option("sdprof_maxway")->num == 0) {
+      error ("sdprof_maxway must be 1 or more");
+      return false;
+    }
+  }
+  if (opt->option("missprof")->flag) {
+    // the regions are found by masking the address
+    uint32 region = opt->option("missprof_region")->num;
+    if (region == 0 || (region & (region - 1)) != 0) {
+      error ("missprof_region must be a power of two");
+      return false;
+    }
+  }
+  return true;
+}
+
+bool
+vmips::setup_l2cache ()
+{
+  if (!opt->option("l2cache")->flag)
+    return true;
+
+  int policy;
+  std::string policy_str = std::string(opt->option("l2cache_policy")->str);
+  if (policy_str == std::string("nine")) {
+    policy = L2_POLICY_NINE;
+  } else if (policy_str == std::string("inclusive")) {
+    policy = L2_POLICY_INCLUSIVE;
+  } else if (policy_str == std::string("exclusive")) {
+    policy = L2_POLICY_EXCLUSIVE;
+  } else {
+    error ("unknown L2 cache policy: %s", policy_str.c_str());
+    return false;
+  }
+
+  // the index and the offset are bit fields of the address
+  uint32 bnum = opt->option("l2cachebnum")->num;
+  uint32 bsize = opt->option("l2cachebsize")->num;
+  if (bnum == 0 || (bnum & (bnum - 1)) != 0) {
+    error ("l2cachebnum must be a power of two");
+    return false;
+  }
+  if (bsize < 4 || (bsize & (bsize - 1)) != 0) {
+    error ("l2cachebsize must be a power of two of 4 or more");
+    return false;
+  }
+  if (opt->option("l2cacheway")->num == 0) {
+    error ("l2cacheway must be 1 or more");
+    return false;
+  }
+
+  l2cache = new L2Cache(bnum, bsize,
+                        opt->option("l2cacheway")->num,
+                        opt->option("l2cachebanks")->num,
+                        opt->option("l2cache_latency")->num,
+                        policy);
+  l2cache->add_range(memmod);
+  l2cache->add_range(mem_prog);
+  physmem->attach_l2cache(l2cache);
+
+  boot_msg ("Shared L2 cache (%uKB, %u-way, %s) covers RAM and program memory\n",
+            opt->option("l2cachebnum")->num * opt->option("l2cachebsize")->num
+              * opt->option("l2cacheway")->num / 1024,
+            opt->option("l2cacheway")->num, policy_str.c_str());
+  return true;
+}
+
 bool
 vmips::setup_clock ()
 {
@@ -613,7 +1133,7 @@ vmips::setup_rs232c()
 bool
 vmips::setup_router()
 {
-	rtif = new RouterInterface();
+	rtif = new RouterInterface(*physmem);
 	rtIO = new RouterIOReg(rtif);
 	rtrange_kseg0 = new RouterRange(rtif, true);
 	rtrange_kseg1 = new RouterRange(rtif, false);
@@ -647,6 +1167,11 @@ bool vmips::setup_dmac()
 {
 	if (opt->option("dmac")->flag) {
 		dmac = new DMAC(*physmem);
+		physmem->register_master(dmac, "dmac",
+			opt->option("bus_weight_dmac")->num);
+		physmem->set_master_cap(dmac, opt->option("bus_cap_dmac")->num);
+		physmem->set_master_outstanding(dmac,
+			opt->option("bus_outstanding_dmac")->num);
 		intc->connectLine(IRQ5, dmac);
 		boot_msg( "Connected IRQ5 to the %s\n",
 			dmac->descriptor_str());
@@ -654,15 +1179,120 @@ bool vmips::setup_dmac()
 	return true;
 }
 
+bool
+vmips::setup_topology()
+{
+	const char *filename = opt->option("topology")->str;
+	std::string msg;
+
+	topology = new NocTopology();
+	if (strcmp(filename, "none") == 0 && mode_noc_bench) {
+		//the host and three accelerators
+		topology->set_stack(4);
+	} else if (strcmp(filename, "none") == 0) {
+		//stack of accelerator0-2
+		const char *names[] = {opt->option("accelerator0")->str,
+			opt->option("accelerator1")->str, opt->option("accelerator2")->str};
+		int count = 1;
+		for (int i = 0; i < 3; i++) {
+			if (strcmp(names[i], "none") != 0) {
+				if (count != i + 1) {
+					fprintf(stderr, "Upper module (accelerator%d) is not built\n", i - 1);
+					return false;
+				}
+				count = i + 2;
+			}
+		}
+		topology->set_stack(count);
+		for (int i = 0; i < count - 1; i++) {
+			topology->set_node_type(i + 1, names[i]);
+		}
+	} else if (!topology->load(filename, msg)) {
+		error("%s", msg.c_str());
+		return false;
+	}
+
+	int node_bits = opt->option("node_bits")->num;
+	if (!topology->check(node_bits, msg)) {
+		error("%s", msg.c_str());
+		return false;
+	}
+	RouterUtils::set_node_bits(node_bits);
+
+	if (!topology->set_flow_control(opt->option("tci_flow_control")->str,
+			opt->option("onchip_flow_control")->str, msg)) {
+		error("%s", msg.c_str());
+		return false;
+	}
+	const char *model = opt->option("noc_model")->str;
+	if (strcmp(model, "flit") != 0 && strcmp(model, "tlm") != 0) {
+		error("unknown noc_model: %s", model);
+		return false;
+	}
+
+	if (strcmp(filename, "none") != 0) {
+		boot_msg("Cube network: %d nodes in a %s, %s routing\n",
+			topology->node_count(), topology->shape_name(),
+			topology->routing_name());
+	}
+	return true;
+}
+
+bool
+vmips::setup_noc_shm()
+{
+	const char *name = opt->option("cube_shm")->str;
+	if (strcmp(name, "none") == 0)
+		return true;
+
+	int node = opt->option("cube_node")->num;
+	int latency = opt->option("cube_shm_latency")->num;
+	if (node >= topology->node_count()) {
+		error("cube_node %d is out of the %d nodes", node,
+			topology->node_count());
+		return false;
+	}
+	if (latency < 1) {
+		error("cube_shm_latency must be 1 or more");
+		return false;
+	}
+	//the routers take as many steps as in setup_cube
+	int steps = opt->option("nif_bandwidth")->num;
+	if (steps == 0) {
+		steps = mem_bandwidth;
+	}
+	if (latency > NocShm::max_latency(steps)) {
+		error("cube_shm_latency must be %d or less for a link to hold the "
+			"flits in flight", NocShm::max_latency(steps));
+		return false;
+	}
+	if (strcmp(opt->option("noc_model")->str, "flit") != 0) {
+		error("cube_shm needs noc_model=flit");
+		return false;
+	}
+	if (opt_debug && node != 0) {
+		error("only node 0 of cube_shm can be debugged");
+		return false;
+	}
+
+	noc_shm = new NocShm(topology, node, latency);
+	std::string msg;
+	if (!noc_shm->open(name, msg)) {
+		error("%s", msg.c_str());
+		return false;
+	}
+	boot_msg("Simulating node %d of the Cube network, linked to the others "
+		"through %s\n", node, name);
+	return true;
+}
+
 bool
 vmips::setup_cube()
 {
 	std::vector<int> snacc_inst_dump(2, -1), snacc_mad_debug(2, -1);
 	bool snacc_inst_dump_fail, snacc_mad_debug_fail;
 	snacc_inst_dump_fail = snacc_mad_debug_fail = false;
-	std::string ac0_name = std::string(opt->option("accelerator0")->str);
-	std::string ac1_name = std::string(opt->option("accelerator1")->str);
-	std::string ac2_name = std::string(opt->option("accelerator2")->str);
+	int node_count = topology->node_count();
 
 	//get snacc options
 	std::string opt_str = std::string(opt->option("snacc_inst_dump")->str);
@@ -676,109 +1306,72 @@ vmips::setup_cube()
 		snacc_mad_debug_fail = true;
 	}
 
-	//setup accelerator0
-	if (ac0_name == std::string("CMA")) {
-		ac0 = new CMA(1, rtif->getRouter());
-	} else if (ac0_name == std::string("SNACC")) {
-		ac0 = new SNACC(1, rtif->getRouter(), 4);
-	} else if (ac0_name == std::string("RemoteRam")) {
-		ac0 = new RemoteRam(1, rtif->getRouter(), 0x2048); //2KB
-	} else if (ac0_name != std::string("none")) {
-		fprintf(stderr, "Unknown accelerator: %s\n", ac0_name.c_str());
-		return false;
+	//routers run at the bandwidth of the network interfaces
+	router_steps = opt->option("nif_bandwidth")->num;
+	if (router_steps == 0) {
+		router_steps = mem_bandwidth;
 	}
 
-	if (ac0 != NULL) {
-		ac0->setup();
-		if (ac0_name == std::string("SNACC")) {
-			if (snacc_inst_dump[0] == 0) {
-				((SNACC*)(ac0))->enable_inst_dump(snacc_inst_dump[1]);
-				snacc_inst_dump_fail = false;
-			}
-			if (snacc_mad_debug[0] == 0) {
-				((SNACC*)(ac0))->enable_mad_debug(snacc_mad_debug[1]);
-				snacc_mad_debug_fail = false;
-			}
-		}
-		if (opt_debug) {
-			ac0_dbg = new AcceleratorDebugger(ac0);
-			physmem->map_at_physical_address(ac0_dbg, opt_debuggeraddr);
-			dbgr->register_ac_debbuger(ac0_dbg);
-		}
+	noc_routers.assign(node_count, NULL);
+	cube_acs.assign(node_count - 1, NULL);
+	if (rtif != NULL) {
+		noc_routers[0] = rtif->getRouter();
 	}
 
-	//setup accelerator1
-	if (ac1_name != std::string("none")) {
-		if (ac0 == NULL){
-			fprintf(stderr, "Upper module (accelerator0) is not built\n");
-			return false;
-		} if (ac1_name == std::string("CMA")) {
-			ac1 = new CMA(2, ac0->getRouter());
-		} else if (ac1_name == std::string("SNACC")) {
-			ac1 = new SNACC(2, ac0->getRouter(), 4);
-		} else if (ac1_name == std::string("RemoteRam")) {
-			ac1 = new RemoteRam(2, ac0->getRouter(), 0x2048); //2KB
+	//setup accelerators (accelerator i is at node i + 1)
+	for (int node = 1; node < node_count; node++) {
+		const std::string &ac_name = topology->node_type(node);
+		int i = node - 1;
+		CubeAccelerator *ac;
+		if (noc_shm != NULL && node != noc_shm->get_node()) {
+			//simulated by another process
+			continue;
+		}
+		if (ac_name == std::string("CMA")) {
+			ac = new CMA(node);
+		} else if (ac_name == std::string("SNACC")) {
+			ac = new SNACC(node, 4);
+		} else if (ac_name == std::string("RemoteRam")) {
+			ac = new RemoteRam(node, 0x2048); //2KB
+		} else if (ac_name == std::string("none")) {
+			//only a router to forward the packets
+			noc_routers[node] = new Router(NULL, NULL, node);
+			continue;
 		} else {
-			fprintf(stderr, "Unknown accelerator: %s\n", ac1_name.c_str());
+			fprintf(stderr, "Unknown accelerator: %s\n", ac_name.c_str());
 			return false;
 		}
-	}
+		cube_acs[i] = ac;
+		noc_routers[node] = ac->getRouter();
 
-	if (ac1 != NULL) {
-		ac1->setup();
-		if (ac1_name == std::string("SNACC")) {
-			if (snacc_inst_dump[0] == 1) {
-				((SNACC*)(ac1))->enable_inst_dump(snacc_inst_dump[1]);
+		ac->setup();
+		if (ac_name == std::string("SNACC")) {
+			if (snacc_inst_dump[0] == i) {
+				((SNACC*)(ac))->enable_inst_dump(snacc_inst_dump[1]);
 				snacc_inst_dump_fail = false;
 			}
-			if (snacc_mad_debug[0] == 1) {
-				((SNACC*)(ac1))->enable_mad_debug(snacc_mad_debug[1]);
+			if (snacc_mad_debug[0] == i) {
+				((SNACC*)(ac))->enable_mad_debug(snacc_mad_debug[1]);
 				snacc_mad_debug_fail = false;
 			}
 		}
 		if (opt_debug) {
-			ac1_dbg = new AcceleratorDebugger(ac1);
-			physmem->map_at_physical_address(ac1_dbg, opt_debuggeraddr + 
-											ACDBGR_SIZE);
-			dbgr->register_ac_debbuger(ac1_dbg);
+			AcceleratorDebugger *ac_dbg = new AcceleratorDebugger(ac);
+			physmem->map_at_physical_address(ac_dbg, opt_debuggeraddr +
+											ACDBGR_SIZE * i);
+			dbgr->register_ac_debbuger(ac_dbg);
 		}
 	}
 
-	//setup accelerator2
-	if (ac2_name != std::string("none")) {
-		if (ac1 == NULL){
-			fprintf(stderr, "Upper module (accelerator1) is not built\n");
-			return false;
-		} if (ac1_name == std::string("CMA")) {
-			ac2 = new CMA(3, ac1->getRouter());
-		} else if (ac1_name == std::string("SNACC")) {
-			ac2 = new SNACC(3, ac1->getRouter(), 4);
-		} else if (ac1_name == std::string("RemoteRam")) {
-			ac2 = new RemoteRam(3, ac1->getRouter(), 0x2048); //2KB
-		} else {
-			fprintf(stderr, "Unknown accelerator: %s\n", ac1_name.c_str());
-			return false;
-		}
+	if (noc_shm != NULL) {
+		noc_shm->connect(noc_routers[noc_shm->get_node()]);
+	} else {
+		topology->connect(noc_routers);
 	}
-
-	if (ac2 != NULL) {
-		ac2->setup();
-		if (ac2_name == std::string("SNACC")) {
-			if (snacc_inst_dump[0] == 2) {
-				((SNACC*)(ac2))->enable_inst_dump(snacc_inst_dump[1]);
-				snacc_inst_dump_fail = false;
-			}
-			if (snacc_mad_debug[0] == 0) {
-				((SNACC*)(ac2))->enable_mad_debug(snacc_mad_debug[1]);
-				snacc_mad_debug_fail = false;
-			}
-		}
-		if (opt_debug) {
-			ac2_dbg = new AcceleratorDebugger(ac2);
-			physmem->map_at_physical_address(ac2_dbg, opt_debuggeraddr + 
-											ACDBGR_SIZE * 2);
-			dbgr->register_ac_debbuger(ac2_dbg);
-		}
+	if (strcmp(opt->option("noc_model")->str, "tlm") == 0) {
+		noc_tlm = new NocTlm(topology, opt->option("noc_tlm_hop_latency")->num,
+			router_steps);
+		noc_tlm->attach(noc_routers);
 	}
 
 	if (snacc_inst_dump_fail) {
@@ -841,11 +1434,11 @@ vmips::setup_bus_master()
 		bus_masters.push_back(bus_ac0);
 		if (ac0_name == std::string("SNACC")) {
 			if (snacc_inst_dump[0] == 0) {
-				((SNACC*)(ac0))->enable_inst_dump(snacc_inst_dump[1]);
+				((SNACC*)(bus_ac0))->enable_inst_dump(snacc_inst_dump[1]);
 				snacc_inst_dump_fail = false;
 			}
 			if (snacc_mad_debug[0] == 0) {
-				((SNACC*)(ac0))->enable_mad_debug(snacc_mad_debug[1]);
+				((SNACC*)(bus_ac0))->enable_mad_debug(snacc_mad_debug[1]);
 				snacc_mad_debug_fail = false;
 			}
 		}
@@ -875,11 +1468,11 @@ vmips::setup_bus_master()
 		bus_masters.push_back(bus_ac1);
 		if (ac1_name == std::string("SNACC")) {
 			if (snacc_inst_dump[0] == 0) {
-				((SNACC*)(ac1))->enable_inst_dump(snacc_inst_dump[1]);
+				((SNACC*)(bus_ac1))->enable_inst_dump(snacc_inst_dump[1]);
 				snacc_inst_dump_fail = false;
 			}
 			if (snacc_mad_debug[0] == 0) {
-				((SNACC*)(ac1))->enable_mad_debug(snacc_mad_debug[1]);
+				((SNACC*)(bus_ac1))->enable_mad_debug(snacc_mad_debug[1]);
 				snacc_mad_debug_fail = false;
 			}
 		}
@@ -909,11 +1502,11 @@ vmips::setup_bus_master()
 		bus_masters.push_back(bus_ac2);
 		if (ac2_name == std::string("SNACC")) {
 			if (snacc_inst_dump[0] == 0) {
-				((SNACC*)(ac2))->enable_inst_dump(snacc_inst_dump[1]);
+				((SNACC*)(bus_ac2))->enable_inst_dump(snacc_inst_dump[1]);
 				snacc_inst_dump_fail = false;
 			}
 			if (snacc_mad_debug[0] == 0) {
-				((SNACC*)(ac2))->enable_mad_debug(snacc_mad_debug[1]);
+				((SNACC*)(bus_ac2))->enable_mad_debug(snacc_mad_debug[1]);
 				snacc_mad_debug_fail = false;
 			}
 		}
@@ -980,6 +1573,13 @@ vmips::run()
 	/* Set up the rest of the machine components. */
 	setup_machine();
 
+	if (mode_noc_bench)
+	  return run_noc_bench();
+
+	if (mode_cube && strcmp(opt->option("cube_shm")->str, "none") != 0 &&
+		opt->option("cube_node")->num != 0)
+	  return run_cube_node();
+
 	if (!setup_bootrom ()) 
 	  return 1;
 
@@ -989,6 +1589,30 @@ vmips::run()
 	if (!setup_ram ())
 	  return 1;
 
+	if (!setup_dram ())
+	  return 1;
+
+	if (!setup_l2cache ())
+	  return 1;
+
+	if (!setup_cacheprof ())
+	  return 1;
+
+	if (!setup_memtrace ())
+	  return 1;
+
+	if (!setup_insttrace ())
+	  return 1;
+
+	if (!setup_stallprof ())
+	  return 1;
+
+	if (!setup_symbols ())
+	  return 1;
+
+	if (!setup_funcprof ())
+	  return 1;
+
 	if (!setup_haltdevice ())
 	  return 1;
 
@@ -1023,6 +1647,10 @@ vmips::run()
 		return 1;
 
 	if (mode_cube) {
+		if (!setup_topology())
+		  return 1;
+		if (!setup_noc_shm())
+		  return 1;
 		if (!setup_router())
 		  return 1;
 		if (!setup_cube())
@@ -1046,6 +1674,10 @@ vmips::run()
 	boot_msg( "\n*************RESET*************\n" );
 	boot_msg("Resetting CPU\n");
 	cpu->reset();
+	if (l2cache != NULL) {
+		l2cache->attach_upper(cpu->icache);
+		l2cache->attach_upper(cpu->dcache);
+	}
 	/* for cube mode */
 	if (mode_cube) {
 		/* Reset Router interface */
@@ -1054,17 +1686,16 @@ vmips::run()
 			rtif->reset();
 		}
 	}
-	if (ac0 != NULL) {
-		boot_msg("Resetting %s_0\n", ac0->accelerator_name());
-		ac0->reset();
-	}
-	if (ac1 != NULL) {
-		boot_msg("Resetting %s_1\n", ac1->accelerator_name());
-		ac1->reset();
+	for (size_t i = 0; i < cube_acs.size(); i++) {
+		if (cube_acs[i] != NULL) {
+			boot_msg("Resetting %s_%d\n", cube_acs[i]->accelerator_name(), (int)i);
+			cube_acs[i]->reset();
+		} else if (noc_routers[i + 1] != NULL) {
+			noc_routers[i + 1]->reset();
+		}
 	}
-	if (ac2 != NULL) {
-		boot_msg("Resetting %s_2\n", ac2->accelerator_name());
-		ac2->reset();
+	if (noc_tlm != NULL) {
+		noc_tlm->reset();
 	}
 
 	if (bus_ac0 != NULL) {
@@ -1087,9 +1718,30 @@ vmips::run()
 
 	fprintf(stderr, "\n");
 
+	if (!setup_stats ())
+	  return 1;
+
+	if (!setup_perfcounter ())
+	  return 1;
+
+	if (!setup_eventtrace ())
+	  return 1;
+
+	if (mode_cube) {
+		if (!setup_flittrace ())
+		  return 1;
+		for (size_t i = 0; flittrace != NULL && i < noc_routers.size(); i++) {
+			if (noc_routers[i] != NULL)
+				noc_routers[i]->attach_flittrace(flittrace);
+		}
+	}
+
 	if (!setup_exe ())
 	  return 1;
 
+	if (!setup_hostprof ())
+	  return 1;
+
 	timeval start;
 	if (opt_instcounts)
 		gettimeofday(&start, NULL);
@@ -1112,6 +1764,10 @@ vmips::run()
 	timeval end;
 	if (opt_instcounts)
 		gettimeofday(&end, NULL);
+	if (hostprof != NULL)
+		hostprof->stop();
+	if (noc_shm != NULL)
+		noc_shm->halt();
 
 	/* Halt! */
 	boot_msg( "\n*************HALT*************\n\n" );
@@ -1119,6 +1775,29 @@ vmips::run()
 	/* If we're tracing, dump the trace. */
 	cpu->flush_trace ();
 
+	if (stats_interval > 0) {
+		// the last interval may be shorter
+		stats->dump(num_cycles);
+		stats->close();
+	}
+
+	if (memtrace != NULL) {
+		memtrace->close();
+		memtrace->report();
+	}
+	if (insttrace != NULL) {
+		insttrace->close();
+		insttrace->report();
+	}
+	if (flittrace != NULL) {
+		flittrace->close();
+		flittrace->report();
+	}
+	if (eventtrace != NULL) {
+		eventtrace->close(get_cycles());
+		eventtrace->report();
+	}
+
 	/* If user requested it, dump registers from CPU and/or CP0. */
 	if (opt_haltdumpcpu || opt_haltdumpcp0) {
 		fprintf(stderr,"Dumping:\n");
@@ -1148,20 +1827,76 @@ vmips::run()
 		cpu->icache->report_prof();
 		fprintf(stderr, "Data Cache Profile\n");
 		cpu->dcache->report_prof();
+		if (l2cache != NULL) {
+			fprintf(stderr, "L2 Cache Profile\n");
+			l2cache->report_prof();
+		}
+		fprintf(stderr, "\n");
+	}
+
+	if (opt->option("busprof")->flag) {
+		fprintf(stderr, "Bus Profile\n");
+		physmem->report_bus_prof();
+		fprintf(stderr, "\n");
+	}
+
+	if (opt->option("sdprof")->flag) {
+		fprintf(stderr, "Instruction Cache Stack Distance Profile\n");
+		cpu->icache->report_sdprof();
+		fprintf(stderr, "Data Cache Stack Distance Profile\n");
+		cpu->dcache->report_sdprof();
+		fprintf(stderr, "\n");
+	}
+
+	if (opt->option("missprof")->flag) {
+		fprintf(stderr, "Instruction Cache Miss Profile\n");
+		cpu->icache->report_missprof();
+		fprintf(stderr, "Data Cache Miss Profile\n");
+		cpu->dcache->report_missprof();
+		fprintf(stderr, "\n");
+	}
+
+	if (funcprof != NULL) {
+		fprintf(stderr, "Function Profile\n");
+		funcprof->report_prof();
+		const char *filename = opt->option("gmonfile")->str;
+		if (!funcprof->write_gmon(filename)) {
+			fprintf(stderr, "Could not write function profile to %s\n",
+				filename);
+		}
+		fprintf(stderr, "\n");
+	}
+
+	if (stallprof != NULL) {
+		fprintf(stderr, "Stall Profile\n");
+		stallprof->report_prof();
+		const char *filename = opt->option("stallprof_file")->str;
+		if (!stallprof->write_collapsed(filename, symtab)) {
+			fprintf(stderr, "Could not write stall profile to %s\n",
+				filename);
+		}
+		fprintf(stderr, "\n");
+	}
+
+	if (hostprof != NULL) {
+		fprintf(stderr, "Host Profile\n");
+		hostprof->report_prof(num_cycles);
 		fprintf(stderr, "\n");
 	}
 
 	if (opt_router_prof) {
 		fprintf(stderr, "Router Profile\n");
-		rtif->getRouter()->report_router();
-		if (ac0 != NULL) {
-			ac0->getRouter()->report_router();
-		}
-		if (ac1 != NULL) {
-			ac1->getRouter()->report_router();
+		if (noc_tlm != NULL) {
+			noc_tlm->report();
+		} else {
+			rtif->getRouter()->report_router();
+			for (size_t node = 1; node < noc_routers.size(); node++) {
+				if (noc_routers[node] != NULL)
+					noc_routers[node]->report_router();
+			}
 		}
-		if (ac2 != NULL) {
-			ac2->getRouter()->report_router();
+		if (noc_shm != NULL) {
+			noc_shm->report();
 		}
 	}
 
@@ -1173,6 +1908,10 @@ vmips::run()
 		((Range*)(mem_prog))->report_profile();
 		fprintf(stderr, "  Boot rom\n");
 		((Range*)(rm))->report_profile();
+		if (dram != NULL) {
+			fprintf(stderr, "  DRAM\n");
+			dram->report_prof();
+		}
 	}
 
 	/* We're done. */
@@ -1180,6 +1919,81 @@ vmips::run()
 	return 0;
 }
 
+int
+vmips::run_noc_bench()
+{
+	if (!setup_topology())
+	  return 1;
+
+	NocBench bench(topology);
+	if (!bench.setup())
+	  return 1;
+	if (!setup_flittrace())
+	  return 1;
+	if (flittrace != NULL)
+	  bench.attach_flittrace(flittrace);
+	bench.run();
+	if (flittrace != NULL) {
+		flittrace->close();
+		flittrace->report();
+	}
+
+	boot_msg( "Goodbye.\n" );
+	return 0;
+}
+
+int
+vmips::run_cube_node()
+{
+	if (!setup_topology())
+	  return 1;
+	if (!setup_noc_shm())
+	  return 1;
+	if (!setup_cube())
+	  return 1;
+
+	int node = noc_shm->get_node();
+	CubeAccelerator *ac = cube_acs[node - 1];
+	if (ac != NULL) {
+		boot_msg("Resetting %s_%d\n", ac->accelerator_name(), node - 1);
+		ac->reset();
+	} else {
+		noc_routers[node]->reset();
+	}
+
+	if (!setup_hostprof ())
+	  return 1;
+
+	timeval start, end;
+	gettimeofday(&start, NULL);
+	step_ptr = &vmips::step_cube_node;
+	state = RUN;
+	while (state == RUN) { step (); }
+	gettimeofday(&end, NULL);
+	if (hostprof != NULL)
+		hostprof->stop();
+
+	boot_msg( "\n*************HALT*************\n\n" );
+	if (opt_instcounts) {
+		double elapsed = (double) timediff(&end, &start) / 1000000.0;
+		fprintf(stderr, "%llu cycles in %.5f seconds\n",
+			(unsigned long long)get_cycles(), elapsed);
+	}
+	if (hostprof != NULL) {
+		fprintf(stderr, "Host Profile\n");
+		hostprof->report_prof(num_cycles);
+		fprintf(stderr, "\n");
+	}
+	if (opt_router_prof) {
+		fprintf(stderr, "Router Profile\n");
+		noc_routers[node]->report_router();
+		noc_shm->report();
+	}
+
+	boot_msg( "Goodbye.\n" );
+	return 0;
+}
+
 static void vmips_unexpected() {
   fatal_error ("unexpected exception");
 }
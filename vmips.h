@@ -52,10 +52,26 @@ class Interactor;
 class RouterInterface;
 class RouterRange;
 class RouterIOReg;
+class Router;
+class NocTopology;
+class NocTlm;
+class NocShm;
 class CubeAccelerator;
 class DMAC;
 class AcceleratorDebugger;
 class BusConAccelerator;
+class L2Cache;
+class DRAMModel;
+class MemTrace;
+class InstTrace;
+class StallProfiler;
+class SymbolTable;
+class FuncProfiler;
+class StatsRegistry;
+class HostProfiler;
+class PerfCounter;
+class EventTrace;
+class FlitTrace;
 
 long timediff(struct timeval *after, struct timeval *before);
 
@@ -91,11 +107,33 @@ public:
 	RouterInterface *rtif;
 	RouterIOReg *rtIO;
 	RouterRange *rtrange_kseg0, *rtrange_kseg1;
-	CubeAccelerator *ac0, *ac1, *ac2;
+	NocTopology *topology;
+	//indexed by node ID - 1 (NULL for the nodes without accelerator)
+	std::vector<CubeAccelerator *> cube_acs;
+	//indexed by node ID (node 0 is the router of the router interface)
+	std::vector<Router *> noc_routers;
+	int router_steps; //router cycles per cycle
+	//carries the packets instead of the routers (noc_model=tlm)
+	NocTlm *noc_tlm;
+	//links to the nodes simulated by the other processes (cube_shm)
+	NocShm *noc_shm;
 	BusConAccelerator *bus_ac0, *bus_ac1, *bus_ac2;
-	AcceleratorDebugger *ac0_dbg, *ac1_dbg, *ac2_dbg;
 
 	DMAC *dmac;
+	L2Cache *l2cache;
+	DRAMModel *dram;
+	MemTrace *memtrace;
+	InstTrace *insttrace;
+	StallProfiler *stallprof;
+	SymbolTable *symtab;
+	FuncProfiler *funcprof;
+	StatsRegistry *stats;
+	uint32 stats_interval;
+	uint32 next_stats_dump;
+	HostProfiler *hostprof;
+	PerfCounter *perfcounter;
+	EventTrace *eventtrace;
+	FlitTrace *flittrace;
 
 	/* Cached versions of options: */
 	bool		opt_bootmsg;
@@ -135,6 +173,7 @@ public:
 	char		*opt_ttydev;
 	char		*opt_ttydev2;
 	uint32		num_cycles;
+	uint32		num_cycles_high;	// wrap count of num_cycles
 	uint32 		stall_count;
 	uint32		mem_bandwidth;
 	uint32		bus_latency;
@@ -143,6 +182,7 @@ public:
 	bool		mode_cpu_only;
 	bool		mode_cube;
 	bool		mode_bus_conn;
+	bool		mode_noc_bench;
 
 private:
 	Interactor *interactor;
@@ -186,6 +226,12 @@ private:
 
 	virtual bool setup_exe();
 
+	virtual bool setup_topology();
+
+	/* Attach to the shared memory of a distributed simulation of the
+	   Cube network if it is configured. */
+	virtual bool setup_noc_shm();
+
 	virtual bool setup_router();
 
 	virtual bool setup_cube();
@@ -194,12 +240,66 @@ private:
 
 	virtual bool setup_bus_master();
 
+	/* Run the traffic generator benchmark of the Cube network instead
+	   of the machine (system_mode=noc_bench). */
+	int run_noc_bench();
+
+	/* Simulate a node other than the host in a distributed simulation
+	   of the Cube network (cube_shm), until the host halts. */
+	int run_cube_node();
+
 	bool load_elf (FILE *fp);
 	bool load_ecoff (FILE *fp);
 	char *translate_to_host_ram_pointer (uint32 vaddr);
 
 	virtual bool setup_ram();
 
+	/* Initialize the DRAM timing model for the external memories
+	   if it is configured. */
+	virtual bool setup_dram();
+
+	/* Initialize the shared L2 cache if it is configured. */
+	virtual bool setup_l2cache();
+
+	/* Check the geometries of the L1 cache profilers, which the CPU
+	   attaches to its caches, if they are configured. */
+	virtual bool setup_cacheprof();
+
+	/* Open the memory reference trace if it is configured. */
+	virtual bool setup_memtrace();
+
+	/* Open the binary instruction trace if it is configured. */
+	virtual bool setup_insttrace();
+
+	/* Attach the stall attribution profiler if it is configured. */
+	virtual bool setup_stallprof();
+
+	/* Read the symbols of the guest program from symfile (or from
+	   the ELF executable). */
+	virtual bool setup_symbols();
+
+	/* Attach the per-function profiler if it is configured. */
+	virtual bool setup_funcprof();
+
+	/* Register the statistics of the modules and open the interval
+	   dump if it is configured. */
+	virtual bool setup_stats();
+
+	/* Map the performance counters for the guest program if they are
+	   configured. */
+	virtual bool setup_perfcounter();
+
+	/* Open the timeline trace of the modules if it is configured. */
+	virtual bool setup_eventtrace();
+
+	/* Open the binary trace of the flits in the Cube network if it is
+	   configured (attached to the routers by the caller). */
+	virtual bool setup_flittrace();
+
+	/* Start the host-side profiler of the simulator if it is
+	   configured. */
+	virtual bool setup_hostprof();
+
 	virtual bool setup_clock();
 
 	/* Connect the file or device named NAME to line number L of
@@ -232,6 +332,11 @@ public:
 	/* Halt the simulation. */
 	void halt(void);
 
+	/* num_cycles extended to 64 bits */
+	uint64 get_cycles() const {
+		return ((uint64)num_cycles_high << 32) | num_cycles;
+	}
+
 	/* Interact with user. */
 	bool interact(void);
 
@@ -246,6 +351,7 @@ public:
 
 	//step func for each mode
 	void step_cube(void);
+	void step_cube_node(void);
 	void step_cpu_only(void);
 	void step_bus_conn(void);
 